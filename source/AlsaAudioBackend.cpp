@@ -0,0 +1,486 @@
+/*
+    Runs the Processor straight from ALSA on the headless Pi, without the AudioDeviceManager.
+*/
+
+#include "AlsaAudioBackend.h"
+#include "RealtimeThreadPool.h"
+#include <cerrno>
+#include <sys/mman.h>
+
+// In order of preference, the integer formats are little endian like the Pi
+static constexpr snd_pcm_format_t supportedFormats[] =
+{
+    SND_PCM_FORMAT_FLOAT_LE, SND_PCM_FORMAT_S32_LE, SND_PCM_FORMAT_S24_3LE, SND_PCM_FORMAT_S16_LE
+};
+
+static char* getSampleAddress(const snd_pcm_channel_area_t& area, snd_pcm_uframes_t frame) noexcept
+{
+    return static_cast<char*>(area.addr) + (area.first + frame * area.step) / 8;
+}
+
+static void readSamples(snd_pcm_format_t format, const snd_pcm_channel_area_t& area, snd_pcm_uframes_t offset,
+                        float* destination, int numSamples) noexcept
+{
+    auto* source = getSampleAddress(area, offset);
+    auto stride = area.step / 8;
+
+    switch (format)
+    {
+        case SND_PCM_FORMAT_FLOAT_LE:
+            for (int i = 0; i < numSamples; ++i, source += stride)
+                std::memcpy(destination + i, source, sizeof(float));
+            break;
+
+        case SND_PCM_FORMAT_S32_LE:
+            for (int i = 0; i < numSamples; ++i, source += stride)
+            {
+                int32_t sample;
+                std::memcpy(&sample, source, sizeof(sample));
+                destination[i] = (float) sample * (1.0f / 2147483648.0f);
+            }
+            break;
+
+        case SND_PCM_FORMAT_S24_3LE:
+            for (int i = 0; i < numSamples; ++i, source += stride)
+            {
+                auto* bytes = reinterpret_cast<const uint8_t*>(source);
+                auto sample = (int32_t) (((uint32_t) bytes[0] << 8) | ((uint32_t) bytes[1] << 16) | ((uint32_t) bytes[2] << 24)) >> 8;
+                destination[i] = (float) sample * (1.0f / 8388608.0f);
+            }
+            break;
+
+        case SND_PCM_FORMAT_S16_LE:
+            for (int i = 0; i < numSamples; ++i, source += stride)
+            {
+                int16_t sample;
+                std::memcpy(&sample, source, sizeof(sample));
+                destination[i] = (float) sample * (1.0f / 32768.0f);
+            }
+            break;
+
+        default:
+            juce::FloatVectorOperations::clear(destination, numSamples);
+            break;
+    }
+}
+
+static void writeSamples(snd_pcm_format_t format, const float* source, const snd_pcm_channel_area_t& area,
+                         snd_pcm_uframes_t offset, int numSamples) noexcept
+{
+    auto* destination = getSampleAddress(area, offset);
+    auto stride = area.step / 8;
+
+    switch (format)
+    {
+        case SND_PCM_FORMAT_FLOAT_LE:
+            for (int i = 0; i < numSamples; ++i, destination += stride)
+                std::memcpy(destination, source + i, sizeof(float));
+            break;
+
+        case SND_PCM_FORMAT_S32_LE:
+            for (int i = 0; i < numSamples; ++i, destination += stride)
+            {
+                auto sample = (int32_t) (juce::jlimit(-1.0f, 1.0f, source[i]) * 2147483647.0);
+                std::memcpy(destination, &sample, sizeof(sample));
+            }
+            break;
+
+        case SND_PCM_FORMAT_S24_3LE:
+            for (int i = 0; i < numSamples; ++i, destination += stride)
+            {
+                auto sample = (int32_t) (juce::jlimit(-1.0f, 1.0f, source[i]) * 8388607.0f);
+                auto* bytes = reinterpret_cast<uint8_t*>(destination);
+                bytes[0] = (uint8_t) sample;
+                bytes[1] = (uint8_t) (sample >> 8);
+                bytes[2] = (uint8_t) (sample >> 16);
+            }
+            break;
+
+        case SND_PCM_FORMAT_S16_LE:
+            for (int i = 0; i < numSamples; ++i, destination += stride)
+            {
+                auto sample = (int16_t) (juce::jlimit(-1.0f, 1.0f, source[i]) * 32767.0f);
+                std::memcpy(destination, &sample, sizeof(sample));
+            }
+            break;
+
+        default:
+            snd_pcm_area_silence(&area, offset, (unsigned int) numSamples, format);
+            break;
+    }
+}
+
+//==============================================================================
+AlsaAudioBackend::~AlsaAudioBackend()
+{
+    close();
+}
+
+juce::Result AlsaAudioBackend::open(const Options& newOptions)
+{
+    close();
+    options = newOptions;
+
+    auto rate = options.sampleRate;
+    auto period = (snd_pcm_uframes_t) options.periodSize;
+    auto captureBuffer = period * (snd_pcm_uframes_t) options.numPeriods;
+    auto result = openStream(capture, options.captureDevice, SND_PCM_STREAM_CAPTURE, (unsigned int) options.numInputChannels,
+                             rate, period, captureBuffer);
+
+    // The playback side asks for whatever the capture side settled on, they have to run in step
+    sampleRate = rate;
+    periodSize = period;
+    bufferSize = period * (snd_pcm_uframes_t) options.numPeriods;
+
+    if (result.wasOk())
+        result = openStream(playback, options.playbackDevice, SND_PCM_STREAM_PLAYBACK, (unsigned int) options.numOutputChannels,
+                            rate, period, bufferSize);
+
+    if (result.wasOk() && (rate != sampleRate || period != periodSize))
+        result = juce::Result::fail("The capture and playback devices do not agree on the rate and period: "
+                                    + juce::String(sampleRate) + " Hz and " + juce::String((int) periodSize) + " frames against "
+                                    + juce::String(rate) + " Hz and " + juce::String((int) period) + " frames");
+
+    if (result.failed())
+    {
+        close();
+        return result;
+    }
+
+    // Linked streams start and stop on the same frame, devices that can not be linked are started one after the other
+    linked = snd_pcm_link(capture.handle, playback.handle) == 0;
+    return juce::Result::ok();
+}
+
+juce::Result AlsaAudioBackend::openStream(Stream& stream, const juce::String& device, snd_pcm_stream_t direction, unsigned int numChannels,
+                                          unsigned int& rate, snd_pcm_uframes_t& period, snd_pcm_uframes_t& bufferFrames)
+{
+    auto fail = [&device](const char* what, int error)
+    {
+        return juce::Result::fail(juce::String(what) + " " + device + ": " + snd_strerror(error));
+    };
+
+    auto error = snd_pcm_open(&stream.handle, device.toRawUTF8(), direction, 0);
+
+    if (error < 0)
+        return fail("Could not open", error);
+
+    snd_pcm_hw_params_t* hardware;
+    snd_pcm_hw_params_alloca(&hardware);
+    snd_pcm_hw_params_any(stream.handle, hardware);
+
+    // Samples are converted straight in and out of the driver's buffer, interleaved or not
+    snd_pcm_access_mask_t* access;
+    snd_pcm_access_mask_alloca(&access);
+    snd_pcm_access_mask_none(access);
+    snd_pcm_access_mask_set(access, SND_PCM_ACCESS_MMAP_INTERLEAVED);
+    snd_pcm_access_mask_set(access, SND_PCM_ACCESS_MMAP_NONINTERLEAVED);
+
+    if ((error = snd_pcm_hw_params_set_access_mask(stream.handle, hardware, access)) < 0)
+        return fail("No mmap access on", error);
+
+    stream.format = SND_PCM_FORMAT_UNKNOWN;
+
+    for (auto format : supportedFormats)
+    {
+        if (snd_pcm_hw_params_test_format(stream.handle, hardware, format) == 0)
+        {
+            stream.format = format;
+            break;
+        }
+    }
+
+    if (stream.format == SND_PCM_FORMAT_UNKNOWN)
+        return juce::Result::fail("No supported sample format on " + device);
+
+    // Resampling in a plugin would add latency, the device has to run at the rate itself
+    stream.numChannels = numChannels;
+    snd_pcm_hw_params_set_format(stream.handle, hardware, stream.format);
+    snd_pcm_hw_params_set_rate_resample(stream.handle, hardware, 0);
+    snd_pcm_hw_params_set_channels_near(stream.handle, hardware, &stream.numChannels);
+    snd_pcm_hw_params_set_rate_near(stream.handle, hardware, &rate, nullptr);
+    snd_pcm_hw_params_set_period_size_near(stream.handle, hardware, &period, nullptr);
+    snd_pcm_hw_params_set_buffer_size_near(stream.handle, hardware, &bufferFrames);
+
+    if ((error = snd_pcm_hw_params(stream.handle, hardware)) < 0)
+        return fail("Could not configure", error);
+
+    stream.numUsedChannels = juce::jmin(numChannels, stream.numChannels);
+
+    // Started by hand once the playback buffer holds silence, and woken once a period
+    snd_pcm_sw_params_t* software;
+    snd_pcm_sw_params_alloca(&software);
+    snd_pcm_sw_params_current(stream.handle, software);
+
+    snd_pcm_uframes_t boundary;
+    snd_pcm_sw_params_get_boundary(software, &boundary);
+    snd_pcm_sw_params_set_start_threshold(stream.handle, software, boundary);
+    snd_pcm_sw_params_set_avail_min(stream.handle, software, period);
+
+    if ((error = snd_pcm_sw_params(stream.handle, software)) < 0)
+        return fail("Could not configure", error);
+
+    return juce::Result::ok();
+}
+
+void AlsaAudioBackend::close()
+{
+    stop();
+
+    for (auto* stream : { &capture, &playback })
+    {
+        if (stream->handle != nullptr)
+            snd_pcm_close(stream->handle);
+
+        *stream = {};
+    }
+
+    linked = false;
+}
+
+//==============================================================================
+juce::Result AlsaAudioBackend::start(juce::AudioProcessor& processorToRun)
+{
+    if (capture.handle == nullptr || playback.handle == nullptr)
+        return juce::Result::fail("No ALSA device is open");
+
+    stop();
+
+    // A prepare that fails here would fail on the audio thread too, better to hear about it now
+    for (auto* stream : { &capture, &playback })
+        if (auto error = snd_pcm_prepare(stream->handle); error < 0)
+            return juce::Result::fail(juce::String("Could not prepare the ALSA device: ") + snd_strerror(error));
+
+    processor = &processorToRun;
+    buffer.setSize(juce::jmax(processor->getTotalNumInputChannels(), processor->getTotalNumOutputChannels(), 1), (int) periodSize);
+    processor->setRateAndBufferSizeDetails(sampleRate, (int) periodSize);
+    processor->prepareToPlay(sampleRate, (int) periodSize);
+
+    // Everything mapped now and later (the heap, the stacks, the libraries) stays in RAM, so the
+    // audio thread never waits on a page fault. Needs CAP_IPC_LOCK or a memlock limit.
+    memoryLocked = mlockall(MCL_CURRENT | MCL_FUTURE) == 0;
+
+    xruns = 0;
+    lastError = 0;
+    roundTripLatency = -1;
+    maxRoundTripLatency = -1;
+    stopping = false;
+    running = true;
+    thread = std::thread(&AlsaAudioBackend::audioThread, this);
+
+    return juce::Result::ok();
+}
+
+void AlsaAudioBackend::stop()
+{
+    stopping = true;
+
+    if (thread.joinable())
+        thread.join();
+
+    for (auto* stream : { &capture, &playback })
+        if (stream->handle != nullptr)
+            snd_pcm_drop(stream->handle);
+
+    if (processor != nullptr)
+        processor->releaseResources();
+
+    processor = nullptr;
+    running = false;
+}
+
+juce::String AlsaAudioBackend::getLastErrorMessage() const
+{
+    auto error = lastError.load();
+    return error < 0 ? juce::String(snd_strerror(error)) : juce::String();
+}
+
+//==============================================================================
+void AlsaAudioBackend::audioThread()
+{
+    realtimePriority = RealtimeThreadPool::setCurrentThreadRealtime(options.core, options.priority);
+    juce::FloatVectorOperations::disableDenormalisedNumberSupport();
+
+    // The streams start here rather than in start(), so the first period is already on time
+    auto error = restartStreams();
+
+    while (error >= 0 && ! stopping.load(std::memory_order_relaxed))
+    {
+        // Wakes up once a period of input is in, the timeout only matters if the device hangs
+        error = snd_pcm_wait(capture.handle, 1000);
+
+        if (error == 0)
+            error = -EIO;
+
+        auto available = error > 0 ? snd_pcm_avail_update(capture.handle) : 0;
+
+        if (available < 0)
+            error = (int) available;
+
+        if (error >= 0 && (snd_pcm_uframes_t) available >= periodSize)
+        {
+            error = readPeriod();
+
+            if (error >= 0)
+            {
+                midiMessages.clear();
+                processor->processBlock(buffer, midiMessages);
+                error = writePeriod();
+            }
+
+            // Both counters at the same moment: the period's last sample was captured captureDelay
+            // frames ago and gets played in playbackDelay frames
+            snd_pcm_sframes_t captureDelay, playbackDelay;
+
+            if (error >= 0 && snd_pcm_delay(capture.handle, &captureDelay) == 0 && snd_pcm_delay(playback.handle, &playbackDelay) == 0)
+            {
+                auto latency = (int) (captureDelay + playbackDelay);
+                roundTripLatency.store(latency, std::memory_order_relaxed);
+
+                if (latency > maxRoundTripLatency.load(std::memory_order_relaxed))
+                    maxRoundTripLatency.store(latency, std::memory_order_relaxed);
+            }
+        }
+
+        // An overrun or underrun (EPIPE) or a suspend (ESTRPIPE): count it and start over with fresh silence
+        if (error == -EPIPE || error == -ESTRPIPE)
+        {
+            xruns.fetch_add(1, std::memory_order_relaxed);
+            error = restartStreams();
+        }
+    }
+
+    lastError = error < 0 ? error : 0;
+    running = false;
+}
+
+int AlsaAudioBackend::restartStreams() noexcept
+{
+    snd_pcm_drop(capture.handle);
+    snd_pcm_drop(playback.handle);
+
+    int error;
+
+    if ((error = snd_pcm_prepare(capture.handle)) < 0 || (error = snd_pcm_prepare(playback.handle)) < 0)
+        return error;
+
+    // The round trip is the playback buffer plus a period, so the buffer starts out full
+    for (snd_pcm_uframes_t filled = 0; filled < bufferSize;)
+    {
+        const snd_pcm_channel_area_t* areas;
+        snd_pcm_uframes_t offset, frames = bufferSize - filled;
+        snd_pcm_avail_update(playback.handle);
+
+        if ((error = snd_pcm_mmap_begin(playback.handle, &areas, &offset, &frames)) < 0)
+            return error;
+
+        if (frames == 0)
+            break;
+
+        snd_pcm_areas_silence(areas, offset, playback.numChannels, frames, playback.format);
+        auto committed = snd_pcm_mmap_commit(playback.handle, offset, frames);
+
+        if (committed < 0)
+            return (int) committed;
+
+        filled += (snd_pcm_uframes_t) committed;
+    }
+
+    if ((error = snd_pcm_start(capture.handle)) < 0)
+        return error;
+
+    if (! linked && (error = snd_pcm_start(playback.handle)) < 0)
+        return error;
+
+    return 0;
+}
+
+int AlsaAudioBackend::readPeriod() noexcept
+{
+    auto numChannels = (int) juce::jmin(capture.numUsedChannels, (unsigned int) buffer.getNumChannels());
+
+    for (snd_pcm_uframes_t done = 0; done < periodSize;)
+    {
+        const snd_pcm_channel_area_t* areas;
+        snd_pcm_uframes_t offset, frames = periodSize - done;
+
+        if (auto error = snd_pcm_mmap_begin(capture.handle, &areas, &offset, &frames); error < 0)
+            return error;
+
+        // Less than was available means the stream fell over in between
+        if (frames == 0)
+            return -EPIPE;
+
+        for (int ch = 0; ch < numChannels; ++ch)
+            readSamples(capture.format, areas[ch], offset, buffer.getWritePointer(ch, (int) done), (int) frames);
+
+        auto committed = snd_pcm_mmap_commit(capture.handle, offset, frames);
+
+        if (committed < 0)
+            return (int) committed;
+
+        if ((snd_pcm_uframes_t) committed != frames)
+            return -EPIPE;
+
+        done += frames;
+    }
+
+    // A mono guitar input goes to every channel, as the offline renderer does with mono files
+    for (int ch = numChannels; ch < buffer.getNumChannels(); ++ch)
+        buffer.copyFrom(ch, 0, buffer, numChannels - 1, 0, (int) periodSize);
+
+    return 0;
+}
+
+int AlsaAudioBackend::writePeriod() noexcept
+{
+    auto numChannels = (unsigned int) juce::jmin(playback.numUsedChannels, (unsigned int) buffer.getNumChannels());
+
+    for (snd_pcm_uframes_t done = 0; done < periodSize;)
+    {
+        auto available = snd_pcm_avail_update(playback.handle);
+
+        if (available < 0)
+            return (int) available;
+
+        // A period plays out as one is captured, so this only waits if the two devices' clocks drift apart
+        if ((snd_pcm_uframes_t) available < periodSize - done)
+        {
+            auto error = snd_pcm_wait(playback.handle, 1000);
+
+            if (error <= 0)
+                return error < 0 ? error : -EIO;
+
+            continue;
+        }
+
+        const snd_pcm_channel_area_t* areas;
+        snd_pcm_uframes_t offset, frames = periodSize - done;
+
+        if (auto error = snd_pcm_mmap_begin(playback.handle, &areas, &offset, &frames); error < 0)
+            return error;
+
+        if (frames == 0)
+            return -EPIPE;
+
+        for (unsigned int ch = 0; ch < playback.numChannels; ++ch)
+        {
+            if (ch < numChannels)
+                writeSamples(playback.format, buffer.getReadPointer((int) ch, (int) done), areas[ch], offset, (int) frames);
+            else
+                snd_pcm_area_silence(&areas[ch], offset, (unsigned int) frames, playback.format);
+        }
+
+        auto committed = snd_pcm_mmap_commit(playback.handle, offset, frames);
+
+        if (committed < 0)
+            return (int) committed;
+
+        if ((snd_pcm_uframes_t) committed != frames)
+            return -EPIPE;
+
+        done += frames;
+    }
+
+    return 0;
+}
@@ -0,0 +1,106 @@
+/*
+    Runs the Processor straight from ALSA on the headless Pi, without the AudioDeviceManager.
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <alsa/asoundlib.h>
+#include <atomic>
+#include <thread>
+
+/** Opens a capture and a playback PCM with mmap access and a fixed period, and calls the
+    processor's processBlock() once a period from a SCHED_FIFO thread pinned to its own core,
+    with the process's memory locked so a page fault can not stall it.
+
+    The two streams are linked so they start on the same frame, with the playback buffer
+    filled with silence first: the round trip is then one period of capture plus the playback
+    buffer, and stays there unless an xrun restarts the streams. An xrun is counted and
+    recovered from, the callback carries on.
+
+    Any ALSA device works, including "null", which runs as fast as the CPU allows, and the
+    snd-aloop "hw:Loopback" devices for testing without an interface.
+*/
+class AlsaAudioBackend
+{
+public:
+    struct Options
+    {
+        juce::String captureDevice { "hw:0" };
+        juce::String playbackDevice { "hw:0" };
+        unsigned int sampleRate = 48000;
+        int periodSize = 64;
+        int numPeriods = 2;
+        int numInputChannels = 1;       // A mono input goes to every channel of the processor
+        int numOutputChannels = 2;
+        int priority = 80;              // Above the thread pool's workers
+        int core = 0;                   // The pool's workers start on core 1
+    };
+
+    AlsaAudioBackend() = default;
+    ~AlsaAudioBackend();
+
+    /** Opens and configures both streams. The device may settle on a different rate or period,
+        see getSampleRate() and getPeriodSize().
+    */
+    juce::Result open(const Options& options);
+
+    /** Prepares the processor and starts the audio thread. The processor has to outlive stop(). */
+    juce::Result start(juce::AudioProcessor& processor);
+    void stop();
+    void close();
+
+    /** False once the audio thread gave up on an error it could not recover from, such as an unplugged interface */
+    bool isRunning() const noexcept { return running.load(); }
+
+    /** The ALSA error the audio thread gave up on, as a negative errno, or 0 if it has not given up */
+    int getLastError() const noexcept { return lastError.load(); }
+    juce::String getLastErrorMessage() const;
+
+    unsigned int getSampleRate() const noexcept { return sampleRate; }
+    int getPeriodSize() const noexcept { return (int) periodSize; }
+    int getBufferSize() const noexcept { return (int) bufferSize; }
+
+    bool hasRealtimePriority() const noexcept { return realtimePriority.load(); }
+    bool isMemoryLocked() const noexcept { return memoryLocked; }
+
+    int getXRunCount() const noexcept { return xruns.load(); }
+
+    /** Frames from a sample being captured to it being played, from the driver's counters after every
+        period, or -1 before the first period. The max is the worst since start().
+    */
+    int getRoundTripLatency() const noexcept { return roundTripLatency.load(); }
+    int getMaxRoundTripLatency() const noexcept { return maxRoundTripLatency.load(); }
+
+private:
+    struct Stream
+    {
+        snd_pcm_t* handle = nullptr;
+        snd_pcm_format_t format = SND_PCM_FORMAT_UNKNOWN;
+        unsigned int numChannels = 0;
+        unsigned int numUsedChannels = 0;
+    };
+
+    // Asks for the rate, period and buffer size, and hands back what the device settled on
+    juce::Result openStream(Stream& stream, const juce::String& device, snd_pcm_stream_t direction, unsigned int numChannels,
+                            unsigned int& rate, snd_pcm_uframes_t& period, snd_pcm_uframes_t& bufferFrames);
+    int restartStreams() noexcept;
+    int readPeriod() noexcept;
+    int writePeriod() noexcept;
+    void audioThread();
+
+    Options options;
+    Stream capture, playback;
+    bool linked = false;
+    unsigned int sampleRate = 0;
+    snd_pcm_uframes_t periodSize = 0, bufferSize = 0;
+
+    juce::AudioProcessor* processor = nullptr;
+    juce::AudioBuffer<float> buffer;
+    juce::MidiBuffer midiMessages;
+
+    std::thread thread;
+    std::atomic<bool> stopping { false }, running { false }, realtimePriority { false };
+    bool memoryLocked = false;
+    std::atomic<int> xruns { 0 }, roundTripLatency { -1 }, maxRoundTripLatency { -1 }, lastError { 0 };
+};
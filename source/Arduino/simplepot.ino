@@ -9,7 +9,11 @@ const int numPots = 3; // Number of pots
 #define MIDI_MAX_VALUE 127
 #define ANALOG_MIN_VALUE 0
 #define ANALOG_MAX_VALUE 1027
-#define BAUD_RATE 9600
+#define BAUD_RATE 115200 // Must match the --baud option of GuitarFX
+#define TAP_TEMPO_PIN 2 // Footswitch to ground
+#define TAP_TEMPO_CC 80 // Must match the --tap-cc option of GuitarFX
+#define MIDI_CHANNEL 1 // 1-16, rig n of a --rigs host listens on channel n + 1 unless it has its own --rig-serial port
+#define DEBOUNCE_MS 20
 
 
 // Define a struct to hold potentiometer data
@@ -28,9 +32,27 @@ Potentiometer pots[numPots] =
     {A2, 3, -1}
 };
 
+int previousSwitchState = HIGH;
+unsigned long lastSwitchChange = 0;
+
+void sendControlChange(int ccNumber, int value)
+{
+    // Construct MIDI Control Change message as an array of bytes
+    unsigned char midiMessage[] = 
+    {
+      MIDI_CONTROL_CHANGE_STATUS_BYTE | ((MIDI_CHANNEL - 1) & 0x0F), // Set MIDI channel        
+      (unsigned char)ccNumber & 0x7F, // MIDI CC number
+      (unsigned char)value & 0x7F, // MIDI value
+      STOP_BYTE // Stop byte to indicate the end of the message
+    };
+    // Send MIDI message
+    Serial.write(midiMessage, sizeof(midiMessage));
+}
+
 void setup() 
 {
     Serial.begin(BAUD_RATE);
+    pinMode(TAP_TEMPO_PIN, INPUT_PULLUP);
 }
 
 void loop() 
@@ -43,20 +65,21 @@ void loop()
 
         if (abs(mappedPotValue - pots[i].previousValue) > THRESHOLD) 
         {
-            // Construct MIDI Control Change message as an array of bytes
-            unsigned char midiMessage[] = 
-            {
-              MIDI_CONTROL_CHANGE_STATUS_BYTE | (pots[i].ccNumber & 0x00), // Set MIDI channel        
-              (unsigned char)pots[i].ccNumber & 0x7F, // MIDI CC number
-              (unsigned char)mappedPotValue & 0x7F, // MIDI value
-              STOP_BYTE // Stop byte to indicate the end of the message
-            };
-          // Send MIDI message
-          Serial.write(midiMessage, sizeof(midiMessage));
-          pots[i].previousValue = mappedPotValue;
+            sendControlChange(pots[i].ccNumber, mappedPotValue);
+            pots[i].previousValue = mappedPotValue;
         }
     }
 
+    // Send the tap tempo footswitch straight away, the time between presses is the tempo
+    int switchState = digitalRead(TAP_TEMPO_PIN);
+
+    if (switchState != previousSwitchState && millis() - lastSwitchChange > DEBOUNCE_MS)
+    {
+        sendControlChange(TAP_TEMPO_CC, switchState == LOW ? MIDI_MAX_VALUE : MIDI_MIN_VALUE);
+        previousSwitchState = switchState;
+        lastSwitchChange = millis();
+    }
+
     // Add a small delay to prevent flooding the serial port
     delay(10);
 }
\ No newline at end of file
@@ -3,32 +3,35 @@
 */
 
 #include "ArduinoSerialReader.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
 #include <fcntl.h>
+#include <poll.h>
 #include <unistd.h>
 
-ArduinoSerialReader::ArduinoSerialReader(const char* portName, speed_t baudRate, Processor& processor) 
-    :   processorRef(processor), 
+ArduinoSerialReader::ArduinoSerialReader(const char* portName, speed_t baudRate, Processor& processor)
+    :   ArduinoSerialReader(portName, baudRate, [&processor] (const juce::MidiMessage& message) { processor.handleMidiMessage(message); })
+{
+}
+
+ArduinoSerialReader::ArduinoSerialReader(const char* portName, speed_t baudRate, MessageHandler handler) 
+    :   messageHandler(std::move(handler)), 
         serialPortFd_(-1), 
         portName_(portName), 
         baudRate_(baudRate), 
         stop_(false) 
 {
-    // Open serial port
-    serialPortFd_ = open(portName_, O_RDWR | O_NOCTTY);
-    if (serialPortFd_ < 0) 
+    // Used to wake the read thread out of poll() when it has to stop
+    if (pipe2(wakePipe_, O_NONBLOCK | O_CLOEXEC) < 0)
     {
-        perror("Error opening serial port");
+        perror("Error creating serial wake pipe");
         return;
     }
 
-    // Configure serial port settings
-    struct termios options;
-    tcgetattr(serialPortFd_, &options);
-    cfsetispeed(&options, baudRate_); // Set input baud rate
-    options.c_cflag |= (CLOCAL | CREAD); // Enable receiver and set local mode
-    tcsetattr(serialPortFd_, TCSANOW, &options);
+    openPort();
 
-    // Create thread for serial read operation
+    // Create thread for serial read operation, it keeps trying to reopen the port if it is missing
     readThread_ = std::thread(&ArduinoSerialReader::serialReadThread, this);
 }
 
@@ -37,56 +40,145 @@ ArduinoSerialReader::~ArduinoSerialReader()
     // Signal the thread to stop
     stop_ = true;
 
-    // Wait for thread to finish
-    readThread_.join();
+    if (wakePipe_[1] >= 0)
+    {
+        unsigned char wake = 0;
+        ssize_t ignored = write(wakePipe_[1], &wake, 1);
+        (void) ignored;
+    }
+
+    // Wait for thread to finish, there is none if the wake pipe failed
+    if (readThread_.joinable())
+        readThread_.join();
 
-    // Close serial port
-    close(serialPortFd_);
+    closePort();
+
+    for (auto fd : wakePipe_)
+        if (fd >= 0)
+            close(fd);
+}
+
+speed_t ArduinoSerialReader::getSpeedForBaudRate(int baudRate)
+{
+    switch (baudRate)
+    {
+        case 9600:      return B9600;
+        case 19200:     return B19200;
+        case 38400:     return B38400;
+        case 57600:     return B57600;
+        case 115200:    return B115200;
+        case 230400:    return B230400;
+        case 460800:    return B460800;
+        case 500000:    return B500000;
+        case 921600:    return B921600;
+        case 1000000:   return B1000000;
+        case 2000000:   return B2000000;
+        default:        return B0;
+    }
+}
+
+bool ArduinoSerialReader::openPort()
+{
+    // Open serial port, non-blocking so a burst can be read until it runs dry
+    serialPortFd_ = open(portName_.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if (serialPortFd_ < 0) 
+    {
+        // It is retried every REOPEN_INTERVAL_MS while the Arduino is unplugged, so only a new error is logged
+        auto error = errno;
+
+        if (error != lastOpenError_)
+            fprintf(stderr, "Error opening serial port %s: %s\n", portName_.c_str(), strerror(error));
+
+        lastOpenError_ = error;
+        return false;
+    }
+
+    if (lastOpenError_ != 0)
+        fprintf(stderr, "Serial port %s is open again\n", portName_.c_str());
+
+    lastOpenError_ = 0;
+
+    // Raw mode: no line buffering, echo or byte translation, every byte is handed over as it arrives
+    struct termios options;
+    tcgetattr(serialPortFd_, &options);
+    cfmakeraw(&options);
+    cfsetispeed(&options, baudRate_);
+    cfsetospeed(&options, baudRate_);
+    options.c_cflag |= (CLOCAL | CREAD); // Enable receiver and set local mode
+    options.c_cc[VMIN] = 1;   // poll() wakes up on the first byte
+    options.c_cc[VTIME] = 0;  // and there is no inter-byte timer holding data back
+    tcsetattr(serialPortFd_, TCSANOW, &options);
+    tcflush(serialPortFd_, TCIFLUSH);
+
+    // Whatever was half received before the port went away is gone
+    parser_.reset();
+    return true;
+}
+
+void ArduinoSerialReader::closePort()
+{
+    if (serialPortFd_ >= 0)
+        close(serialPortFd_);
+
+    serialPortFd_ = -1;
 }
 
 void ArduinoSerialReader::serialReadThread() 
 {
-    // Buffer to store the received bytes (3 MIDI bytes + STOP_BYTE + null terminator)
-    unsigned char buffer[4]; 
-    size_t index = 0;
+    unsigned char burst[256];
 
     while (!stop_) 
     {
-        // Read from serial port
-        unsigned char c;
-        if (read(serialPortFd_, &c, 1) > 0) 
+        pollfd fds[2] = { { wakePipe_[0], POLLIN, 0 }, { serialPortFd_, POLLIN, 0 } };
+        auto portIsOpen = serialPortFd_ >= 0;
+
+        // Sleeps until there is data or we are asked to stop, costing nothing while the pots are still
+        if (poll(fds, portIsOpen ? 2 : 1, portIsOpen ? -1 : REOPEN_INTERVAL_MS) < 0)
+            continue;
+
+        if (stop_)
+            break;
+
+        if (! portIsOpen)
         {
-            if (c == STOP_BYTE) 
-            {
-                // Process received data
-                buffer[index] = '\0'; // Null-terminate the string
-                processArduinoData(buffer);
-                index = 0; // Reset index for the next packet
-            } 
-            else 
-            {
-                buffer[index++] = c;
-                if (index >= sizeof(buffer)) 
+            openPort();
+            continue;
+        }
+
+        if (fds[1].revents & (POLLERR | POLLHUP | POLLNVAL))
+        {
+            // The Arduino was unplugged, reopen it once it comes back
+            fprintf(stderr, "Serial port %s closed\n", portName_.c_str());
+            closePort();
+            continue;
+        }
+
+        if (fds[1].revents & POLLIN)
+        {
+            // Drain everything that arrived and parse all complete frames in one go
+            ssize_t numRead;
+
+            while ((numRead = read(serialPortFd_, burst, sizeof(burst))) > 0)
+                parser_.feed(burst, (size_t) numRead, [this] (const unsigned char* data, size_t size)
                 {
-                    // Buffer overflow, discard the packet
-                    index = 0;
-                }
-            }
+                    processArduinoData(data, size);
+                });
         }
-        usleep(1000);
     }
 }
 
-void ArduinoSerialReader::processArduinoData(unsigned char* data) 
+void ArduinoSerialReader::processArduinoData(const unsigned char* data, size_t size) 
 {    
-    // Check if the MIDI status byte indicates a Control Change message
-    if (data[0] == MIDI_CC_STATUS_BYTE) {
-        
-        juce::MidiMessage message(data, 3);
-        processorRef.handleMidiMessage(message);
-    } 
-    else 
-    {
-        DBG("Unexpected MIDI message received");
-    }
+    // The sketch ends every message with STOP_BYTE, which the parser hands over as a realtime message
+    if (size == 1 && data[0] == STOP_BYTE)
+        return;
+
+    // Nothing handles SysEx, and MidiMessage would allocate a copy of anything longer than a short
+    // message. The parser has already counted it in the statistics.
+    if (data[0] == 0xf0)
+        return;
+
+    // Messages of up to three bytes fit inside MidiMessage, so this does not allocate
+    juce::MidiMessage message(data, (int) size);
+    messageHandler(message);
 }
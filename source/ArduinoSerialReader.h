@@ -6,32 +6,47 @@
 
 #include <thread>
 #include <atomic>
+#include <functional>
+#include <string>
 #include <termios.h>
 #include "AudioProcessor.h"
+#include "MidiStreamParser.h"
 
 class ArduinoSerialReader
 {
 public:
+    using MessageHandler = std::function<void(const juce::MidiMessage&)>;
+
     ArduinoSerialReader(const char* portName, speed_t baudRate, Processor& processor);
+
+    // Hands every message to handler on the read thread instead, such as a RigHost routing it to a rig
+    ArduinoSerialReader(const char* portName, speed_t baudRate, MessageHandler handler);
     ~ArduinoSerialReader();
 
+    // Returns B0 for a rate termios does not support
+    static speed_t getSpeedForBaudRate(int baudRate);
+
+    // Message and error counters of the incoming stream, safe to read from any thread
+    const MidiStreamParser::Statistics& getStatistics() const { return parser_.getStatistics(); }
+
 private:
-    Processor& processorRef;
+    MessageHandler messageHandler;
+    bool openPort();
+    void closePort();
     void serialReadThread();
-    void processArduinoData(unsigned char* data);
-    void prepare();
+    void processArduinoData(const unsigned char* data, size_t size);
 
-    unsigned char serialBuffer[4];
+    MidiStreamParser parser_;
 
     int serialPortFd_;
-    const char* portName_;
+    int wakePipe_[2] = { -1, -1 };
+    std::string portName_;
     speed_t baudRate_;
     std::thread readThread_;
     std::atomic<bool> stop_;
+    int lastOpenError_ = 0;     // errno of the last failed open, 0 while the port opens
 
     // Byte definitions
-    static constexpr unsigned char MIDI_CC_STATUS_BYTE = 0xB0U;
-    static constexpr unsigned char MIDI_CC_NUMBER = 1;
-    static constexpr unsigned char MIDI_VALUE = 2;
     static constexpr unsigned char STOP_BYTE = 0xFFU;
-};
\ No newline at end of file
+    static constexpr int REOPEN_INTERVAL_MS = 1000;
+};
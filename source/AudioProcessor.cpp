@@ -3,74 +3,418 @@
 */
 
 #include "AudioProcessor.h"
+#include "RealtimeChecker.h"
+
+// Indexed by Processor::ParameterIndex
+static constexpr const char* parameterIDs[] =
+{
+    "GATETHRESHOLD", "GATERELEASE", "TUNER",
+    "COMPRESSORATTACK", "COMPRESSORRELEASE", "COMPRESSORRATIO", "COMPRESSORTHRESHOLD",
+    "PREGAIN",
+    "DRIVEGAIN", "DRIVECURVE", "DRIVETIGHT", "DRIVETONE", "DRIVELEVEL", "DRIVEOVERSAMPLING",
+    "CHORUSCENTREDELAY", "CHORUSDEPTH", "CHORUSFEEDBACK", "CHORUSMIX", "CHORUSRATE",
+    "REVERBROOMSIZE", "REVERBDAMPING", "REVERBWETLEVEL", "REVERBDRYLEVEL", "REVERBWIDTH", "REVERBFREEZEMODE",
+    "DELAYMAXTIME", "DELAYLEFTTIME", "DELAYRIGHTTIME", "DELAYWETLEVEL", "DELAYFEEDBACK", "DELAYINTERPOLATION", "DELAYSATURATION",
+    "MULTITAPTAPS", "MULTITAPTEMPO", "MULTITAPDIVISION", "MULTITAPFEEDBACK", "MULTITAPWETLEVEL", "MULTITAPDECAY", "MULTITAPSPREAD", "MULTITAPTONE",
+    "CONVOLUTIONWETLEVEL", "CONVOLUTIONDRYLEVEL",
+    "MASTERGAIN"
+};
+
+static_assert (std::size (parameterIDs) == Processor::numParameters, "parameterIDs is out of sync with ParameterIndex");
 
 Processor::Processor() : juce::AudioProcessor (BusesProperties()
                         .withInput("Input", juce::AudioChannelSet::stereo(), true)
                         .withOutput ("Output", juce::AudioChannelSet::stereo(), true)),
                         treeState(*this, nullptr, juce::Identifier("Parameters"), createParameterLayout())
 {
-    
-    auto& compressor = processorChain.template get<compressorIndex>();
-    compressor.setAttack(5.0f);
-    compressor.setRelease(2.0f);
-    compressor.setRatio(1.5f);
-    compressor.setThreshold(4.0f);
-
-    auto& gain = processorChain.template get<gainIndex>();
-    gain.setGainLinear(1.0f);
-
-    auto& chorus = processorChain.template get<chorusIndex>();
-    chorus.setCentreDelay(30.0f);
-    chorus.setDepth(0.2f);
-    chorus.setFeedback(0.5f);
-    chorus.setMix(0.5f);
-    chorus.setRate(3.0f);
-    processorChain.setBypassed<chorusIndex>(true);
-
-    auto& delay = processorChain.template get<delayIndex>();
-    delay.setMaxDelayTime (0.4f);
-    delay.setDelayTime (0, 0.2f);
-    delay.setDelayTime (1, 0.3f);
-    delay.setWetLevel (1.0f);
-    delay.setFeedback (1.0f);
-
-    auto& reverb = processorChain.template get<reverbIndex>();
-    reverbParams.roomSize = 0.2f;
-    reverbParams.damping = 0.5f; 
-    reverbParams.wetLevel = 0.33f;
-    reverbParams.dryLevel = 1.0f;
-    reverbParams.width = 0.5f;
-    reverbParams.freezeMode = 0.0f; 
-    reverb.setParameters(reverbParams);
-
-    auto& masterGain = processorChain.template get<masterGainIndex>();
-    masterGain.setGainLinear(1.0f);
-}
-
-Processor::~Processor(){  }
+    // Resolve the parameters once so nothing downstream has to look them up by name
+    for (size_t i = 0; i < numParameters; ++i)
+    {
+        parameters[i] = treeState.getParameter (parameterIDs[i]);
+        rawValues[i] = treeState.getRawParameterValue (parameterIDs[i]);
+        jassert (parameters[i] != nullptr && rawValues[i] != nullptr);
+        lastValues[i] = rawValues[i]->load();
+        smoothedValues[i].setCurrentAndTargetValue (lastValues[i]);
+    }
+
+    // Every node starts out from the parameter defaults, the chorus is left out as it always was
+    setGraph (defaultGraph);
+    switchGraph();
+    processParameters();
+}
+
+Processor::~Processor()
+{
+    const juce::ScopedLock sl (graphLock);
+    deleteRetiredGraphs();
+    delete nextGraph.exchange (nullptr);
+}
 
 void Processor::prepareToPlay (double sampleRate, int samplesPerBlock)
 {   
-    processorChain.reset();
+    const juce::ScopedLock sl (graphLock);
+
     juce::dsp::ProcessSpec spec;
-    spec.numChannels = 1;
     spec.maximumBlockSize = samplesPerBlock;
     spec.sampleRate = sampleRate;
-
     spec.numChannels = getTotalNumOutputChannels();
-    processorChain.prepare(spec); 
+    currentSpec = spec;
+
+    // Every node gets prepared, including those not in the graph, so any graph can be switched to later
+    auto values = getParameterValues();
+
+    for (size_t i = 0; i < numNodes; ++i)
+    {
+        nodes[i]->prepare (spec, values.data());
+        nodes[i]->reset();
+    }
+
+    analyser.prepare (sampleRate);
+
+    // Parameters start at their values rather than gliding to them
+    for (size_t i = 0; i < numParameters; ++i)
+    {
+        smoothedValues[i].reset (sampleRate, parameterSmoothingTime);
+        smoothedValues[i].setCurrentAndTargetValue (rawValues[i]->load());
+    }
+
+    // The audio thread is stopped, so a waiting graph can be taken over straight away
+    deleteRetiredGraphs();
+    switchGraph();
+    graph->prepare (spec);
+    profiler.prepare (sampleRate);
 }
 
 void Processor::processBlock (juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
 {
     
     juce::ScopedNoDenormals noDenormals;
-    // Don't think we need these:
-    //auto totalNumInputChannels  = getTotalNumInputChannels();
-    //auto totalNumOutputChannels = getTotalNumOutputChannels();
+    RealtimeChecker::ScopedSection realtimeSection;
+    auto numSamples = (uint32_t) buffer.getNumSamples();
+    auto callbackStart = DspProfiler::getTicks();
+
+    // Collect this block's parameter changes: the control queue applies at the start
+    // of the block, controllers arriving in the MidiBuffer at their own sample position
+    numPendingEvents = 0;
+    ParameterEvent event;
+
+    switchGraph();
+
+    // A preset replaces every value at the start of the block, later events in the block still apply on top
+    if (auto* preset = pendingPreset.exchange (nullptr, std::memory_order_acquire))
+        applyPreset (*preset);
+
+    while (numPendingEvents < pendingEvents.size() && parameterQueue.pop (event))
+        addPendingEvent (event, numSamples);
+
+    for (const auto metadata : midiMessages)
+    {
+        auto message = metadata.getMessage();
+        int index;
+        float value;
+        double bpm;
+
+        if (trackTempo (message, audioThreadTempo, (double) (samplePosition + (uint64_t) metadata.samplePosition) / currentSpec.sampleRate, bpm))
+        {
+            if (bpm > 0.0)
+                addPendingEvent ({ (uint16_t) multiTapTempoParam, (uint32_t) metadata.samplePosition,
+                                   parameters[multiTapTempoParam]->convertTo0to1 ((float) bpm) }, numSamples);
+        }
+        else if (controllerMap.map (message, audioThreadControllers, index, value))
+        {
+            addPendingEvent ({ (uint16_t) index, (uint32_t) metadata.samplePosition, value }, numSamples);
+        }
+    }
+
+    samplePosition += numSamples;
+
+    // Split the block at every event so each change lands on its own sample
     juce::dsp::AudioBlock<float> context (buffer);
+    size_t startSample = 0;
+
+    for (size_t i = 0; i < numPendingEvents; ++i)
+    {
+        auto& pending = pendingEvents[i];
+
+        if (pending.sampleOffset > startSample)
+        {
+            processSubBlock (context, startSample, pending.sampleOffset - startSample);
+            startSample = pending.sampleOffset;
+        }
+
+        applyParameterEvent (pending);
+    }
+
+    if (startSample < numSamples)
+        processSubBlock (context, startSample, numSamples - startSample);
 
-    processorChain.process (juce::dsp::ProcessContextReplacing<float> (context));
+    auto callbackTicks = DspProfiler::getTicks() - callbackStart;
+    updateProcessingLoad (callbackTicks, numSamples);
+
+    if (profiler.isEnabled())
+        profiler.addCallback (callbackTicks, (int) numSamples);
+}
+
+void Processor::updateProcessingLoad (int64_t callbackTicks, uint32_t numSamples) noexcept
+{
+    // Offline the callbacks run as fast as they can, the nodes keep the settings they were prepared
+    // with so the output does not depend on the machine's speed
+    if (numSamples == 0 || currentSpec.sampleRate <= 0.0 || isNonRealtime())
+        return;
+
+    auto load = (float) (juce::Time::highResolutionTicksToSeconds (callbackTicks) * currentSpec.sampleRate / numSamples);
+    processingLoad = juce::jmax (load, processingLoad * 0.99f);
+
+    for (auto* node : graph->getNodes())
+        node->setProcessingLoad (processingLoad);
+}
+
+// Processes the part between two parameter events, in small-block mode in pieces of at most subBlockSize
+void Processor::processSubBlock (juce::dsp::AudioBlock<float>& block, size_t startSample, size_t numSamples) noexcept
+{
+    auto maxSize = (size_t) subBlockSize.load (std::memory_order_relaxed);
+    auto* pool = threadPool.load (std::memory_order_relaxed);
+    auto* activeProfiler = profiler.isEnabled() ? &profiler : nullptr;
+
+    for (auto end = startSample + numSamples; startSample < end;)
+    {
+        auto size = maxSize > 0 ? juce::jmin (maxSize, end - startSample) : end - startSample;
+
+        processParameters ((int) size);
+
+        // The tuner needs the pitch, and keeps the tails going underneath but silent
+        auto tuning = lastValues[tunerParam] >= 0.5f;
+        auto subBlock = block.getSubBlock (startSample, size);
+        analyser.setPitchDetectionEnabled (tuning);
+        analyser.process (subBlock);
+        graph->process (subBlock, activeProfiler, pool);
+
+        if (tuning)
+            subBlock.clear();
+
+        startSample += size;
+    }
+}
+
+//==============================================================================
+juce::Result Processor::setGraph (const juce::String& description)
+{
+    const juce::ScopedLock sl (graphLock);
+    deleteRetiredGraphs();
+
+    juce::String error;
+    auto newGraph = EffectGraph::create (description, [this] (const juce::String& name) { return getOrCreateNode (name); }, error);
+
+    if (newGraph == nullptr)
+        return juce::Result::fail ("Invalid effect graph \"" + description + "\": " + error);
+
+    if (currentSpec.sampleRate > 0.0)
+        newGraph->prepare (currentSpec);
+
+    graphDescription = newGraph->getDescription();
+
+    // A graph the audio thread has not taken yet is simply replaced
+    delete nextGraph.exchange (newGraph.release(), std::memory_order_acq_rel);
+    return juce::Result::ok();
+}
+
+juce::String Processor::getGraphDescription() const
+{
+    const juce::ScopedLock sl (graphLock);
+    return graphDescription;
+}
+
+juce::Result Processor::loadImpulseResponse (const juce::String& nodeName, const juce::File& file)
+{
+    const juce::ScopedLock sl (graphLock);
+    auto* node = getOrCreateNode (nodeName);
+
+    if (node == nullptr)
+        return juce::Result::fail ("Unknown effect " + nodeName);
+
+    return node->loadImpulseResponse (file);
+}
+
+juce::Result Processor::waitForImpulseResponses (int timeoutMs)
+{
+    const juce::ScopedLock sl (graphLock);
+
+    for (size_t i = 0; i < numNodes; ++i)
+        if (! nodes[i]->waitForImpulseResponse (timeoutMs))
+            return juce::Result::fail ("The impulse response of " + nodes[i]->getName() + " was not ready within "
+                                        + juce::String (timeoutMs) + " ms");
+
+    return juce::Result::ok();
+}
+
+EffectNode* Processor::getOrCreateNode (const juce::String& name)
+{
+    for (size_t i = 0; i < numNodes; ++i)
+        if (nodes[i]->getName() == name)
+            return nodes[i].get();
+
+    if (numNodes == nodes.size())
+        return nullptr;
+
+    auto node = EffectNode::create (name, analyser);
+
+    if (node == nullptr)
+        return nullptr;
+
+    node->setProfilerStage ((int) numNodes);
+    profiler.setStageName (numNodes, node->getName().toRawUTF8());
+
+    // A node added while running has to be ready before the audio thread sees it
+    if (currentSpec.sampleRate > 0.0)
+    {
+        auto values = getParameterValues();
+        node->prepare (currentSpec, values.data());
+        node->update (values.data());
+    }
+
+    nodes[numNodes] = std::move (node);
+    return nodes[numNodes++].get();
+}
+
+// Runs on the audio thread. Retiring the old graph is a queue push, so it never frees anything here.
+void Processor::switchGraph() noexcept
+{
+    if (nextGraph.load (std::memory_order_relaxed) == nullptr || retiredGraphs.getNumReady() == maxRetiredGraphs)
+        return;
+
+    if (graph != nullptr)
+        retiredGraphs.push (graph.release());
+
+    graph.reset (nextGraph.exchange (nullptr, std::memory_order_acq_rel));
+
+    // Nodes that were not in the old graph may have missed parameter changes
+    dirtyStages = allStages;
+}
+
+void Processor::deleteRetiredGraphs()
+{
+    EffectGraph* retired;
+
+    while (retiredGraphs.pop (retired))
+        delete retired;
+}
+
+void Processor::addPendingEvent (ParameterEvent event, uint32_t numSamples) noexcept
+{
+    event.sampleOffset = juce::jmin (event.sampleOffset, numSamples);
+
+    // With the list full, the event takes over the latest one for its parameter: the value that
+    // arrived last wins, at the later of the two offsets. Only an event with no such one is lost.
+    if (numPendingEvents >= pendingEvents.size())
+    {
+        auto i = numPendingEvents;
+
+        while (i > 0 && pendingEvents[i - 1].parameterIndex != event.parameterIndex)
+            --i;
+
+        if (i == 0)
+        {
+            droppedParameterEvents.fetch_add (1, std::memory_order_relaxed);
+            return;
+        }
+
+        auto& merged = pendingEvents[i - 1];
+        event.sampleOffset = juce::jmax (event.sampleOffset, merged.sampleOffset);
+
+        for (--numPendingEvents; i - 1 < numPendingEvents; ++i)
+            pendingEvents[i - 1] = pendingEvents[i];
+    }
+
+    // Keep the list sorted by sample offset, events at the same offset stay in arrival order
+    auto i = numPendingEvents++;
+
+    for (; i > 0 && pendingEvents[i - 1].sampleOffset > event.sampleOffset; --i)
+        pendingEvents[i] = pendingEvents[i - 1];
+
+    pendingEvents[i] = event;
+}
+
+bool Processor::pushParameterChange (int parameterIndex, float normalisedValue) noexcept
+{
+    if (! juce::isPositiveAndBelow (parameterIndex, (int) numParameters))
+    {
+        jassertfalse;
+        return false;
+    }
+
+    return parameterQueue.push ({ (uint16_t) parameterIndex, 0, normalisedValue });
+}
+
+// Runs on the audio thread. Only updates the raw tree state value without notifying
+// listeners, processParameters() picks the change up before the next sub-block.
+void Processor::applyParameterEvent (const ParameterEvent& event) noexcept
+{
+    auto index = (size_t) event.parameterIndex;
+    rawValues[index]->store (parameters[index]->convertFrom0to1 (juce::jlimit (0.0f, 1.0f, event.normalisedValue)));
+}
+
+// Runs on the audio thread, the preset was resolved when it was loaded so this is only a copy
+void Processor::applyPreset (const Preset& preset) noexcept
+{
+    for (size_t i = 0; i < numParameters; ++i)
+        rawValues[i]->store (preset.values[i], std::memory_order_relaxed);
+}
+
+bool Processor::isSmoothedParameter (size_t parameterIndex) noexcept
+{
+    switch (parameterIndex)
+    {
+        case multiTapTapsParam:
+        case multiTapTempoParam:
+        case multiTapDivisionParam:
+        case tunerParam:
+        case driveCurveParam:
+        case driveOversamplingParam:
+        case reverbFreezeModeParam:
+        case delayMaxTimeParam:
+        case delayLeftTimeParam:
+        case delayRightTimeParam:
+        case delayInterpolationParam:
+        case delaySaturationParam:
+            return false;
+
+        default:
+            return true;
+    }
+}
+
+// Maps the cached parameter values onto the DSP stages. Only the stages with a changed
+// parameter get their settings recomputed, so calling this every block is cheap. A ramping
+// parameter takes the value it reaches at the end of the next numSamples, so smaller
+// sub-blocks give finer steps.
+void Processor::processParameters (int numSamples)
+{
+    for (size_t i = 0; i < numParameters; ++i)
+    {
+        auto value = rawValues[i]->load (std::memory_order_relaxed);
+
+        if (isSmoothedParameter (i))
+        {
+            auto& smoothed = smoothedValues[i];
+            smoothed.setTargetValue (value);
+            value = smoothed.isSmoothing() ? smoothed.skip (numSamples) : value;
+        }
+
+        if (value != lastValues[i])
+        {
+            lastValues[i] = value;
+            dirtyStages |= 1u << parameterStages[i];
+        }
+    }
+
+    if (dirtyStages == 0)
+        return;
+
+    for (auto* node : graph->getNodes())
+        if (dirtyStages & (1u << node->getType()))
+            node->update (lastValues.data());
+
+    dirtyStages = 0;
 }
 
 juce::AudioProcessorValueTreeState::ParameterLayout Processor::createParameterLayout()
@@ -80,30 +424,56 @@ juce::AudioProcessorValueTreeState::ParameterLayout Processor::createParameterLa
     return layout;
 }
 
-// TODO: Add delay effect
 void Processor::addParameters(juce::AudioProcessorValueTreeState::ParameterLayout& layout)
 {
+    // Gate and tuner
+    auto gateThreshold = std::make_unique<juce::AudioParameterFloat>(juce::ParameterID("GATETHRESHOLD", 1), "Gate Threshold", juce::NormalisableRange<float> { -96.0f, 0.0f, 0.1f }, -70.0f);
+    auto gateRelease = std::make_unique<juce::AudioParameterFloat>(juce::ParameterID("GATERELEASE", 1), "Gate Release", juce::NormalisableRange<float> { 5.0f, 1000.0f, 1.0f, 0.4f }, 100.0f);
+    auto tuner = std::make_unique<juce::AudioParameterBool>(juce::ParameterID("TUNER", 1), "Tuner", false);
+    auto groupGate = std::make_unique<juce::AudioProcessorParameterGroup>("gate", "GATE", "|",
+                                                                      std::move (gateThreshold),
+                                                                      std::move (gateRelease),
+                                                                      std::move (tuner));
     // Compressor
-    auto compressorAttack = std::make_unique<juce::AudioParameterFloat>(juce::ParameterID("COMPRESSORATTACK", 1), "Compressor Attack", juce::NormalisableRange<float> { 0.0f, 1.0f, 0.01f }, 0.5f);
-    auto compressorRelease = std::make_unique<juce::AudioParameterFloat>(juce::ParameterID("COMPRESSORRELEASE", 1), "Compressor Release", juce::NormalisableRange<float> { 0.0f, 1.0f, 0.01f }, 0.5f);
-    auto compressorRatio = std::make_unique<juce::AudioParameterFloat>(juce::ParameterID("COMPRESSORRATIO", 1), "Compressor Ratio", juce::NormalisableRange<float> { 0.0f, 1.0f, 0.01f }, 0.5f);
-    auto compressorThreshold = std::make_unique<juce::AudioParameterFloat>(juce::ParameterID("COMPRESSORTHRESHOLD", 1), "Compressor Threshold", juce::NormalisableRange<float> { 0.0f, 1.0f, 0.01f }, 0.5f);
+    auto compressorAttack = std::make_unique<juce::AudioParameterFloat>(juce::ParameterID("COMPRESSORATTACK", 1), "Compressor Attack", juce::NormalisableRange<float> { 0.1f, 200.0f, 0.1f, 0.3f }, 5.0f);
+    auto compressorRelease = std::make_unique<juce::AudioParameterFloat>(juce::ParameterID("COMPRESSORRELEASE", 1), "Compressor Release", juce::NormalisableRange<float> { 1.0f, 1000.0f, 1.0f, 0.3f }, 2.0f);
+    auto compressorRatio = std::make_unique<juce::AudioParameterFloat>(juce::ParameterID("COMPRESSORRATIO", 1), "Compressor Ratio", juce::NormalisableRange<float> { 1.0f, 20.0f, 0.1f, 0.5f }, 1.5f);
+    auto compressorThreshold = std::make_unique<juce::AudioParameterFloat>(juce::ParameterID("COMPRESSORTHRESHOLD", 1), "Compressor Threshold", juce::NormalisableRange<float> { -60.0f, 6.0f, 0.1f }, 4.0f);
     auto groupCompressor = std::make_unique<juce::AudioProcessorParameterGroup>("compressor", "Compressor", "|",
                                                                       std::move (compressorAttack),
                                                                       std::move (compressorRelease),
                                                                       std::move (compressorRatio),
                                                                       std::move (compressorThreshold));
     // Pre Gain
-    auto preGainLevel = std::make_unique<juce::AudioParameterFloat>(juce::ParameterID("PREGAIN", 1), "Pre Gain", juce::NormalisableRange<float> { 0.0f, 1.0f, 0.01f }, 0.5f);
+    auto preGainLevel = std::make_unique<juce::AudioParameterFloat>(juce::ParameterID("PREGAIN", 1), "Pre Gain", juce::NormalisableRange<float> { -24.0f, 24.0f, 0.1f }, 0.0f);
     auto groupPreGain = std::make_unique<juce::AudioProcessorParameterGroup>("preGain", "PREGAIN", "|",
                                                                       std::move (preGainLevel));
 
+    // Drive, tight is a high-pass before the waveshaper and tone a low-pass after it
+    auto driveGain = std::make_unique<juce::AudioParameterFloat>(juce::ParameterID("DRIVEGAIN", 1), "Drive Gain", juce::NormalisableRange<float> { 0.0f, 48.0f, 0.1f }, 12.0f);
+    // Indexed by DriveCurve
+    auto driveCurve = std::make_unique<juce::AudioParameterChoice>(juce::ParameterID("DRIVECURVE", 1), "Drive Curve",
+                                                juce::StringArray { "Soft", "Hard", "Asymmetric" }, 0);
+    auto driveTight = std::make_unique<juce::AudioParameterFloat>(juce::ParameterID("DRIVETIGHT", 1), "Drive Tight", juce::NormalisableRange<float> { 20.0f, 1000.0f, 1.0f, 0.3f }, 100.0f);
+    auto driveTone = std::make_unique<juce::AudioParameterFloat>(juce::ParameterID("DRIVETONE", 1), "Drive Tone", juce::NormalisableRange<float> { 500.0f, 16000.0f, 1.0f, 0.3f }, 5000.0f);
+    auto driveLevel = std::make_unique<juce::AudioParameterFloat>(juce::ParameterID("DRIVELEVEL", 1), "Drive Level", juce::NormalisableRange<float> { -48.0f, 12.0f, 0.1f }, -12.0f);
+    // The oversampling order, Auto picks it from the CPU load
+    auto driveOversampling = std::make_unique<juce::AudioParameterChoice>(juce::ParameterID("DRIVEOVERSAMPLING", 1), "Drive Oversampling",
+                                                juce::StringArray { "Auto", "2x", "4x", "8x" }, 0);
+    auto groupDrive = std::make_unique<juce::AudioProcessorParameterGroup>("drive", "DRIVE", "|",
+                                                                      std::move (driveGain),
+                                                                      std::move (driveCurve),
+                                                                      std::move (driveTight),
+                                                                      std::move (driveTone),
+                                                                      std::move (driveLevel),
+                                                                      std::move (driveOversampling));
+
     // Chorus
-    auto chorusCentreDelay = std::make_unique<juce::AudioParameterFloat>(juce::ParameterID("CHORUSCENTREDELAY", 1), "Chorus Centre Delay", juce::NormalisableRange<float> { 0.0f, 1.0f, 0.01f }, 0.5f);
-    auto chorusDepth = std::make_unique<juce::AudioParameterFloat>(juce::ParameterID("CHORUSDEPTH", 1), "Chorus Depth", juce::NormalisableRange<float> { 0.0f, 1.0f, 0.01f }, 0.5f);
-    auto chorusFeedback = std::make_unique<juce::AudioParameterFloat>(juce::ParameterID("CHORUSFEEDBACK", 1), "Chorus Feedback", juce::NormalisableRange<float> { 0.0f, 1.0f, 0.01f }, 0.5f);
+    auto chorusCentreDelay = std::make_unique<juce::AudioParameterFloat>(juce::ParameterID("CHORUSCENTREDELAY", 1), "Chorus Centre Delay", juce::NormalisableRange<float> { 1.0f, 100.0f, 0.1f }, 30.0f);
+    auto chorusDepth = std::make_unique<juce::AudioParameterFloat>(juce::ParameterID("CHORUSDEPTH", 1), "Chorus Depth", juce::NormalisableRange<float> { 0.0f, 1.0f, 0.01f }, 0.2f);
+    auto chorusFeedback = std::make_unique<juce::AudioParameterFloat>(juce::ParameterID("CHORUSFEEDBACK", 1), "Chorus Feedback", juce::NormalisableRange<float> { -1.0f, 1.0f, 0.01f }, 0.5f);
     auto chorusMix = std::make_unique<juce::AudioParameterFloat>(juce::ParameterID("CHORUSMIX", 1), "Chorus Mix", juce::NormalisableRange<float> { 0.0f, 1.0f, 0.01f }, 0.5f);
-    auto chorusRate = std::make_unique<juce::AudioParameterFloat>(juce::ParameterID("CHORUSRATE", 1), "Chorus Rate", juce::NormalisableRange<float> { 0.0f, 1.0f, 0.01f }, 0.5f);
+    auto chorusRate = std::make_unique<juce::AudioParameterFloat>(juce::ParameterID("CHORUSRATE", 1), "Chorus Rate", juce::NormalisableRange<float> { 0.1f, 20.0f, 0.01f, 0.5f }, 3.0f);
     auto groupChorus = std::make_unique<juce::AudioProcessorParameterGroup>("chorus", "CHORUS", "|",
                                                                       std::move (chorusCentreDelay),
                                                                       std::move (chorusDepth),
@@ -112,15 +482,15 @@ void Processor::addParameters(juce::AudioProcessorValueTreeState::ParameterLayou
                                                                       std::move (chorusRate));
     // REVERB
     auto reverbRoomSize = std::make_unique<juce::AudioParameterFloat>(juce::ParameterID("REVERBROOMSIZE", 1), "Reverb Room Size",
-                                                juce::NormalisableRange<float> { 0.0f, 1.0f, 0.01f }, 0.0f);
+                                                juce::NormalisableRange<float> { 0.0f, 1.0f, 0.01f }, 0.2f);
     auto reverbDamping = std::make_unique<juce::AudioParameterFloat>(juce::ParameterID("REVERBDAMPING", 1), "Reverb Damping",
-                                                juce::NormalisableRange<float> { 0.0f, 1.0f, 0.01f }, 0.0f);
+                                                juce::NormalisableRange<float> { 0.0f, 1.0f, 0.01f }, 0.5f);
     auto reverbWetLevel = std::make_unique<juce::AudioParameterFloat>(juce::ParameterID("REVERBWETLEVEL", 1), "Reverb Wet Level",
-                                                juce::NormalisableRange<float> { 0.0f, 1.0f, 0.01f }, 0.0f);
+                                                juce::NormalisableRange<float> { 0.0f, 1.0f, 0.01f }, 0.33f);
     auto reverbDryLevel = std::make_unique<juce::AudioParameterFloat>(juce::ParameterID("REVERBDRYLEVEL", 1), "Reverb Dry Level",
-                                                juce::NormalisableRange<float> { 0.0f, 1.0f, 0.01f }, 0.0f);
+                                                juce::NormalisableRange<float> { 0.0f, 1.0f, 0.01f }, 1.0f);
     auto reverbWidth = std::make_unique<juce::AudioParameterFloat>(juce::ParameterID("REVERBWIDTH", 1), "Reverb Width",
-                                                juce::NormalisableRange<float> { 0.0f, 1.0f, 0.01f }, 0.0f);
+                                                juce::NormalisableRange<float> { 0.0f, 1.0f, 0.01f }, 0.5f);
     auto reverbFreezeMode = std::make_unique<juce::AudioParameterFloat>(juce::ParameterID("REVERBFREEZEMODE", 1), "Reverb Freeze Mode",
                                                 juce::NormalisableRange<float> { 0.0f, 1.0f, 0.01f }, 0.0f);
     auto groupReverb = std::make_unique<juce::AudioProcessorParameterGroup>("reverb", "REVERB", "|",
@@ -130,55 +500,181 @@ void Processor::addParameters(juce::AudioProcessorValueTreeState::ParameterLayou
                                                                       std::move (reverbDryLevel),
                                                                       std::move (reverbWidth),
                                                                       std::move (reverbFreezeMode));
-    // DELAY
+    // DELAY, the max time goes up to the Delay's default delay time limit
     auto delayMaxTime = std::make_unique<juce::AudioParameterFloat>(juce::ParameterID("DELAYMAXTIME", 1), "Delay Max Time",
-                                                juce::NormalisableRange<float> { 0.0f, 1.0f, 0.01f }, 0.0f);
+                                                juce::NormalisableRange<float> { 0.01f, 2.0f, 0.01f }, 0.4f);
     auto delayLeftTime = std::make_unique<juce::AudioParameterFloat>(juce::ParameterID("DELAYLEFTTIME", 1), "Delay Left Time",
-                                                juce::NormalisableRange<float> { 0.0f, 1.0f, 0.01f }, 0.0f);
+                                                juce::NormalisableRange<float> { 0.0f, 2.0f, 0.001f }, 0.2f);
     auto delayRightTime = std::make_unique<juce::AudioParameterFloat>(juce::ParameterID("DELAYRIGHTTIME", 1), "Delay Right Time",
-                                                juce::NormalisableRange<float> { 0.0f, 1.0f, 0.01f }, 0.0f);
+                                                juce::NormalisableRange<float> { 0.0f, 2.0f, 0.001f }, 0.3f);
     auto delayWetLevel = std::make_unique<juce::AudioParameterFloat>(juce::ParameterID("DELAYWETLEVEL", 1), "Delay Wet Level",
-                                                juce::NormalisableRange<float> { 0.0f, 1.0f, 0.01f }, 0.0f);
+                                                juce::NormalisableRange<float> { 0.0f, 1.0f, 0.01f }, 1.0f);
     auto delayFeedback = std::make_unique<juce::AudioParameterFloat>(juce::ParameterID("DELAYFEEDBACK", 1), "Delay Feedback",
-                                                juce::NormalisableRange<float> { 0.0f, 1.0f, 0.01f }, 0.0f);
+                                                juce::NormalisableRange<float> { 0.0f, 1.0f, 0.01f }, 1.0f);
+
+    // Indexed by DelayInterpolation
+    auto delayInterpolation = std::make_unique<juce::AudioParameterChoice>(juce::ParameterID("DELAYINTERPOLATION", 1), "Delay Interpolation",
+                                                juce::StringArray { "None", "Linear", "Lagrange", "Thiran" }, 1);
+    // Indexed by SaturationType
+    auto delaySaturation = std::make_unique<juce::AudioParameterChoice>(juce::ParameterID("DELAYSATURATION", 1), "Delay Saturation",
+                                                juce::StringArray { "Tanh", "Pade", "Table", "Hard Clip" }, 1);
 
     auto groupDelay = std::make_unique<juce::AudioProcessorParameterGroup>("delay", "DELAY", "|",
                                                                       std::move (delayMaxTime),
                                                                       std::move (delayLeftTime),
                                                                       std::move (delayRightTime),
                                                                       std::move (delayWetLevel),
-                                                                      std::move (delayFeedback));
+                                                                      std::move (delayFeedback),
+                                                                      std::move (delayInterpolation),
+                                                                      std::move (delaySaturation));
+
+    // Multi-tap delay, the taps are spaced at the division of the tempo
+    auto multiTapTaps = std::make_unique<juce::AudioParameterInt>(juce::ParameterID("MULTITAPTAPS", 1), "Multi-Tap Taps", 1, 8, 4);
+    auto multiTapTempo = std::make_unique<juce::AudioParameterFloat>(juce::ParameterID("MULTITAPTEMPO", 1), "Multi-Tap Tempo",
+                                                juce::NormalisableRange<float> { 40.0f, 300.0f, 0.1f }, 120.0f);
+    auto multiTapDivision = std::make_unique<juce::AudioParameterChoice>(juce::ParameterID("MULTITAPDIVISION", 1), "Multi-Tap Division",
+                                                juce::StringArray { "1/4", "1/8 Dotted", "1/8", "1/8 Triplet", "1/16" }, 1);
+    auto multiTapFeedback = std::make_unique<juce::AudioParameterFloat>(juce::ParameterID("MULTITAPFEEDBACK", 1), "Multi-Tap Feedback",
+                                                juce::NormalisableRange<float> { 0.0f, 0.95f, 0.01f }, 0.3f);
+    auto multiTapWetLevel = std::make_unique<juce::AudioParameterFloat>(juce::ParameterID("MULTITAPWETLEVEL", 1), "Multi-Tap Wet Level",
+                                                juce::NormalisableRange<float> { 0.0f, 1.0f, 0.01f }, 0.5f);
+    auto multiTapDecay = std::make_unique<juce::AudioParameterFloat>(juce::ParameterID("MULTITAPDECAY", 1), "Multi-Tap Decay",
+                                                juce::NormalisableRange<float> { 0.0f, 1.0f, 0.01f }, 0.7f);
+    auto multiTapSpread = std::make_unique<juce::AudioParameterFloat>(juce::ParameterID("MULTITAPSPREAD", 1), "Multi-Tap Spread",
+                                                juce::NormalisableRange<float> { 0.0f, 1.0f, 0.01f }, 0.7f);
+    auto multiTapTone = std::make_unique<juce::AudioParameterFloat>(juce::ParameterID("MULTITAPTONE", 1), "Multi-Tap Tone",
+                                                juce::NormalisableRange<float> { 500.0f, 16000.0f, 1.0f, 0.3f }, 6000.0f);
+    auto groupMultiTap = std::make_unique<juce::AudioProcessorParameterGroup>("multiTap", "MULTITAP", "|",
+                                                                      std::move (multiTapTaps),
+                                                                      std::move (multiTapTempo),
+                                                                      std::move (multiTapDivision),
+                                                                      std::move (multiTapFeedback),
+                                                                      std::move (multiTapWetLevel),
+                                                                      std::move (multiTapDecay),
+                                                                      std::move (multiTapSpread),
+                                                                      std::move (multiTapTone));
+
+    // Convolution, a cabinet wants it all wet and a room mostly dry
+    auto convolutionWetLevel = std::make_unique<juce::AudioParameterFloat>(juce::ParameterID("CONVOLUTIONWETLEVEL", 1), "Convolution Wet Level",
+                                                juce::NormalisableRange<float> { 0.0f, 1.0f, 0.01f }, 1.0f);
+    auto convolutionDryLevel = std::make_unique<juce::AudioParameterFloat>(juce::ParameterID("CONVOLUTIONDRYLEVEL", 1), "Convolution Dry Level",
+                                                juce::NormalisableRange<float> { 0.0f, 1.0f, 0.01f }, 0.0f);
+    auto groupConvolution = std::make_unique<juce::AudioProcessorParameterGroup>("convolution", "CONVOLUTION", "|",
+                                                                      std::move (convolutionWetLevel),
+                                                                      std::move (convolutionDryLevel));
 
     // Master Gain
     auto masterGain = std::make_unique<juce::AudioParameterFloat>(juce::ParameterID("MASTERGAIN", 1), "Master Gain",
-                                                juce::NormalisableRange<float> { 0.0f, 1.0f, 0.01f }, 0.5f);
+                                                juce::NormalisableRange<float> { -24.0f, 12.0f, 0.1f }, 0.0f);
     auto groupMaster = std::make_unique<juce::AudioProcessorParameterGroup>("master", "MASTER", "|",
                                                                       std::move (masterGain));     
 
     // Add all the groups to layout
-    layout.add (std::move (groupCompressor),
+    layout.add (std::move (groupGate),
+                std::move (groupCompressor),
                 std::move (groupPreGain),
+                std::move (groupDrive),
                 std::move (groupChorus),
                 std::move (groupReverb),
+                std::move (groupDelay),
+                std::move (groupMultiTap),
+                std::move (groupConvolution),
                 std::move (groupMaster));
 
 }
-// TODO: Add functionality for the rotary encoder to change the midi program
 void Processor::handleMidiMessage(const MidiMessage& message)
 {
-    if (message.isController())
+    if (message.isProgramChange())
     {
-        auto controllerNumber = message.getControllerNumber();
-        auto controllerValue = message.getControllerValue();
+        setCurrentProgram (message.getProgramChangeNumber());
+        return;
+    }
 
-        switch (controllerNumber)
-        {
-            case 1: // Example: Compressor Attack
-                treeState.getParameter("COMPRESSORATTACK")->setValueNotifyingHost(controllerValue / 127.0f);
-                break;
-            // Add more cases for other MIDI CC numbers and parameters
-        }
+    double bpm;
+
+    if (trackTempo (message, controlThreadTempo, juce::Time::getMillisecondCounterHiRes() * 0.001, bpm))
+    {
+        if (bpm > 0.0)
+            pushParameterChange (multiTapTempoParam, parameters[multiTapTempoParam]->convertTo0to1 ((float) bpm));
+
+        return;
+    }
+
+    if (controllerMap.learn (message))
+    {
+        DBG ("Learned controller " << message.getControllerNumber() << " on channel " << message.getChannel());
+        return;
+    }
+
+    int parameterIndex;
+    float value;
+
+    if (controllerMap.map (message, controlThreadControllers, parameterIndex, value))
+        pushParameterChange (parameterIndex, value);
+}
+
+bool Processor::trackTempo (const juce::MidiMessage& message, TempoTracker& tracker, double timeInSeconds, double& bpm) const noexcept
+{
+    bpm = 0.0;
+
+    if (message.isMidiClock())
+    {
+        bpm = tracker.clock (timeInSeconds);
+        return true;
+    }
+
+    if (message.isMidiStart() || message.isMidiContinue())
+    {
+        tracker.restartClock();
+        return true;
     }
+
+    if (message.isController() && message.getControllerNumber() == tapTempoController.load (std::memory_order_relaxed))
+    {
+        if (message.getControllerValue() >= 64)
+            bpm = tracker.tap (timeInSeconds);
+
+        return true;
+    }
+
+    return false;
+}
+
+int Processor::findParameterIndex (const juce::String& parameterID) noexcept
+{
+    for (int i = 0; i < numParameters; ++i)
+        if (parameterID == parameterIDs[i])
+            return i;
+
+    return -1;
+}
+
+juce::RangedAudioParameter* Processor::getParameterByIndex (int parameterIndex) const noexcept
+{
+    return juce::isPositiveAndBelow (parameterIndex, (int) numParameters) ? parameters[(size_t) parameterIndex] : nullptr;
+}
+
+std::vector<float> Processor::getParameterValues() const
+{
+    std::vector<float> values (numParameters);
+
+    for (size_t i = 0; i < numParameters; ++i)
+        values[i] = rawValues[i]->load();
+
+    return values;
+}
+
+void Processor::setParameterValues (const std::vector<float>& values)
+{
+    jassert (values.size() == numParameters);
+
+    for (size_t i = 0; i < juce::jmin (values.size(), (size_t) numParameters); ++i)
+        parameters[i]->setValueNotifyingHost (parameters[i]->convertTo0to1 (values[i]));
+}
+
+juce::String Processor::getParameterID (int parameterIndex)
+{
+    return juce::isPositiveAndBelow (parameterIndex, (int) numParameters) ? juce::String (parameterIDs[parameterIndex]) : juce::String();
 }
 
 /**------------------------------------------------------UNUSED BOILERPLATE---------------------------------------------------------------
@@ -223,21 +719,36 @@ double Processor::getTailLengthSeconds() const
 
 int Processor::getNumPrograms()
 {
-    return 1;
+    return juce::jmax (1, presetBank.size());
 }
 
 int Processor::getCurrentProgram()
 {
-    return 0;
+    return currentProgram.load();
 }
 
+// Safe from any thread: only hands the preset over, the audio thread applies it at the start of its next block
 void Processor::setCurrentProgram (int index)
 {
+    if (auto* preset = presetBank.getPreset (index))
+    {
+        if (preset->graph.isNotEmpty() && preset->graph != getGraphDescription())
+        {
+            auto result = setGraph (preset->graph);
+
+            if (result.failed())
+                DBG (result.getErrorMessage());
+        }
+
+        currentProgram.store (index);
+        pendingPreset.store (preset, std::memory_order_release);
+    }
 }
 
 const juce::String Processor::getProgramName (int index)
 {
-    return {};
+    auto* preset = presetBank.getPreset (index);
+    return preset != nullptr ? preset->name : juce::String();
 }
 
 void Processor::changeProgramName (int index, const juce::String& newName)
@@ -282,10 +793,33 @@ juce::AudioProcessorEditor* Processor::createEditor()
     return 0;
 }
 
+// Parameter changes from the queue only reach the raw values, so those are written over what the tree holds
 void Processor::getStateInformation (juce::MemoryBlock& destData)
 {
+    auto state = treeState.copyState();
+    state.setProperty ("graph", getGraphDescription(), nullptr);
+
+    for (auto child : state)
+    {
+        auto index = findParameterIndex (child.getProperty ("id").toString());
+
+        if (index >= 0)
+            child.setProperty ("value", rawValues[(size_t) index]->load(), nullptr);
+    }
+
+    if (auto xml = state.createXml())
+        copyXmlToBinary (*xml, destData);
 }
 
 void Processor::setStateInformation (const void* data, int sizeInBytes)
 {
+    auto xml = getXmlFromBinary (data, sizeInBytes);
+
+    if (xml == nullptr || ! xml->hasTagName (treeState.state.getType()))
+        return;
+
+    if (xml->hasAttribute ("graph"))
+        setGraph (xml->getStringAttribute ("graph"));
+
+    treeState.replaceState (juce::ValueTree::fromXml (*xml));
 }
\ No newline at end of file
@@ -7,10 +7,65 @@
 
 #include <JuceHeader.h>
 #include "CustomDelay.h"
+#include "ParameterQueue.h"
+#include "DspProfiler.h"
+#include "MidiControllerMap.h"
+#include "PresetBank.h"
+#include "EffectGraph.h"
+#include "TempoTracker.h"
 
 class Processor : public juce::AudioProcessor
 {
 public:
+    // Every parameter in the layout, in the order of parameterIDs in AudioProcessor.cpp
+    enum ParameterIndex
+    {
+        gateThresholdParam,
+        gateReleaseParam,
+        tunerParam,
+        compressorAttackParam,
+        compressorReleaseParam,
+        compressorRatioParam,
+        compressorThresholdParam,
+        preGainParam,
+        driveGainParam,
+        driveCurveParam,
+        driveTightParam,
+        driveToneParam,
+        driveLevelParam,
+        driveOversamplingParam,
+        chorusCentreDelayParam,
+        chorusDepthParam,
+        chorusFeedbackParam,
+        chorusMixParam,
+        chorusRateParam,
+        reverbRoomSizeParam,
+        reverbDampingParam,
+        reverbWetLevelParam,
+        reverbDryLevelParam,
+        reverbWidthParam,
+        reverbFreezeModeParam,
+        delayMaxTimeParam,
+        delayLeftTimeParam,
+        delayRightTimeParam,
+        delayWetLevelParam,
+        delayFeedbackParam,
+        delayInterpolationParam,
+        delaySaturationParam,
+        multiTapTapsParam,
+        multiTapTempoParam,
+        multiTapDivisionParam,
+        multiTapFeedbackParam,
+        multiTapWetLevelParam,
+        multiTapDecayParam,
+        multiTapSpreadParam,
+        multiTapToneParam,
+        convolutionWetLevelParam,
+        convolutionDryLevelParam,
+        masterGainParam,
+        numParameters
+    };
+
     Processor();
     ~Processor() override;
     //==============================================================================
@@ -49,26 +104,155 @@ public:
     //==============================================================================
     juce::AudioProcessorValueTreeState::ParameterLayout createParameterLayout();
     void addParameters(juce::AudioProcessorValueTreeState::ParameterLayout& layout);
-    void processParameters();
+    // Moves the parameter smoothing on by numSamples and updates the stages whose values changed
+    void processParameters (int numSamples = 0);
     void handleMidiMessage(const MidiMessage& message);
+
+    // Lock-free hand-off of a parameter change to the audio thread. Call from a single control thread.
+    bool pushParameterChange (int parameterIndex, float normalisedValue) noexcept;
+
+    // Parameter changes lost because a block had more events than fit, each of them for a parameter
+    // with no other change pending to merge into
+    int getNumDroppedParameterEvents() const noexcept { return droppedParameterEvents.load(); }
+
+    // Which controller drives which parameter, shared by the serial input and the MidiBuffer
+    MidiControllerMap& getControllerMap() noexcept { return controllerMap; }
+
+    // Presses (values of 64 and up) of this controller tap the multi-tap tempo, -1 turns tapping off.
+    // MIDI clock always sets the tempo.
+    static constexpr int defaultTapTempoController = 80;
+    void setTapTempoController (int controller) noexcept { tapTempoController.store (controller); }
+
+    // The order and routing of the effects, see EffectGraph. Call from the control thread,
+    // the audio thread switches over at the start of its next block.
+    static constexpr const char* defaultGraph = "gate > compressor > preGain > delay > reverb > masterGain";
+    juce::Result setGraph (const juce::String& description);
+    juce::String getGraphDescription() const;
+
+    // Loads a cabinet or room impulse response into the named convolution node, creating the node if
+    // it is not in the graph yet. Call from the control thread, the file is resampled in the background.
+    juce::Result loadImpulseResponse (const juce::String& nodeName, const juce::File& file);
+
+    // Blocks until every convolution node uses the response loaded last, so an offline render does not
+    // start on the previous one. Call after prepareToPlay() and not while the audio thread runs.
+    juce::Result waitForImpulseResponses (int timeoutMs);
+
+    // Program changes switch between these, see setCurrentProgram()
+    PresetBank& getPresetBank() noexcept { return presetBank; }
+
+    // Returns -1 for an unknown parameter ID
+    static int findParameterIndex (const juce::String& parameterID) noexcept;
+    static juce::String getParameterID (int parameterIndex);
+    juce::RangedAudioParameter* getParameterByIndex (int parameterIndex) const noexcept;
+
+    // Every parameter value in its own units, indexed by ParameterIndex. Setting them notifies
+    // the tree state and should be done from the message thread.
+    std::vector<float> getParameterValues() const;
+    void setParameterValues (const std::vector<float>& values);
+
+    // Small-block mode: every block is processed in pieces of at most this many samples, with the
+    // parameter ramps moving on between them. 0 processes blocks whole, only split at parameter events.
+    void setSubBlockSize (int numSamples) noexcept { subBlockSize.store (juce::jmax (0, numSamples)); }
+    int getSubBlockSize() const noexcept { return subBlockSize.load(); }
+
+    // Spreads parallel branches and channels over other cores, null runs everything on the audio thread.
+    // The pool has to outlive the processor's use of it.
+    void setThreadPool (RealtimeThreadPool* newPool) noexcept { threadPool.store (newPool); }
+
+    // The input's level, and its pitch while the tuner is on. TUNER mutes the output.
+    const SignalAnalyser& getAnalyser() const noexcept { return analyser; }
+    bool isTunerOn() const noexcept { return rawValues[tunerParam]->load (std::memory_order_relaxed) >= 0.5f; }
+
+    // Per-stage timing, off until enabled
+    DspProfiler& getProfiler() noexcept { return profiler; }
     
 private:
 
-    enum
+    static constexpr uint32_t allStages = (1u << numEffectTypes) - 1;
+
+    // The effect type each parameter belongs to, indexed by ParameterIndex. The tuner belongs
+    // to the processor itself, numEffectTypes matches no node.
+    static constexpr int parameterStages[numParameters] =
     {
-        compressorIndex,
-        gainIndex,
-        chorusIndex,
-        delayIndex,
-        reverbIndex,
-        masterGainIndex
+        gateEffect, gateEffect,
+        numEffectTypes,
+        compressorEffect, compressorEffect, compressorEffect, compressorEffect,
+        preGainEffect,
+        driveEffect, driveEffect, driveEffect, driveEffect, driveEffect, driveEffect,
+        chorusEffect, chorusEffect, chorusEffect, chorusEffect, chorusEffect,
+        reverbEffect, reverbEffect, reverbEffect, reverbEffect, reverbEffect, reverbEffect,
+        delayEffect, delayEffect, delayEffect, delayEffect, delayEffect, delayEffect, delayEffect,
+        multiTapEffect, multiTapEffect, multiTapEffect, multiTapEffect, multiTapEffect, multiTapEffect, multiTapEffect, multiTapEffect,
+        convolutionEffect, convolutionEffect,
+        masterGainEffect
     };
 
     juce::AudioProcessorValueTreeState treeState;
 
-    juce::dsp::ProcessorChain<juce::dsp::Compressor<float>, juce::dsp::Gain<float>,
-                              juce::dsp::Chorus<float>, Delay<float>,
-                              juce::dsp::Reverb, juce::dsp::Gain<float>> processorChain;
-    
-    juce::dsp::Reverb::Parameters reverbParams;
+    // Analyses the graph's input for the gate and the tuner, it outlives the nodes
+    SignalAnalyser analyser;
+
+    // Nodes are created on demand and kept until the processor goes, one per profiler stage
+    std::array<std::unique_ptr<EffectNode>, DspProfiler::maxNumStages> nodes;
+    size_t numNodes = 0;
+    EffectNode* getOrCreateNode (const juce::String& name);
+
+    // The audio thread owns graph. A new one waits in nextGraph, and the one it replaces goes
+    // back through retiredGraphs to be deleted on the control thread.
+    std::unique_ptr<EffectGraph> graph;
+    std::atomic<EffectGraph*> nextGraph { nullptr };
+    static constexpr size_t maxRetiredGraphs = 8;
+    SpscQueue<EffectGraph*, maxRetiredGraphs> retiredGraphs;
+    juce::String graphDescription;
+    juce::CriticalSection graphLock;
+    juce::dsp::ProcessSpec currentSpec {};
+
+    std::atomic<RealtimeThreadPool*> threadPool { nullptr };
+
+    // The callback's share of the block's duration, following peaks straight away and decaying slowly
+    float processingLoad = 0.0f;
+    void updateProcessingLoad (int64_t callbackTicks, uint32_t numSamples) noexcept;
+
+    void switchGraph() noexcept;
+    void deleteRetiredGraphs();
+
+    std::array<juce::RangedAudioParameter*, numParameters> parameters;
+    std::array<std::atomic<float>*, numParameters> rawValues;
+    std::array<float, numParameters> lastValues;
+    uint32_t dirtyStages = 0;
+
+    // Continuous parameters glide to a new value instead of stepping. Delay times are left
+    // out as the Delay glides them itself, as are switches and the max delay time.
+    static constexpr double parameterSmoothingTime = 0.02;
+    std::array<juce::SmoothedValue<float>, numParameters> smoothedValues;
+    static bool isSmoothedParameter (size_t parameterIndex) noexcept;
+
+    std::atomic<int> subBlockSize { 0 };
+
+    ParameterQueue parameterQueue;
+    std::array<ParameterEvent, 64> pendingEvents;
+    size_t numPendingEvents = 0;
+    std::atomic<int> droppedParameterEvents { 0 };
+
+    PresetBank presetBank;
+    std::atomic<const Preset*> pendingPreset { nullptr };
+    std::atomic<int> currentProgram { 0 };
+
+    void applyPreset (const Preset& preset) noexcept;
+
+    MidiControllerMap controllerMap;
+    MidiControllerMap::State controlThreadControllers, audioThreadControllers;
+
+    std::atomic<int> tapTempoController { defaultTapTempoController };
+    TempoTracker controlThreadTempo, audioThreadTempo;
+    uint64_t samplePosition = 0;
+
+    // Returns false if the message has nothing to do with the tempo, bpm is 0 unless it set a new one
+    bool trackTempo (const juce::MidiMessage& message, TempoTracker& tracker, double timeInSeconds, double& bpm) const noexcept;
+
+    void addPendingEvent (ParameterEvent event, uint32_t numSamples) noexcept;
+    void applyParameterEvent (const ParameterEvent& event) noexcept;
+    void processSubBlock (juce::dsp::AudioBlock<float>& block, size_t startSample, size_t numSamples) noexcept;
+
+    DspProfiler profiler;
 };
\ No newline at end of file
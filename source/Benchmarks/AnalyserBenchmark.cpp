@@ -0,0 +1,52 @@
+/*
+    Cost of the SignalAnalyser with and without pitch detection. The pitch stages are spread over
+    blocks, so the worst block matters as much as the average.
+*/
+
+#include "Benchmark.h"
+#include "../SignalAnalyser.h"
+
+GUITARFX_BENCHMARK (analyser)
+{
+    constexpr double sampleRate = 48000.0;
+    constexpr size_t blockSize = 64;
+    constexpr size_t numSamples = 48000 * 5;
+    constexpr int numRuns = 5;
+
+    // A low E with some harmonics
+    juce::AudioBuffer<float> buffer (2, (int) numSamples);
+
+    for (int ch = 0; ch < buffer.getNumChannels(); ++ch)
+        for (int i = 0; i < (int) numSamples; ++i)
+            buffer.setSample (ch, i, 0.3f * std::sin (juce::MathConstants<float>::twoPi * 82.41f * (float) i / (float) sampleRate)
+                                   + 0.1f * std::sin (juce::MathConstants<float>::twoPi * 164.82f * (float) i / (float) sampleRate));
+
+    for (auto pitchDetection : { false, true })
+    {
+        SignalAnalyser analyser;
+        analyser.prepare (sampleRate);
+        analyser.setPitchDetectionEnabled (pitchDetection);
+
+        juce::dsp::AudioBlock<const float> block (buffer);
+        auto worstBlock = 0.0;
+
+        auto nanoseconds = measureNanosecondsPerSample (numSamples, numRuns, [&]
+        {
+            for (size_t start = 0; start + blockSize <= numSamples; start += blockSize)
+            {
+                auto blockStart = std::chrono::steady_clock::now();
+                analyser.process (block.getSubBlock (start, blockSize));
+                auto blockNanoseconds = std::chrono::duration<double, std::nano> (std::chrono::steady_clock::now() - blockStart).count();
+                worstBlock = juce::jmax (worstBlock, blockNanoseconds / (double) blockSize);
+            }
+        });
+
+        auto name = juce::String (pitchDetection ? "Levels and pitch" : "Levels");
+
+        if (pitchDetection && std::abs (analyser.getFrequency() - 82.41f) > 0.5f)
+            reportBenchmarkFailure ("Detected " + juce::String (analyser.getFrequency()) + " Hz instead of 82.41 Hz");
+
+        printBenchmarkResult (name, nanoseconds);
+        printBenchmarkResult (name + " (worst block)", worstBlock);
+    }
+}
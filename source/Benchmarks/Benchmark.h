@@ -0,0 +1,68 @@
+/*
+    Minimal micro-benchmark harness for the DSP code, built as GuitarFXBenchmarks
+    when GUITARFX_BUILD_BENCHMARKS is on.
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <chrono>
+#include <limits>
+#include <vector>
+
+using BenchmarkFunction = void (*)();
+
+struct BenchmarkRegistration
+{
+    BenchmarkRegistration (const char* name, BenchmarkFunction function);
+};
+
+#define GUITARFX_BENCHMARK(name) \
+    static void name(); \
+    static BenchmarkRegistration name##Registration (#name, name); \
+    static void name()
+
+/** Runs the function numRuns times and returns the fastest run in nanoseconds per sample */
+template <typename Function>
+double measureNanosecondsPerSample (size_t numSamples, int numRuns, Function&& function)
+{
+    auto best = std::numeric_limits<double>::max();
+
+    for (int run = 0; run < numRuns; ++run)
+    {
+        auto start = std::chrono::steady_clock::now();
+        function();
+        auto end = std::chrono::steady_clock::now();
+
+        best = juce::jmin (best, std::chrono::duration<double, std::nano> (end - start).count() / (double) numSamples);
+    }
+
+    return best;
+}
+
+/** Stops the compiler from optimising away a result */
+template <typename Type>
+void keepResult (Type value)
+{
+    static volatile Type sink;
+    sink = value;
+}
+
+void printBenchmarkResult (const juce::String& name, double nanosecondsPerSample);
+
+/** Compares an output sample by sample with the one recorded under name in the golden directory
+    (--golden=<directory>), and fails if any sample is further off than tolerance. An output with no
+    committed recording is checked against one in --local-golden=<directory> instead, which the first
+    run records, and fails without either unless --allow-missing is given. --update-golden records the
+    outputs in the golden directory instead of checking them.
+*/
+void checkGoldenOutput (const juce::String& name, const std::vector<float>& output, float tolerance);
+
+/** Prints the result, and fails if it is more than --max-regression=<percent> slower than the entry
+    for name in the --baseline=<file>, or if the file has no entry for name unless --allow-missing is given.
+    --update-baseline, or a file that is not there yet, records this run's results in it instead.
+*/
+void checkThroughput (const juce::String& name, double nanosecondsPerSample);
+
+/** Prints the message and makes GuitarFXBenchmarks exit with an error */
+void reportBenchmarkFailure (const juce::String& message);
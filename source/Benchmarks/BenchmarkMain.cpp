@@ -0,0 +1,263 @@
+/*
+    Runs every registered benchmark, or only the ones named on the command line.
+*/
+
+#include "Benchmark.h"
+#include "../RealtimeChecker.h"
+#include <algorithm>
+#include <map>
+
+static std::vector<std::pair<const char*, BenchmarkFunction>>& getBenchmarks()
+{
+    static std::vector<std::pair<const char*, BenchmarkFunction>> benchmarks;
+    return benchmarks;
+}
+
+BenchmarkRegistration::BenchmarkRegistration (const char* name, BenchmarkFunction function)
+{
+    getBenchmarks().emplace_back (name, function);
+}
+
+void printBenchmarkResult (const juce::String& name, double nanosecondsPerSample)
+{
+    std::cout << name.paddedRight (' ', 48) << juce::String (nanosecondsPerSample, 3) << " ns/sample" << std::endl;
+}
+
+static bool anyFailed = false;
+
+void reportBenchmarkFailure (const juce::String& message)
+{
+    std::cout << "FAILED: " << message << std::endl;
+    anyFailed = true;
+}
+
+//==============================================================================
+struct BenchmarkOptions
+{
+    juce::File goldenDirectory;         // source/Benchmarks/Golden by default
+    juce::File localGoldenDirectory;    // Recordings for outputs with none committed, in the build tree by default
+    bool updateGolden = false;
+    juce::File baselineFile;
+    bool updateBaseline = false;
+    double maxRegression = 10.0;        // Percent
+    bool allowMissing = false;          // A golden output or baseline entry that is not there only gets a note
+};
+
+static BenchmarkOptions options;
+
+static BenchmarkOptions parseOptions (const juce::ArgumentList& args)
+{
+    BenchmarkOptions parsed;
+    auto cwd = juce::File::getCurrentWorkingDirectory();
+
+   #ifdef GUITARFX_GOLDEN_DIRECTORY
+    parsed.goldenDirectory = juce::File (GUITARFX_GOLDEN_DIRECTORY);
+   #else
+    parsed.goldenDirectory = cwd.getChildFile ("Golden");
+   #endif
+
+   #ifdef GUITARFX_LOCAL_GOLDEN_DIRECTORY
+    parsed.localGoldenDirectory = juce::File (GUITARFX_LOCAL_GOLDEN_DIRECTORY);
+   #endif
+
+    if (args.containsOption ("--golden"))
+        parsed.goldenDirectory = cwd.getChildFile (args.getValueForOption ("--golden"));
+
+    if (args.containsOption ("--local-golden"))
+        parsed.localGoldenDirectory = cwd.getChildFile (args.getValueForOption ("--local-golden"));
+
+    if (args.containsOption ("--baseline"))
+        parsed.baselineFile = cwd.getChildFile (args.getValueForOption ("--baseline"));
+
+    if (args.containsOption ("--max-regression"))
+        parsed.maxRegression = args.getValueForOption ("--max-regression").getDoubleValue();
+
+    parsed.updateGolden = args.containsOption ("--update-golden");
+    parsed.updateBaseline = args.containsOption ("--update-baseline");
+    parsed.allowMissing = args.containsOption ("--allow-missing");
+    return parsed;
+}
+
+// Without --allow-missing a check with nothing to check against fails, so it cannot pass by checking nothing
+static void reportMissing (const juce::String& name, const juce::String& message)
+{
+    if (options.allowMissing)
+        std::cout << name.paddedRight (' ', 48) << message << std::endl;
+    else
+        reportBenchmarkFailure (name + ": " + message);
+}
+
+static bool recordGoldenOutput (const juce::File& file, const std::vector<float>& output)
+{
+    if (file.getParentDirectory().createDirectory().failed() || ! file.replaceWithData (output.data(), output.size() * sizeof (float)))
+    {
+        reportBenchmarkFailure ("Could not write " + file.getFullPathName());
+        return false;
+    }
+
+    return true;
+}
+
+// Golden outputs are raw native floats, which is little-endian on every machine this runs on
+void checkGoldenOutput (const juce::String& name, const std::vector<float>& output, float tolerance)
+{
+    auto file = options.goldenDirectory.getChildFile (name + ".f32");
+
+    if (options.updateGolden)
+    {
+        if (recordGoldenOutput (file, output))
+            std::cout << name.paddedRight (' ', 48) << "recorded" << std::endl;
+
+        return;
+    }
+
+    // With no committed recording, the first run records one in the build tree and later runs are checked against it
+    auto local = ! file.existsAsFile() && options.localGoldenDirectory != juce::File();
+
+    if (local)
+        file = options.localGoldenDirectory.getChildFile (name + ".f32");
+
+    juce::MemoryBlock golden;
+
+    if (! file.loadFileAsData (golden))
+    {
+        if (! local)
+            reportMissing (name, "no golden output, record it with --update-golden");
+        else if (recordGoldenOutput (file, output))
+            std::cout << name.paddedRight (' ', 48) << "no committed golden output, recorded this run in "
+                      << file.getFullPathName() << " to check later runs against" << std::endl;
+
+        return;
+    }
+
+    if (golden.getSize() != output.size() * sizeof (float))
+    {
+        reportBenchmarkFailure (name + " has " + juce::String (output.size()) + " samples, the golden output "
+                                 + juce::String (golden.getSize() / sizeof (float)));
+        return;
+    }
+
+    auto* expected = static_cast<const float*> (golden.getData());
+    auto maxError = 0.0f;
+    size_t worstSample = 0;
+
+    for (size_t i = 0; i < output.size(); ++i)
+    {
+        auto error = std::abs (output[i] - expected[i]);
+
+        // A NaN compares false with everything, it counts as off by any amount
+        if (! (error <= maxError))
+        {
+            maxError = std::isnan (error) ? std::numeric_limits<float>::infinity() : error;
+            worstSample = i;
+        }
+    }
+
+    if (maxError > tolerance)
+        reportBenchmarkFailure (name + " is off the golden output by " + juce::String (maxError) + " at sample " + juce::String (worstSample));
+    else
+        std::cout << name.paddedRight (' ', 48) << "matches, off by at most " << maxError << std::endl;
+}
+
+//==============================================================================
+// Both in ns/sample, keyed by the printed names
+static std::map<juce::String, double> baseline, measured;
+
+// One "<ns/sample> <name>" per line
+static void loadBaseline()
+{
+    juce::StringArray lines;
+    options.baselineFile.readLines (lines);
+
+    for (auto& line : lines)
+    {
+        auto name = line.fromFirstOccurrenceOf (" ", false, false).trim();
+
+        if (name.isNotEmpty())
+            baseline[name] = line.upToFirstOccurrenceOf (" ", false, false).getDoubleValue();
+    }
+}
+
+// Entries for benchmarks that did not run this time are kept
+static void saveBaseline()
+{
+    for (auto& [name, nanosecondsPerSample] : measured)
+        baseline[name] = nanosecondsPerSample;
+
+    juce::String text;
+
+    for (auto& [name, nanosecondsPerSample] : baseline)
+        text << juce::String (nanosecondsPerSample, 3) << " " << name << juce::newLine;
+
+    if (! options.baselineFile.replaceWithText (text))
+        reportBenchmarkFailure ("Could not write " + options.baselineFile.getFullPathName());
+    else
+        std::cout << "Recorded the throughputs in " << options.baselineFile.getFullPathName() << std::endl;
+}
+
+void checkThroughput (const juce::String& name, double nanosecondsPerSample)
+{
+    printBenchmarkResult (name, nanosecondsPerSample);
+    measured[name] = nanosecondsPerSample;
+
+    auto entry = baseline.find (name);
+
+    if (options.updateBaseline || options.baselineFile == juce::File())
+        return;
+
+    if (entry == baseline.end())
+    {
+        reportMissing (name, "not in the baseline, record it with --update-baseline");
+        return;
+    }
+
+    if (nanosecondsPerSample > entry->second * (1.0 + options.maxRegression / 100.0))
+        reportBenchmarkFailure (name + " takes " + juce::String (nanosecondsPerSample, 3) + " ns/sample, more than "
+                                 + juce::String (options.maxRegression, 1) + "% over the baseline's " + juce::String (entry->second, 3));
+}
+
+//==============================================================================
+int main (int argc, char* argv[])
+{
+    juce::ArgumentList args (argc, argv);
+    juce::StringArray selected;
+    options = parseOptions (args);
+
+    for (auto& argument : args.arguments)
+        if (! argument.isOption())
+            selected.add (argument.text);
+
+    // The first run on a machine records the baseline that later runs are checked against
+    if (options.baselineFile != juce::File() && options.baselineFile.existsAsFile())
+    {
+        loadBaseline();
+    }
+    else if (options.baselineFile != juce::File() && ! options.updateBaseline)
+    {
+        std::cout << "No baseline in " << options.baselineFile.getFullPathName()
+                  << " yet, recording this run's throughputs there instead of checking them" << std::endl;
+        options.updateBaseline = true;
+    }
+
+    // A misspelt name would otherwise run nothing and pass
+    for (auto& name : selected)
+        if (std::none_of (getBenchmarks().begin(), getBenchmarks().end(), [&] (auto& benchmark) { return name == benchmark.first; }))
+            reportBenchmarkFailure ("There is no benchmark called " + name);
+
+    for (auto& [name, function] : getBenchmarks())
+    {
+        if (! selected.isEmpty() && ! selected.contains (name))
+            continue;
+
+        std::cout << "-- " << name << std::endl;
+        function();
+    }
+
+    if (options.updateBaseline && options.baselineFile != juce::File())
+        saveBaseline();
+
+    if (RealtimeChecker::getNumViolations() > 0)
+        reportBenchmarkFailure (juce::String (RealtimeChecker::getNumViolations()) + " real-time violations on the audio path");
+
+    return anyFailed ? 1 : 0;
+}
@@ -0,0 +1,72 @@
+/*
+    The Convolver with impulse responses from a short cabinet to a long hall, at the block sizes
+    a live run uses, to see which lengths fit the CPU budget.
+*/
+
+#include "Benchmark.h"
+#include "../Convolver.h"
+
+namespace
+{
+    constexpr double sampleRate = 48000.0;
+    constexpr size_t numSamples = 48000 * 5;
+    constexpr int numRuns = 3;
+    constexpr int numChannels = 2;
+
+    // Decaying noise, about what a room sounds like to the engine
+    juce::AudioBuffer<float> createImpulseResponse (double seconds)
+    {
+        juce::AudioBuffer<float> impulseResponse (numChannels, (int) (seconds * sampleRate));
+        juce::Random random (2);
+
+        for (int ch = 0; ch < numChannels; ++ch)
+            for (int i = 0; i < impulseResponse.getNumSamples(); ++i)
+                impulseResponse.setSample (ch, i, (random.nextFloat() * 2.0f - 1.0f)
+                                                    * std::exp (-6.9f * (float) i / (float) impulseResponse.getNumSamples()));
+
+        return impulseResponse;
+    }
+}
+
+GUITARFX_BENCHMARK (convolution)
+{
+    juce::ScopedNoDenormals noDenormals;
+
+    juce::AudioBuffer<float> buffer (numChannels, (int) numSamples);
+    juce::Random random (1);
+
+    for (int ch = 0; ch < numChannels; ++ch)
+        for (int i = 0; i < (int) numSamples; ++i)
+            buffer.setSample (ch, i, random.nextFloat() * 2.0f - 1.0f);
+
+    for (size_t blockSize : { 64, 256 })
+    {
+        for (auto seconds : { 0.1, 0.5, 1.0, 2.0, 3.0 })
+        {
+            Convolver convolver;
+            convolver.loadImpulseResponse (createImpulseResponse (seconds), sampleRate);
+            convolver.prepare ({ sampleRate, (juce::uint32) blockSize, (juce::uint32) numChannels });
+
+            auto processBlocks = [&]
+            {
+                juce::dsp::AudioBlock<float> block (buffer);
+
+                for (size_t start = 0; start + blockSize <= numSamples; start += blockSize)
+                {
+                    auto subBlock = block.getSubBlock (start, blockSize);
+                    convolver.process (juce::dsp::ProcessContextReplacing<float> (subBlock));
+                }
+            };
+
+            // Timing the unit impulse the engines start out with would say nothing about the response
+            if (! convolver.waitForImpulseResponse (10000))
+            {
+                reportBenchmarkFailure ("The " + juce::String (seconds) + " s impulse response never got installed");
+                continue;
+            }
+
+            printBenchmarkResult ("Convolver " + juce::String (seconds) + " s (block " + juce::String (blockSize) + ")",
+                                  measureNanosecondsPerSample (numSamples, numRuns, processBlocks));
+        }
+    }
+}
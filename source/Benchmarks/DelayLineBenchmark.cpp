@@ -0,0 +1,80 @@
+/*
+    DelayLine (modulo indexing) against MaskedDelayLine (power of two, masked
+    indexing and block spans) at the sizes the Delay stage uses.
+*/
+
+#include "Benchmark.h"
+#include "../CustomDelay.h"
+
+namespace
+{
+    constexpr size_t lineSize = 19200;     // 0.4 s at 48 kHz
+    constexpr size_t delayInSamples = 9600;
+    constexpr size_t blockSize = 64;
+    constexpr size_t numSamples = 48000 * 10;
+    constexpr int numRuns = 5;
+
+    std::vector<float> makeInput()
+    {
+        juce::Random random (1);
+        std::vector<float> input (numSamples);
+
+        for (auto& sample : input)
+            sample = random.nextFloat() * 2.0f - 1.0f;
+
+        return input;
+    }
+
+    template <typename Line>
+    double runPerSample (const std::vector<float>& input)
+    {
+        Line line;
+        line.resize (lineSize);
+
+        return measureNanosecondsPerSample (numSamples, numRuns, [&]
+        {
+            auto sum = 0.0f;
+
+            for (auto sample : input)
+            {
+                auto delayed = line.get (delayInSamples);
+                line.push (sample + 0.5f * delayed);
+                sum += delayed;
+            }
+
+            keepResult (sum);
+        });
+    }
+
+    double runBlocks (const std::vector<float>& input)
+    {
+        MaskedDelayLine<float> line;
+        line.resize (lineSize);
+        std::array<float, blockSize> delayed, lineInput;
+
+        return measureNanosecondsPerSample (numSamples, numRuns, [&]
+        {
+            auto sum = 0.0f;
+
+            for (size_t start = 0; start < numSamples; start += blockSize)
+            {
+                line.readBlock (delayInSamples, blockSize).copyTo (delayed.data());
+                juce::FloatVectorOperations::copy (lineInput.data(), input.data() + start, (int) blockSize);
+                juce::FloatVectorOperations::addWithMultiply (lineInput.data(), delayed.data(), 0.5f, (int) blockSize);
+                line.writeBlock (lineInput.data(), blockSize);
+                sum += delayed[0];
+            }
+
+            keepResult (sum);
+        });
+    }
+}
+
+GUITARFX_BENCHMARK (delayLine)
+{
+    auto input = makeInput();
+
+    printBenchmarkResult ("DelayLine get/push", runPerSample<DelayLine<float>> (input));
+    printBenchmarkResult ("MaskedDelayLine get/push", runPerSample<MaskedDelayLine<float>> (input));
+    printBenchmarkResult ("MaskedDelayLine readBlock/writeBlock", runBlocks (input));
+}
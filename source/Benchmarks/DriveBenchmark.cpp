@@ -0,0 +1,114 @@
+/*
+    Aliasing against cost of the Drive at every oversampling factor and curve. The aliasing is
+    the energy that is not a harmonic of a driven 7 kHz sine, relative to the harmonics.
+*/
+
+#include "Benchmark.h"
+#include "../Drive.h"
+
+namespace
+{
+    constexpr double sampleRate = 48000.0;
+    constexpr size_t blockSize = 64;
+    constexpr int numChannels = 2;
+    constexpr int numRuns = 5;
+
+    constexpr int fftOrder = 14;
+    constexpr int fftSize = 1 << fftOrder;
+    constexpr int sineBin = 2389;       // About 7 kHz, on a bin so it does not leak
+
+    void processBlocks (Drive& drive, juce::AudioBuffer<float>& buffer)
+    {
+        juce::dsp::AudioBlock<float> block (buffer);
+
+        for (size_t start = 0; start + blockSize <= (size_t) buffer.getNumSamples(); start += blockSize)
+        {
+            auto subBlock = block.getSubBlock (start, blockSize);
+            drive.process (juce::dsp::ProcessContextReplacing<float> (subBlock));
+        }
+    }
+
+    void prepareDrive (Drive& drive, int order, DriveCurve curve)
+    {
+        drive.setOversamplingOrder (order);
+        drive.setCurve (curve);
+        drive.setDrive (24.0f);
+        drive.setLevel (0.0f);
+        drive.setTightFrequency (20.0f);
+        drive.setToneFrequency (16000.0f);
+        drive.prepare ({ sampleRate, (juce::uint32) blockSize, (juce::uint32) numChannels });
+    }
+
+    double measureAliasingDecibels (int order, DriveCurve curve)
+    {
+        Drive drive;
+        prepareDrive (drive, order, curve);
+
+        // The first half lets the filters settle, the second half is analysed
+        juce::AudioBuffer<float> buffer (numChannels, fftSize * 2);
+
+        for (int ch = 0; ch < numChannels; ++ch)
+            for (int i = 0; i < buffer.getNumSamples(); ++i)
+                buffer.setSample (ch, i, 0.5f * std::sin (juce::MathConstants<float>::twoPi * (float) sineBin * (float) i / (float) fftSize));
+
+        processBlocks (drive, buffer);
+
+        std::vector<float> spectrum (fftSize * 2);
+        std::copy (buffer.getReadPointer (0, fftSize), buffer.getReadPointer (0, fftSize) + fftSize, spectrum.begin());
+
+        juce::dsp::WindowingFunction<float> (fftSize, juce::dsp::WindowingFunction<float>::hann, false).multiplyWithWindowingTable (spectrum.data(), fftSize);
+        juce::dsp::FFT (fftOrder).performFrequencyOnlyForwardTransform (spectrum.data());
+
+        double harmonics = 0.0, aliasing = 0.0;
+
+        // The Hann window spreads every component over its bin and the two next to it
+        for (int bin = 4; bin < fftSize / 2; ++bin)
+        {
+            auto nearest = (bin + sineBin / 2) / sineBin * sineBin;
+            auto power = (double) spectrum[(size_t) bin] * spectrum[(size_t) bin];
+
+            if (std::abs (bin - nearest) <= 1)
+                harmonics += power;
+            else
+                aliasing += power;
+        }
+
+        return 10.0 * std::log10 (aliasing / juce::jmax (harmonics, 1.0e-30) + 1.0e-30);
+    }
+}
+
+GUITARFX_BENCHMARK (drive)
+{
+    juce::ScopedNoDenormals noDenormals;
+
+    constexpr size_t numSamples = 48000 * 5;
+    juce::AudioBuffer<float> input (numChannels, (int) numSamples), buffer (numChannels, (int) numSamples);
+    juce::Random random (1);
+
+    for (int ch = 0; ch < numChannels; ++ch)
+        for (int i = 0; i < (int) numSamples; ++i)
+            input.setSample (ch, i, (random.nextFloat() * 2.0f - 1.0f) * 0.5f);
+
+    const std::pair<DriveCurve, const char*> curves[] = { { DriveCurve::soft,       "soft" },
+                                                          { DriveCurve::hard,       "hard" },
+                                                          { DriveCurve::asymmetric, "asymmetric" } };
+
+    for (auto& [curve, name] : curves)
+    {
+        for (int order = 1; order <= Drive::maxOversamplingOrder; ++order)
+        {
+            Drive drive;
+            prepareDrive (drive, order, curve);
+
+            auto nanoseconds = measureNanosecondsPerSample (numSamples, numRuns, [&]
+            {
+                buffer.makeCopyOf (input, true);
+                processBlocks (drive, buffer);
+                keepResult (buffer.getSample (0, 0));
+            });
+
+            printBenchmarkResult (juce::String (name) + " " + juce::String (1 << order) + "x (aliasing "
+                                    + juce::String (measureAliasingDecibels (order, curve), 1) + " dB)", nanoseconds);
+        }
+    }
+}
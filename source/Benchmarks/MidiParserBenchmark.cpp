@@ -0,0 +1,158 @@
+/*
+    Checks MidiStreamParser against multi-megabyte synthetic streams, and fuzzes it
+    with random bytes, timing both.
+*/
+
+#include "Benchmark.h"
+#include "../MidiStreamParser.h"
+
+namespace
+{
+    using Message = std::vector<uint8_t>;
+
+    // A valid stream of channel messages (with running status), system common, SysEx and the
+    // Arduino's 0xFF stop bytes, with realtime clock bytes dropped in anywhere
+    void makeValidStream (juce::Random& random, size_t numMessages, std::vector<uint8_t>& stream, std::vector<Message>& expected)
+    {
+        uint8_t runningStatus = 0;
+
+        for (size_t n = 0; n < numMessages; ++n)
+        {
+            Message message;
+            auto kind = random.nextInt (10);
+
+            if (kind < 7)
+            {
+                auto status = (uint8_t) (0x80 | (random.nextInt (7) << 4) | random.nextInt (16));
+                auto numDataBytes = (status & 0xf0) == 0xc0 || (status & 0xf0) == 0xd0 ? 1 : 2;
+                message.push_back (status);
+
+                for (int i = 0; i < numDataBytes; ++i)
+                    message.push_back ((uint8_t) random.nextInt (128));
+
+                if (status != runningStatus || random.nextBool())
+                    stream.push_back (status);
+
+                runningStatus = status;
+                stream.insert (stream.end(), message.begin() + 1, message.end());
+            }
+            else if (kind < 8)
+            {
+                message = { 0xff };
+                stream.push_back (0xff);
+            }
+            else if (kind < 9)
+            {
+                message = { 0xf0 };
+
+                for (int i = random.nextInt (32); --i >= 0;)
+                    message.push_back ((uint8_t) random.nextInt (128));
+
+                message.push_back (0xf7);
+                stream.insert (stream.end(), message.begin(), message.end());
+                runningStatus = 0;
+            }
+            else
+            {
+                message = { 0xf2, (uint8_t) random.nextInt (128), (uint8_t) random.nextInt (128) };
+                stream.insert (stream.end(), message.begin(), message.end());
+                runningStatus = 0;
+            }
+
+            expected.push_back (message);
+
+            if (random.nextInt (5) == 0)
+                stream.insert (stream.begin() + (std::ptrdiff_t) (stream.size() - (size_t) random.nextInt ((int) message.size())), 0xf8);
+        }
+    }
+}
+
+GUITARFX_BENCHMARK (midiParser)
+{
+    juce::Random random (7);
+    constexpr int numRuns = 5;
+
+    // Valid stream, fed in reads of random sizes, must come out exactly as it went in
+    {
+        std::vector<uint8_t> stream;
+        std::vector<Message> expected;
+        makeValidStream (random, 1000000, stream, expected);
+
+        std::vector<Message> received;
+        MidiStreamParser parser;
+        size_t position = 0;
+
+        while (position < stream.size())
+        {
+            auto numBytes = juce::jmin (stream.size() - position, (size_t) random.nextInt ({ 1, 300 }));
+
+            parser.feed (stream.data() + position, numBytes, [&] (const uint8_t* data, size_t size)
+            {
+                if (! (size == 1 && data[0] == 0xf8))
+                    received.emplace_back (data, data + size);
+            });
+
+            position += numBytes;
+        }
+
+        if (received != expected)
+            reportBenchmarkFailure ("midiParser decoded " + juce::String ((int) received.size()) + " of "
+                                    + juce::String ((int) expected.size()) + " messages, or decoded them wrongly");
+
+        if (parser.getStatistics().droppedBytes > 0 || parser.getStatistics().truncatedMessages > 0)
+            reportBenchmarkFailure ("midiParser reported errors on a valid stream");
+
+        auto nanoseconds = measureNanosecondsPerSample (stream.size(), numRuns, [&]
+        {
+            MidiStreamParser timedParser;
+            size_t numMessages = 0;
+            timedParser.feed (stream.data(), stream.size(), [&] (const uint8_t*, size_t) { ++numMessages; });
+            keepResult (numMessages);
+        });
+
+        printBenchmarkResult ("valid stream, " + juce::String ((double) stream.size() / 1.0e6, 1) + " MB (ns/byte)", nanoseconds);
+    }
+
+    // Random bytes: whatever comes out must still be a well formed message, and it must resync
+    {
+        std::vector<uint8_t> stream (8 << 20);
+
+        for (auto& byte : stream)
+            byte = (uint8_t) random.nextInt (256);
+
+        MidiStreamParser parser;
+        size_t numMalformed = 0;
+
+        auto nanoseconds = measureNanosecondsPerSample (stream.size(), 1, [&]
+        {
+            parser.feed (stream.data(), stream.size(), [&] (const uint8_t* data, size_t size)
+            {
+                auto isSysEx = data[0] == 0xf0;
+
+                if (size == 0 || data[0] < 0x80 || (! isSysEx && size > 3) || (isSysEx && data[size - 1] != 0xf7))
+                    ++numMalformed;
+
+                for (size_t i = 1; i < (isSysEx ? size - 1 : size); ++i)
+                    if (data[i] >= 0x80)
+                        ++numMalformed;
+            });
+        });
+
+        if (numMalformed > 0)
+            reportBenchmarkFailure ("midiParser produced " + juce::String ((int) numMalformed) + " malformed messages from random input");
+
+        uint8_t controlChange[] = { 0xb0, 1, 64 };
+        auto resynced = false;
+        parser.feed (controlChange, sizeof (controlChange), [&] (const uint8_t* data, size_t size)
+        {
+            resynced = size == 3 && std::equal (data, data + 3, controlChange);
+        });
+
+        if (! resynced)
+            reportBenchmarkFailure ("midiParser did not resync after random input");
+
+        auto& statistics = parser.getStatistics();
+        printBenchmarkResult ("random bytes, " + juce::String (statistics.messages.load()) + " messages, "
+                              + juce::String (statistics.droppedBytes.load()) + " dropped (ns/byte)", nanoseconds);
+    }
+}
@@ -0,0 +1,84 @@
+/*
+    The MultiTapDelay with 1 to 8 taps against the stereo Delay stage, as a ratio of the
+    Delay's cost, at the block sizes a live run uses. Fails if 8 taps cost more than twice the Delay.
+*/
+
+#include "Benchmark.h"
+#include "../MultiTapDelay.h"
+
+namespace
+{
+    constexpr double sampleRate = 48000.0;
+    constexpr size_t numSamples = 48000 * 10;
+    constexpr int numRuns = 5;
+    constexpr int numChannels = 2;
+    constexpr double maxRatio = 2.0;     // What 8 taps may cost against the Delay
+
+    template <typename Effect>
+    double run (Effect& effect, juce::AudioBuffer<float>& buffer, size_t blockSize)
+    {
+        return measureNanosecondsPerSample (numSamples, numRuns, [&]
+        {
+            juce::dsp::AudioBlock<float> block (buffer);
+
+            for (size_t start = 0; start + blockSize <= numSamples; start += blockSize)
+            {
+                auto subBlock = block.getSubBlock (start, blockSize);
+                effect.process (juce::dsp::ProcessContextReplacing<float> (subBlock));
+            }
+
+            keepResult (buffer.getSample (0, 0));
+        });
+    }
+}
+
+GUITARFX_BENCHMARK (multiTap)
+{
+    juce::ScopedNoDenormals noDenormals;
+
+    juce::AudioBuffer<float> buffer (numChannels, (int) numSamples);
+    juce::Random random (1);
+
+    for (int ch = 0; ch < numChannels; ++ch)
+        for (int i = 0; i < (int) numSamples; ++i)
+            buffer.setSample (ch, i, random.nextFloat() * 2.0f - 1.0f);
+
+    for (size_t blockSize : { 64, 256 })
+    {
+        juce::dsp::ProcessSpec spec { sampleRate, (juce::uint32) blockSize, (juce::uint32) numChannels };
+
+        Delay<float> delay;
+        delay.prepare (spec);
+        delay.setDelayTime (0, 0.3f);
+        delay.setDelayTime (1, 0.4f);
+        delay.setFeedback (0.3f);
+        delay.setWetLevel (0.5f);
+
+        auto delayTime = run (delay, buffer, blockSize);
+        printBenchmarkResult ("Delay (block " + juce::String (blockSize) + ")", delayTime);
+
+        for (size_t numTaps : { 1, 2, 4, 8 })
+        {
+            MultiTapDelay<float> multiTap;
+            multiTap.setMaxDelayTime (4.0f);
+            multiTap.prepare (spec);
+
+            // Dotted eighths at 120 BPM
+            for (size_t t = 0; t < numTaps; ++t)
+                multiTap.setTap (t, 0.375f * (float) (t + 1), std::pow (0.7f, (float) t), t % 2 == 0 ? -0.7f : 0.7f, 6000.0f);
+
+            multiTap.setNumTaps (numTaps);
+            multiTap.setFeedback (0.3f);
+            multiTap.setWetLevel (0.5f);
+
+            auto multiTapTime = run (multiTap, buffer, blockSize);
+            printBenchmarkResult ("MultiTapDelay " + juce::String (numTaps) + " taps (block " + juce::String (blockSize) + ")", multiTapTime);
+            auto ratio = multiTapTime / delayTime;
+            std::cout << "    " << juce::String (ratio, 2) << "x the Delay" << std::endl;
+
+            if (numTaps == 8 && ratio > maxRatio)
+                reportBenchmarkFailure ("MultiTapDelay with " + juce::String (numTaps) + " taps (block " + juce::String (blockSize)
+                                         + ") costs " + juce::String (ratio, 2) + "x the Delay, more than " + juce::String (maxRatio, 1) + "x");
+        }
+    }
+}
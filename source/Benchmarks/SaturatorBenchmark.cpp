@@ -0,0 +1,51 @@
+/*
+    Accuracy against std::tanh and cost per sample of every SaturationType,
+    so one can be picked per preset.
+*/
+
+#include "Benchmark.h"
+#include "../Saturator.h"
+
+GUITARFX_BENCHMARK (saturator)
+{
+    constexpr size_t blockSize = 64;
+    constexpr size_t numBlocks = 10000;
+    constexpr int numRuns = 5;
+
+    // Feedback levels, mostly in the soft knee with some way past it
+    juce::Random random (1);
+    std::vector<float> input (blockSize * numBlocks);
+
+    for (auto& sample : input)
+        sample = (random.nextFloat() * 2.0f - 1.0f) * 3.0f;
+
+    std::vector<float> block (blockSize);
+
+    const std::pair<SaturationType, const char*> types[] = { { SaturationType::tanh,        "tanh" },
+                                                             { SaturationType::pade,        "pade" },
+                                                             { SaturationType::lookupTable, "lookupTable" },
+                                                             { SaturationType::hardClip,    "hardClip" } };
+
+    for (auto& [type, name] : types)
+    {
+        Saturator<float> saturator;
+        saturator.setType (type);
+
+        auto maxError = 0.0f;
+
+        for (auto x = -8.0f; x <= 8.0f; x += 0.001f)
+            maxError = juce::jmax (maxError, std::abs (saturator.processSample (x) - std::tanh (x)));
+
+        auto nanoseconds = measureNanosecondsPerSample (input.size(), numRuns, [&]
+        {
+            for (size_t start = 0; start < input.size(); start += blockSize)
+            {
+                std::copy (input.data() + start, input.data() + start + blockSize, block.data());
+                saturator.process (block.data(), blockSize);
+                keepResult (block[0]);
+            }
+        });
+
+        printBenchmarkResult (juce::String (name) + " (max error " + juce::String (maxError, 7) + ")", nanoseconds);
+    }
+}
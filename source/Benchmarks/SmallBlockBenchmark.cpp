@@ -0,0 +1,53 @@
+/*
+    The whole processor at shrinking block sizes, to show what a lower latency costs in CPU.
+    Small-block mode is timed against real blocks of the same size.
+*/
+
+#include "Benchmark.h"
+#include "../AudioProcessor.h"
+
+namespace
+{
+    constexpr double sampleRate = 48000.0;
+    constexpr int numSamples = 48000 * 5;
+    constexpr int numRuns = 3;
+
+    double measureProcessor (int hostBlockSize, int subBlockSize)
+    {
+        Processor processor;
+        processor.setSubBlockSize (subBlockSize);
+        processor.prepareToPlay (sampleRate, hostBlockSize);
+
+        juce::AudioBuffer<float> input (2, numSamples), buffer (2, hostBlockSize);
+        juce::MidiBuffer midi;
+        juce::Random random (1);
+
+        for (int ch = 0; ch < input.getNumChannels(); ++ch)
+            for (int i = 0; i < numSamples; ++i)
+                input.setSample (ch, i, random.nextFloat() * 0.5f - 0.25f);
+
+        return measureNanosecondsPerSample ((size_t) numSamples, numRuns, [&]
+        {
+            for (int start = 0; start + hostBlockSize <= numSamples; start += hostBlockSize)
+            {
+                for (int ch = 0; ch < buffer.getNumChannels(); ++ch)
+                    buffer.copyFrom (ch, 0, input, ch, start, hostBlockSize);
+
+                processor.processBlock (buffer, midi);
+            }
+
+            keepResult (buffer.getSample (0, 0));
+        });
+    }
+}
+
+GUITARFX_BENCHMARK (smallBlocks)
+{
+    juce::ScopedNoDenormals noDenormals;
+
+    for (int blockSize : { 1024, 512, 256, 128, 64, 32, 16 })
+        printBenchmarkResult ("Processor (block " + juce::String (blockSize) + ")", measureProcessor (blockSize, 0));
+
+    for (int subBlockSize : { 64, 32, 16 })
+        printBenchmarkResult ("Processor (block 256, sub-block " + juce::String (subBlockSize) + ")", measureProcessor (256, subBlockSize));
+}
@@ -0,0 +1,305 @@
+/*
+    Every DSP stage and the whole Processor on fixed test signals: the outputs are checked
+    against recorded golden ones, and the throughput at block sizes from 16 to 1024 against
+    a baseline.
+*/
+
+#include "Benchmark.h"
+#include "../AudioProcessor.h"
+#include "../CustomDelay.h"
+
+namespace
+{
+    constexpr double sampleRate = 48000.0;
+    constexpr int numChannels = 2;
+    constexpr int goldenLength = 8192;
+    constexpr int goldenBlockSize = 64;
+    constexpr int throughputLength = 48000 * 2;
+    constexpr int numRuns = 5;
+
+    //==============================================================================
+    // A logarithmic sine sweep from 20 Hz to 20 kHz at -6 dB
+    juce::AudioBuffer<float> makeSweep (int numSamples)
+    {
+        juce::AudioBuffer<float> signal (numChannels, numSamples);
+        auto rate = std::log (1000.0) / numSamples;
+        auto scale = 2.0 * juce::MathConstants<double>::pi * 20.0 / (rate * sampleRate);
+
+        for (int i = 0; i < numSamples; ++i)
+            for (int ch = 0; ch < numChannels; ++ch)
+                signal.setSample (ch, i, (float) (0.5 * std::sin (scale * (std::exp (rate * i) - 1.0))));
+
+        return signal;
+    }
+
+    // One full scale sample, then the tails
+    juce::AudioBuffer<float> makeImpulse (int numSamples)
+    {
+        juce::AudioBuffer<float> signal (numChannels, numSamples);
+        signal.clear();
+
+        for (int ch = 0; ch < numChannels; ++ch)
+            signal.setSample (ch, 0, 1.0f);
+
+        return signal;
+    }
+
+    // Stands in for a DI guitar: plucked strings (Karplus-Strong) from a fixed seed, a new note every 250 ms
+    juce::AudioBuffer<float> makeGuitar (int numSamples)
+    {
+        juce::AudioBuffer<float> signal (numChannels, numSamples);
+        juce::Random random (1);
+        std::vector<float> string;
+        size_t position = 0;
+
+        static constexpr double notes[] = { 82.41, 110.0, 146.83, 196.0, 246.94, 329.63 };
+        constexpr int noteLength = 12000;
+
+        for (int i = 0; i < numSamples; ++i)
+        {
+            if (i % noteLength == 0)
+            {
+                string.resize ((size_t) (sampleRate / notes[(i / noteLength) % (int) std::size (notes)]));
+
+                for (auto& sample : string)
+                    sample = random.nextFloat() * 0.6f - 0.3f;
+
+                position = 0;
+            }
+
+            auto next = (position + 1) % string.size();
+            auto sample = string[position];
+            string[position] = 0.498f * (sample + string[next]);
+            position = next;
+
+            for (int ch = 0; ch < numChannels; ++ch)
+                signal.setSample (ch, i, sample);
+        }
+
+        return signal;
+    }
+
+    //==============================================================================
+    // Each stage has fixed settings, with short delays so the repeats land inside the golden signals
+    struct DelayStage
+    {
+        static constexpr const char* name = "delay";
+        static constexpr float tolerance = 1.0e-5f;
+        Delay<float> delay;
+
+        void prepare (const juce::dsp::ProcessSpec& spec)
+        {
+            delay.setMaxDelayTime (0.5f);
+            delay.setDelayTime (0, 0.02f);
+            delay.setDelayTime (1, 0.035f);
+            delay.setFeedback (0.5f);
+            delay.setWetLevel (0.5f);
+            delay.prepare (spec);
+        }
+
+        void process (juce::dsp::AudioBlock<float>& block)   { delay.process (juce::dsp::ProcessContextReplacing<float> (block)); }
+    };
+
+    // A feedback comb on the plain modulo-indexed line
+    struct DelayLineStage
+    {
+        static constexpr const char* name = "delayLine";
+        static constexpr float tolerance = 1.0e-5f;
+        std::array<DelayLine<float>, numChannels> lines;
+        size_t delayInSamples = 0;
+
+        void prepare (const juce::dsp::ProcessSpec& spec)
+        {
+            delayInSamples = (size_t) (0.03 * spec.sampleRate);
+
+            for (auto& line : lines)
+                line.resize (delayInSamples + 1);
+        }
+
+        void process (juce::dsp::AudioBlock<float>& block)
+        {
+            for (size_t ch = 0; ch < block.getNumChannels(); ++ch)
+            {
+                auto* data = block.getChannelPointer (ch);
+
+                for (size_t i = 0; i < block.getNumSamples(); ++i)
+                {
+                    auto delayed = lines[ch].get (delayInSamples);
+                    lines[ch].push (data[i] + 0.5f * delayed);
+                    data[i] += delayed;
+                }
+            }
+        }
+    };
+
+    struct CompressorStage
+    {
+        static constexpr const char* name = "compressor";
+        static constexpr float tolerance = 1.0e-5f;
+        juce::dsp::Compressor<float> compressor;
+
+        void prepare (const juce::dsp::ProcessSpec& spec)
+        {
+            compressor.setThreshold (-24.0f);
+            compressor.setRatio (4.0f);
+            compressor.setAttack (5.0f);
+            compressor.setRelease (100.0f);
+            compressor.prepare (spec);
+        }
+
+        void process (juce::dsp::AudioBlock<float>& block)   { compressor.process (juce::dsp::ProcessContextReplacing<float> (block)); }
+    };
+
+    // The delay time comes from a sine and is read between samples, so a rounding difference in it
+    // moves the output much more than it does in the other stages
+    struct ChorusStage
+    {
+        static constexpr const char* name = "chorus";
+        static constexpr float tolerance = 1.0e-4f;
+        juce::dsp::Chorus<float> chorus;
+
+        void prepare (const juce::dsp::ProcessSpec& spec)
+        {
+            chorus.setRate (1.5f);
+            chorus.setDepth (0.5f);
+            chorus.setCentreDelay (7.0f);
+            chorus.setFeedback (0.2f);
+            chorus.setMix (0.5f);
+            chorus.prepare (spec);
+        }
+
+        void process (juce::dsp::AudioBlock<float>& block)   { chorus.process (juce::dsp::ProcessContextReplacing<float> (block)); }
+    };
+
+    struct ReverbStage
+    {
+        static constexpr const char* name = "reverb";
+        static constexpr float tolerance = 1.0e-5f;
+        juce::dsp::Reverb reverb;
+
+        void prepare (const juce::dsp::ProcessSpec& spec)
+        {
+            juce::dsp::Reverb::Parameters parameters;
+            parameters.roomSize = 0.6f;
+            parameters.damping = 0.5f;
+            parameters.wetLevel = 0.33f;
+            parameters.dryLevel = 0.7f;
+            parameters.width = 1.0f;
+            reverb.setParameters (parameters);
+            reverb.prepare (spec);
+        }
+
+        void process (juce::dsp::AudioBlock<float>& block)   { reverb.process (juce::dsp::ProcessContextReplacing<float> (block)); }
+    };
+
+    // The default graph with the default parameters. The stages add up their rounding differences, so it gets more room.
+    struct ProcessorStage
+    {
+        static constexpr const char* name = "processor";
+        static constexpr float tolerance = 1.0e-4f;
+        Processor processor;
+        juce::MidiBuffer midi;
+
+        void prepare (const juce::dsp::ProcessSpec& spec)
+        {
+            // Keeps load-dependent settings such as the drive's oversampling where they start
+            processor.setNonRealtime (true);
+            processor.prepareToPlay (spec.sampleRate, (int) spec.maximumBlockSize);
+        }
+
+        void process (juce::dsp::AudioBlock<float>& block)
+        {
+            float* channels[numChannels] = { block.getChannelPointer (0), block.getChannelPointer (1) };
+            juce::AudioBuffer<float> buffer (channels, numChannels, (int) block.getNumSamples());
+            processor.processBlock (buffer, midi);
+        }
+    };
+
+    //==============================================================================
+    // Both channels one after the other, from a stage that starts out fresh
+    template <typename Stage>
+    std::vector<float> render (const juce::AudioBuffer<float>& signal)
+    {
+        auto stage = std::make_unique<Stage>();
+        stage->prepare ({ sampleRate, (juce::uint32) goldenBlockSize, (juce::uint32) numChannels });
+
+        juce::AudioBuffer<float> buffer (signal);
+        juce::dsp::AudioBlock<float> block (buffer);
+
+        for (size_t start = 0; start < block.getNumSamples(); start += goldenBlockSize)
+        {
+            auto subBlock = block.getSubBlock (start, juce::jmin ((size_t) goldenBlockSize, block.getNumSamples() - start));
+            stage->process (subBlock);
+        }
+
+        std::vector<float> output;
+
+        for (int ch = 0; ch < numChannels; ++ch)
+            output.insert (output.end(), buffer.getReadPointer (ch), buffer.getReadPointer (ch) + buffer.getNumSamples());
+
+        return output;
+    }
+
+    template <typename Stage>
+    void checkGoldenOutputs()
+    {
+        checkGoldenOutput (juce::String (Stage::name) + "-sweep", render<Stage> (makeSweep (goldenLength)), Stage::tolerance);
+        checkGoldenOutput (juce::String (Stage::name) + "-impulse", render<Stage> (makeImpulse (goldenLength)), Stage::tolerance);
+        checkGoldenOutput (juce::String (Stage::name) + "-guitar", render<Stage> (makeGuitar (goldenLength)), Stage::tolerance);
+    }
+
+    template <typename Stage>
+    double measureStage (const juce::AudioBuffer<float>& signal, int blockSize)
+    {
+        auto stage = std::make_unique<Stage>();
+        stage->prepare ({ sampleRate, (juce::uint32) blockSize, (juce::uint32) numChannels });
+
+        juce::AudioBuffer<float> buffer (numChannels, blockSize);
+        juce::dsp::AudioBlock<float> block (buffer);
+
+        return measureNanosecondsPerSample ((size_t) signal.getNumSamples(), numRuns, [&]
+        {
+            for (int start = 0; start + blockSize <= signal.getNumSamples(); start += blockSize)
+            {
+                for (int ch = 0; ch < numChannels; ++ch)
+                    buffer.copyFrom (ch, 0, signal, ch, start, blockSize);
+
+                stage->process (block);
+            }
+
+            keepResult (buffer.getSample (0, 0));
+        });
+    }
+
+    template <typename Stage>
+    void checkStageThroughput (const juce::AudioBuffer<float>& signal)
+    {
+        for (int blockSize = 16; blockSize <= 1024; blockSize *= 2)
+            checkThroughput (juce::String (Stage::name) + " (block " + juce::String (blockSize) + ")", measureStage<Stage> (signal, blockSize));
+    }
+}
+
+GUITARFX_BENCHMARK (goldenOutputs)
+{
+    juce::ScopedNoDenormals noDenormals;
+
+    checkGoldenOutputs<DelayStage>();
+    checkGoldenOutputs<DelayLineStage>();
+    checkGoldenOutputs<CompressorStage>();
+    checkGoldenOutputs<ChorusStage>();
+    checkGoldenOutputs<ReverbStage>();
+    checkGoldenOutputs<ProcessorStage>();
+}
+
+GUITARFX_BENCHMARK (stageThroughput)
+{
+    juce::ScopedNoDenormals noDenormals;
+    auto signal = makeGuitar (throughputLength);
+
+    checkStageThroughput<DelayStage> (signal);
+    checkStageThroughput<DelayLineStage> (signal);
+    checkStageThroughput<CompressorStage> (signal);
+    checkStageThroughput<ChorusStage> (signal);
+    checkStageThroughput<ReverbStage> (signal);
+    checkStageThroughput<ProcessorStage> (signal);
+}
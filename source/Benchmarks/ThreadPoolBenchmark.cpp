@@ -0,0 +1,94 @@
+/*
+    The Delay stage with its channels on the RealtimeThreadPool against the serial path:
+    the output has to match bit for bit, the timings show what the hand-off costs.
+*/
+
+#include "Benchmark.h"
+#include "../CustomDelay.h"
+#include "../RealtimeThreadPool.h"
+
+namespace
+{
+    constexpr double sampleRate = 48000.0;
+    constexpr size_t numSamples = 48000 * 10;
+    constexpr int numRuns = 5;
+    constexpr int numChannels = 2;
+
+    struct Setup
+    {
+        Delay<float> delay;
+        juce::AudioBuffer<float> buffer { numChannels, (int) numSamples };
+
+        explicit Setup (size_t blockSize)
+        {
+            delay.setMaxDelayTime (0.5f);
+            delay.prepare ({ sampleRate, (juce::uint32) blockSize, (juce::uint32) numChannels });
+            delay.setDelayTime (0, 0.25f);
+            delay.setDelayTime (1, 0.013f);
+            delay.setFeedback (0.6f);
+            delay.setWetLevel (0.7f);
+
+            juce::Random random (1);
+
+            for (int ch = 0; ch < numChannels; ++ch)
+                for (int i = 0; i < (int) numSamples; ++i)
+                    buffer.setSample (ch, i, random.nextFloat() * 2.0f - 1.0f);
+        }
+
+        template <typename ProcessFunction>
+        void processBlocks (size_t blockSize, ProcessFunction&& processFunction)
+        {
+            juce::dsp::AudioBlock<float> block (buffer);
+
+            for (size_t start = 0; start + blockSize <= numSamples; start += blockSize)
+            {
+                auto subBlock = block.getSubBlock (start, blockSize);
+                processFunction (juce::dsp::ProcessContextReplacing<float> (subBlock));
+            }
+        }
+    };
+
+    bool buffersMatch (const juce::AudioBuffer<float>& a, const juce::AudioBuffer<float>& b)
+    {
+        for (int ch = 0; ch < numChannels; ++ch)
+            if (std::memcmp (a.getReadPointer (ch), b.getReadPointer (ch), sizeof (float) * numSamples) != 0)
+                return false;
+
+        return true;
+    }
+}
+
+GUITARFX_BENCHMARK (threadPool)
+{
+    RealtimeThreadPool pool (1);
+    juce::ScopedNoDenormals noDenormals;
+
+    for (size_t blockSize : { 16, 64, 256 })
+    {
+        Setup serial (blockSize), parallel (blockSize);
+
+        serial.processBlocks (blockSize, [&] (const auto& context) { serial.delay.process (context); });
+        parallel.processBlocks (blockSize, [&] (const auto& context)
+        {
+            pool.run (numChannels, [&] (size_t channel) { parallel.delay.process (context, channel); });
+        });
+
+        if (! buffersMatch (serial.buffer, parallel.buffer))
+            reportBenchmarkFailure ("Delay on the thread pool does not match the serial output at block size " + juce::String (blockSize));
+
+        auto label = " (block " + juce::String (blockSize) + ")";
+
+        printBenchmarkResult ("Delay serial" + label, measureNanosecondsPerSample (numSamples, numRuns, [&]
+        {
+            serial.processBlocks (blockSize, [&] (const auto& context) { serial.delay.process (context); });
+        }));
+
+        printBenchmarkResult ("Delay channels on the pool" + label, measureNanosecondsPerSample (numSamples, numRuns, [&]
+        {
+            parallel.processBlocks (blockSize, [&] (const auto& context)
+            {
+                pool.run (numChannels, [&] (size_t channel) { parallel.delay.process (context, channel); });
+            });
+        }));
+    }
+}
@@ -0,0 +1,224 @@
+/*
+    Partitioned convolution with an impulse response, for cabinet simulation and convolution reverb.
+*/
+
+#include "Convolver.h"
+
+Convolver::Convolver()
+{
+    for (auto& convolution : convolutions)
+        convolution = std::make_unique<juce::dsp::Convolution> (juce::dsp::Convolution::NonUniform { headSize }, messageQueue);
+}
+
+//==============================================================================
+juce::Result Convolver::loadImpulseResponse (const juce::File& file)
+{
+    juce::AudioFormatManager formatManager;
+    formatManager.registerBasicFormats();
+
+    std::unique_ptr<juce::AudioFormatReader> reader (formatManager.createReaderFor (file));
+
+    if (reader == nullptr)
+        return juce::Result::fail ("Cannot read the impulse response " + file.getFullPathName());
+
+    auto maxLength = (juce::int64) (reader->sampleRate * maxImpulseResponseSeconds);
+    auto length = (int) juce::jmin (reader->lengthInSamples, maxLength);
+
+    if (length == 0)
+        return juce::Result::fail ("The impulse response " + file.getFullPathName() + " is empty");
+
+    juce::AudioBuffer<float> impulseResponse ((int) juce::jlimit (1u, (unsigned int) maxNumChannels, reader->numChannels), length);
+    reader->read (&impulseResponse, 0, length, 0, true, true);
+
+    loadImpulseResponse (std::move (impulseResponse), reader->sampleRate);
+    return juce::Result::ok();
+}
+
+// From the first to the last sample above -80 dB on any channel, the same threshold as the engine's own trim
+static juce::Range<int> findAudibleRange (const juce::AudioBuffer<float>& buffer)
+{
+    auto threshold = juce::Decibels::decibelsToGain (-80.0f);
+    auto start = buffer.getNumSamples(), end = 0;
+
+    for (int ch = 0; ch < buffer.getNumChannels(); ++ch)
+    {
+        auto* data = buffer.getReadPointer (ch);
+
+        for (int i = 0; i < start; ++i)
+            if (std::abs (data[i]) > threshold)
+                start = i;
+
+        for (int i = buffer.getNumSamples(); i > end; --i)
+            if (std::abs (data[i - 1]) > threshold)
+                end = i;
+    }
+
+    // A silent response is left as it is
+    return start < end ? juce::Range<int> (start, end) : juce::Range<int> (0, buffer.getNumSamples());
+}
+
+// The engine's own normalisation, 0.125 over the root of the loudest channel's energy, as one gain for all channels
+static float getNormalisationGain (const juce::AudioBuffer<float>& buffer, juce::Range<int> range)
+{
+    auto maxEnergy = 0.0f;
+
+    for (int ch = 0; ch < buffer.getNumChannels(); ++ch)
+    {
+        auto* data = buffer.getReadPointer (ch);
+        auto energy = 0.0f;
+
+        for (auto i = range.getStart(); i < range.getEnd(); ++i)
+            energy += data[i] * data[i];
+
+        maxEnergy = juce::jmax (maxEnergy, energy);
+    }
+
+    return maxEnergy > 0.0f ? 0.125f / std::sqrt (maxEnergy) : 1.0f;
+}
+
+void Convolver::loadImpulseResponse (juce::AudioBuffer<float>&& impulseResponse, double sampleRate)
+{
+    jassert (impulseResponse.getNumChannels() > 0);
+
+    // Trimmed and normalised as a whole here rather than by each engine on its own, which
+    // would lose the balance and the time offset between the two sides of a room
+    auto range = findAudibleRange (impulseResponse);
+    auto gain = getNormalisationGain (impulseResponse, range);
+
+    loadedSize = range.getLength();
+    loadedSampleRate = sampleRate;
+
+    for (size_t ch = 0; ch < maxNumChannels; ++ch)
+    {
+        auto source = juce::jmin ((int) ch, impulseResponse.getNumChannels() - 1);
+
+        // Every engine gets a mono response of its own
+        juce::AudioBuffer<float> channel (1, range.getLength());
+        channel.copyFrom (0, 0, impulseResponse, source, range.getStart(), range.getLength());
+        channel.applyGain (gain);
+
+        convolutions[ch]->loadImpulseResponse (std::move (channel), sampleRate, juce::dsp::Convolution::Stereo::no,
+                                               juce::dsp::Convolution::Trim::no, juce::dsp::Convolution::Normalise::no);
+    }
+}
+
+int Convolver::getImpulseResponseSize() const noexcept
+{
+    return convolutions[0]->getCurrentIRSize();
+}
+
+bool Convolver::waitForImpulseResponse (int timeoutMs)
+{
+    jassert (currentSampleRate > 0.0);
+
+    if (loadedSize == 0)
+        return true;
+
+    // JUCE rounds the length of a resampled response, so a sample either way counts as the same one
+    auto expectedSize = juce::roundToInt (loadedSize * currentSampleRate / loadedSampleRate);
+
+    auto isInstalled = [this, expectedSize]
+    {
+        for (auto& convolution : convolutions)
+            if (std::abs (convolution->getCurrentIRSize() - expectedSize) > 1)
+                return false;
+
+        return true;
+    };
+
+    juce::AudioBuffer<float> silence (1, maxBlockSize);
+    auto deadline = juce::Time::getMillisecondCounter() + (juce::uint32) timeoutMs;
+
+    // An engine only picks up a response the background thread has finished when it processes
+    while (! isInstalled())
+    {
+        if (juce::Time::getMillisecondCounter() > deadline)
+            return false;
+
+        for (auto& convolution : convolutions)
+        {
+            silence.clear();
+            juce::dsp::AudioBlock<float> block (silence);
+            convolution->process (juce::dsp::ProcessContextReplacing<float> (block));
+        }
+
+        juce::Thread::sleep (1);
+    }
+
+    // Drops the crossfade from the old response along with whatever the silence left behind
+    reset();
+    return true;
+}
+
+//==============================================================================
+void Convolver::prepare (const juce::dsp::ProcessSpec& spec)
+{
+    jassert (spec.numChannels <= maxNumChannels);
+    currentSampleRate = spec.sampleRate;
+    maxBlockSize = (int) spec.maximumBlockSize;
+
+    for (auto& convolution : convolutions)
+        convolution->prepare ({ spec.sampleRate, spec.maximumBlockSize, 1 });
+
+    dryBuffer.setSize ((int) maxNumChannels, (int) spec.maximumBlockSize);
+
+    for (size_t ch = 0; ch < maxNumChannels; ++ch)
+    {
+        wetLevels[ch].reset (spec.sampleRate, levelSmoothingTime);
+        wetLevels[ch].setCurrentAndTargetValue (wetLevel);
+        dryLevels[ch].reset (spec.sampleRate, levelSmoothingTime);
+        dryLevels[ch].setCurrentAndTargetValue (dryLevel);
+    }
+}
+
+void Convolver::reset() noexcept
+{
+    for (auto& convolution : convolutions)
+        convolution->reset();
+}
+
+void Convolver::setLevelSmoothingTime (double newValueInSeconds) noexcept
+{
+    jassert (newValueInSeconds >= 0.0);
+    levelSmoothingTime = newValueInSeconds;
+}
+
+void Convolver::setWetLevel (float newValue) noexcept
+{
+    jassert (newValue >= 0.0f && newValue <= 1.0f);
+    wetLevel = newValue;
+
+    for (auto& smoothedWetLevel : wetLevels)
+        smoothedWetLevel.setTargetValue (newValue);
+}
+
+void Convolver::setDryLevel (float newValue) noexcept
+{
+    jassert (newValue >= 0.0f && newValue <= 1.0f);
+    dryLevel = newValue;
+
+    for (auto& smoothedDryLevel : dryLevels)
+        smoothedDryLevel.setTargetValue (newValue);
+}
+
+//==============================================================================
+void Convolver::process (const juce::dsp::ProcessContextReplacing<float>& context) noexcept
+{
+    for (size_t ch = 0; ch < context.getOutputBlock().getNumChannels(); ++ch)
+        process (context, ch);
+}
+
+void Convolver::process (const juce::dsp::ProcessContextReplacing<float>& context, size_t channel) noexcept
+{
+    auto block = context.getOutputBlock().getSingleChannelBlock (channel);
+    auto dry = juce::dsp::AudioBlock<float> (dryBuffer).getSingleChannelBlock (channel).getSubBlock (0, block.getNumSamples());
+
+    jassert (block.getNumSamples() <= (size_t) dryBuffer.getNumSamples());
+
+    dry.copyFrom (block);
+    convolutions[channel]->process (juce::dsp::ProcessContextReplacing<float> (block));
+
+    block.multiplyBy (wetLevels[channel]);
+    dry.multiplyBy (dryLevels[channel]);
+    block.add (dry);
+}
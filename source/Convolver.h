@@ -0,0 +1,84 @@
+/*
+    Partitioned convolution with an impulse response, for cabinet simulation and convolution reverb.
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+/** Convolves each channel with its own channel of an impulse response. The first headSize samples
+    of the response run in partitions of the block size, so there is no latency, the rest in larger
+    partitions that cost far less per sample. Every channel has its own engine, so the channels can
+    run on different threads at once like the Delay's.
+
+    Impulse responses are read, resampled to the current rate and transformed on a background
+    thread. The audio thread picks up the new one at the start of a block and carries on with the
+    old one until then.
+*/
+class Convolver
+{
+public:
+    static constexpr size_t maxNumChannels = 2;
+
+    // Samples of the response convolved at the block size, longer heads mean smaller tail spikes but more work per block
+    static constexpr int headSize = 512;
+
+    // Anything longer is cut off, which keeps a mistaken file from eating the Pi's memory
+    static constexpr double maxImpulseResponseSeconds = 10.0;
+
+    Convolver();
+
+    //==============================================================================
+    /** Reads a wav, aiff or flac file on the calling thread and hands it over for resampling. A mono
+        response is used for every channel, a stereo one left to left and right to right.
+    */
+    juce::Result loadImpulseResponse (const juce::File& file);
+
+    /** Takes over the buffer, sampleRate being the rate it was recorded at */
+    void loadImpulseResponse (juce::AudioBuffer<float>&& impulseResponse, double sampleRate);
+
+    /** The length of the response in use on the audio thread, after resampling. Until the first one
+        is installed that is JUCE's one sample unit impulse.
+    */
+    int getImpulseResponseSize() const noexcept;
+
+    /** Blocks until every engine uses the response loaded last, for offline rendering that must not
+        start out on the previous one. Call it after prepare(), from the thread that loaded the response
+        and never while another thread processes. The engines are reset afterwards, so the next block
+        starts from silence. Returns false if the response was not installed within timeoutMs.
+    */
+    bool waitForImpulseResponse (int timeoutMs);
+
+    //==============================================================================
+    void prepare (const juce::dsp::ProcessSpec& spec);
+    void reset() noexcept;
+
+    /** How long level changes take to ramp, applied on the next prepare() */
+    void setLevelSmoothingTime (double newValueInSeconds) noexcept;
+
+    void setWetLevel (float newValue) noexcept;
+    void setDryLevel (float newValue) noexcept;
+
+    //==============================================================================
+    void process (const juce::dsp::ProcessContextReplacing<float>& context) noexcept;
+
+    /** Processes one channel. The channels share no state, so they may run on different threads at once. */
+    void process (const juce::dsp::ProcessContextReplacing<float>& context, size_t channel) noexcept;
+
+private:
+    // Loads and resamples the responses for every channel's engine
+    juce::dsp::ConvolutionMessageQueue messageQueue;
+    std::array<std::unique_ptr<juce::dsp::Convolution>, maxNumChannels> convolutions;
+
+    juce::AudioBuffer<float> dryBuffer;
+    double currentSampleRate = 0.0;
+    int maxBlockSize = 0;
+
+    // The response loaded last, before resampling
+    int loadedSize = 0;
+    double loadedSampleRate = 0.0;
+
+    double levelSmoothingTime = 0.01;
+    float wetLevel = 1.0f, dryLevel = 0.0f;
+    std::array<juce::SmoothedValue<float>, maxNumChannels> wetLevels, dryLevels;
+};
@@ -2,6 +2,7 @@
 
 #pragma once
 #include <JuceHeader.h>
+#include "Saturator.h"
 
 template <typename Type>
 class DelayLine
@@ -55,6 +56,205 @@ private:
     size_t leastRecentIndex = 0;
 };
 
+//==============================================================================
+/** Up to two contiguous runs of samples, the second one is only used when the
+    range wraps around the end of the delay line's buffer.
+*/
+template <typename Type>
+struct DelayLineSpans
+{
+    Type* data[2] { nullptr, nullptr };
+    size_t size[2] { 0, 0 };
+
+    void copyTo (typename std::remove_const<Type>::type* destination) const noexcept
+    {
+        std::copy (data[0], data[0] + size[0], destination);
+        std::copy (data[1], data[1] + size[1], destination + size[0]);
+    }
+};
+
+//==============================================================================
+/** Same interface and indexing as DelayLine, but the buffer is rounded up to a
+    power of two so wrapping around is a mask instead of a modulo, and it is
+    written forwards so whole blocks can be read and written as contiguous spans.
+
+    The buffer is written all the way round whatever the length, so the length is
+    only a window onto it and can change at any time without losing anything.
+*/
+template <typename Type>
+class MaskedDelayLine
+{
+public:
+    MaskedDelayLine() = default;
+
+    // A copy would point into the original's buffer, moving keeps the buffer where it is
+    MaskedDelayLine (MaskedDelayLine&&) = default;
+    MaskedDelayLine& operator= (MaskedDelayLine&&) = default;
+
+    void clear() noexcept
+    {
+        std::fill (rawData, rawData + capacity, Type (0));
+    }
+
+    /** The longest delay the owner means to read. get() accepts anything below the capacity,
+        so a delay can still glide down to a length that was just shortened.
+    */
+    size_t size() const noexcept
+    {
+        return length;
+    }
+
+    size_t getCapacity() const noexcept
+    {
+        return capacity;
+    }
+
+    /** The buffer size a line of this length needs */
+    static size_t getCapacityFor (size_t length) noexcept
+    {
+        return (size_t) juce::nextPowerOfTwo ((int) juce::jmax (length, (size_t) 2));
+    }
+
+    /** Allocates a cleared buffer of its own */
+    void resize (size_t newValue)
+    {
+        storage.assign (getCapacityFor (newValue), Type (0));
+        attach (storage.data(), storage.size());
+        setLength (newValue);
+    }
+
+    /** Uses memory owned by something else, such as a DelayLineArena, which has to outlive
+        the line. The capacity must be a power of two, and the length starts out at 0.
+    */
+    void attach (Type* memory, size_t newCapacity) noexcept
+    {
+        jassert (juce::isPowerOfTwo (newCapacity));
+        rawData = memory;
+        capacity = newCapacity;
+        mask = capacity - 1;
+        length = 0;
+        writeIndex = 0;
+    }
+
+    /** Moves the far end of the line. Nothing is allocated or cleared, so this is safe on the audio thread. */
+    void setLength (size_t newValue) noexcept
+    {
+        jassert (newValue <= capacity);
+        length = juce::jmin (newValue, capacity);
+    }
+
+    Type back() const noexcept
+    {
+        return rawData[(writeIndex - length) & mask];
+    }
+
+    Type get (size_t delayInSamples) const noexcept
+    {
+        jassert (delayInSamples < capacity);
+
+        return rawData[(writeIndex - 1 - delayInSamples) & mask];
+    }
+
+    /** Set the specified sample in the delay line */
+    void set (size_t delayInSamples, Type newValue) noexcept
+    {
+        jassert (delayInSamples < capacity);
+
+        rawData[(writeIndex - 1 - delayInSamples) & mask] = newValue;
+    }
+
+    /** Adds a new value to the delay line, overwriting the least recently added sample */
+    void push (Type valueToAdd) noexcept
+    {
+        rawData[writeIndex] = valueToAdd;
+        writeIndex = (writeIndex + 1) & mask;
+    }
+
+    /** Returns what get (delayInSamples) would return before each of the next numSamples
+        pushes. Those samples must all be written already, so delayInSamples + 1 >= numSamples.
+    */
+    DelayLineSpans<const Type> readBlock (size_t delayInSamples, size_t numSamples) const noexcept
+    {
+        jassert (delayInSamples < capacity && delayInSamples + 1 >= numSamples);
+
+        auto start = (writeIndex - 1 - delayInSamples) & mask;
+        auto firstSize = juce::jmin (numSamples, capacity - start);
+
+        DelayLineSpans<const Type> spans;
+        spans.data[0] = rawData + start;
+        spans.size[0] = firstSize;
+        spans.data[1] = rawData;
+        spans.size[1] = numSamples - firstSize;
+        return spans;
+    }
+
+    /** Pushes a whole block, the same as calling push() for every sample */
+    void writeBlock (const Type* source, size_t numSamples) noexcept
+    {
+        jassert (numSamples <= capacity);
+
+        auto firstSize = juce::jmin (numSamples, capacity - writeIndex);
+        std::copy (source, source + firstSize, rawData + writeIndex);
+        std::copy (source + firstSize, source + numSamples, rawData);
+        writeIndex = (writeIndex + numSamples) & mask;
+    }
+
+private:
+    std::vector<Type> storage;
+    Type* rawData = nullptr;
+    size_t capacity = 0;
+    size_t length = 0;
+    size_t mask = 0;
+    size_t writeIndex = 0;
+};
+
+//==============================================================================
+/** One allocation split into equal power of two buffers for several delay lines, so a
+    processor allocates all of its lines at once in prepare() and they sit side by side.
+*/
+template <typename Type>
+class DelayLineArena
+{
+public:
+    /** Makes room for numLines lines of up to maxLength samples and clears it. Only allocates
+        if the arena has to grow.
+    */
+    void allocate (size_t numLines, size_t maxLength)
+    {
+        lineCapacity = MaskedDelayLine<Type>::getCapacityFor (maxLength);
+        numAllocatedLines = numLines;
+
+        if (memory.size() < numLines * lineCapacity)
+            memory.assign (numLines * lineCapacity, Type (0));
+        else
+            std::fill (memory.begin(), memory.end(), Type (0));
+    }
+
+    /** Points the line at buffer number index, which it keeps until the next allocate() */
+    void attach (size_t index, MaskedDelayLine<Type>& line) noexcept
+    {
+        jassert (index < numAllocatedLines);
+        line.attach (memory.data() + index * lineCapacity, lineCapacity);
+    }
+
+private:
+    std::vector<Type> memory;
+    size_t lineCapacity = 0;
+    size_t numAllocatedLines = 0;
+};
+
+//==============================================================================
+/** How Delay reads between samples. none rounds the delay time to whole samples,
+    the others allow fractional delay times that can be swept without zipper noise.
+*/
+enum class DelayInterpolation
+{
+    none,
+    linear,
+    lagrange3,
+    thiran
+};
+
 //==============================================================================
 template <typename Type, size_t maxNumChannels = 2>
 class Delay
@@ -75,9 +275,38 @@ public:
     {
         jassert (spec.numChannels <= maxNumChannels);
         sampleRate = (Type) spec.sampleRate;
-        updateDelayLineSize();
+
+        // Room for the longest max delay time at this rate, so changing it later never allocates
+        arena.allocate (maxNumChannels, (size_t) std::ceil (delayTimeLimit * sampleRate));
+
+        for (size_t ch = 0; ch < maxNumChannels; ++ch)
+            arena.attach (ch, delayLines[ch]);
+
+        updateDelayLineLength();
+
+        for (auto& block : delayedBlocks)
+            block.resize (spec.maximumBlockSize);
+
+        for (auto& block : lineInputBlocks)
+            block.resize (spec.maximumBlockSize);
+
+        // Start at the requested times rather than ramping up to them
+        for (auto& smoothedDelay : delayTimesSample)
+            smoothedDelay.reset (spec.sampleRate, smoothingTime);
+
         updateDelayTime();
 
+        for (auto& smoothedDelay : delayTimesSample)
+            smoothedDelay.setCurrentAndTargetValue (smoothedDelay.getTargetValue());
+
+        for (size_t ch = 0; ch < maxNumChannels; ++ch)
+        {
+            feedbacks[ch].reset (spec.sampleRate, levelSmoothingTime);
+            feedbacks[ch].setCurrentAndTargetValue (feedback);
+            wetLevels[ch].reset (spec.sampleRate, levelSmoothingTime);
+            wetLevels[ch].setCurrentAndTargetValue (wetLevel);
+        }
+
         //filterCoefs = juce::dsp::IIR::Coefficients<Type>::makeFirstOrderLowPass (sampleRate, Type (1e3));
         filterCoefs = juce::dsp::IIR::Coefficients<Type>::makeFirstOrderHighPass (sampleRate, Type (1e3));
 
@@ -96,6 +325,8 @@ public:
 
         for (auto& dline : delayLines)
             dline.clear();  // [6]
+
+        thiranStates.fill (Type (0));
     }
 
     //==============================================================================
@@ -105,11 +336,60 @@ public:
     }
 
     //==============================================================================
-    void setMaxDelayTime (Type newValue)
+    /** The longest the max delay time can go, the lines get room for it in the next prepare() */
+    void setDelayTimeLimit (Type newValue) noexcept
     {
         jassert (newValue > Type (0));
-        maxDelayTime = newValue;
-        updateDelayLineSize(); // [1]
+        delayTimeLimit = newValue;
+    }
+
+    Type getDelayTimeLimit() const noexcept     { return delayTimeLimit; }
+
+    //==============================================================================
+    /** How far back the lines reach, up to the delay time limit. Only moves the end of each line,
+        so it is safe on the audio thread and nothing already in the lines is lost: delay times
+        longer than the new max glide down to it.
+    */
+    void setMaxDelayTime (Type newValue) noexcept
+    {
+        jassert (newValue > Type (0));
+        maxDelayTime = juce::jmin (newValue, delayTimeLimit);
+        updateDelayLineLength(); // [1]
+        updateDelayTime();
+    }
+
+    //==============================================================================
+    void setInterpolation (DelayInterpolation newValue) noexcept
+    {
+        if (newValue == interpolation)
+            return;
+
+        interpolation = newValue;
+        thiranStates.fill (Type (0));
+        updateDelayTime();
+    }
+
+    //==============================================================================
+    /** The curve that keeps the feedback path from running away */
+    void setSaturation (SaturationType newValue) noexcept
+    {
+        saturator.setType (newValue);
+    }
+
+    //==============================================================================
+    /** How long a change of delay time takes to glide to the new value, applied on the next prepare() */
+    void setSmoothingTime (double newValueInSeconds) noexcept
+    {
+        jassert (newValueInSeconds >= 0.0);
+        smoothingTime = newValueInSeconds;
+    }
+
+    //==============================================================================
+    /** How long feedback and wet level changes take to ramp, applied on the next prepare() */
+    void setLevelSmoothingTime (double newValueInSeconds) noexcept
+    {
+        jassert (newValueInSeconds >= 0.0);
+        levelSmoothingTime = newValueInSeconds;
     }
 
     //==============================================================================
@@ -117,6 +397,9 @@ public:
     {
         jassert (newValue >= Type (0) && newValue <= Type (1));
         feedback = newValue;
+
+        for (auto& smoothedFeedback : feedbacks)
+            smoothedFeedback.setTargetValue (newValue);
     }
 
     //==============================================================================
@@ -124,6 +407,9 @@ public:
     {
         jassert (newValue >= Type (0) && newValue <= Type (1));
         wetLevel = newValue;
+
+        for (auto& smoothedWetLevel : wetLevels)
+            smoothedWetLevel.setTargetValue (newValue);
     }
 
     //==============================================================================
@@ -144,63 +430,188 @@ public:
     //==============================================================================
     template <typename ProcessContext>
     void process (const ProcessContext& context) noexcept
+    {
+        for (size_t ch = 0; ch < context.getOutputBlock().getNumChannels(); ++ch)
+            process (context, ch);
+    }
+
+    /** Processes one channel. The channels share no state, so they may run on different threads at once. */
+    template <typename ProcessContext>
+    void process (const ProcessContext& context, size_t ch) noexcept
     {
         auto& inputBlock  = context.getInputBlock();
         auto& outputBlock = context.getOutputBlock();
         auto numSamples  = outputBlock.getNumSamples();
-        auto numChannels = outputBlock.getNumChannels();
 
         jassert (inputBlock.getNumSamples() == numSamples);
-        jassert (inputBlock.getNumChannels() == numChannels);
-
-        for (size_t ch = 0; ch < numChannels; ++ch)
+        jassert (inputBlock.getNumChannels() == outputBlock.getNumChannels());
+
+        auto* input  = inputBlock .getChannelPointer (ch);
+        auto* output = outputBlock.getChannelPointer (ch);
+        auto& dline = delayLines[ch];
+        auto& smoothedDelay = delayTimesSample[ch];
+        auto& filter = filters[ch];
+        auto& smoothedFeedback = feedbacks[ch];
+        auto& smoothedWetLevel = wetLevels[ch];
+
+        // A steady delay that is at least a block long can be processed a block at a time
+        if (! smoothedDelay.isSmoothing() && ! smoothedFeedback.isSmoothing() && ! smoothedWetLevel.isSmoothing()
+            && (interpolation == DelayInterpolation::none || interpolation == DelayInterpolation::linear))
         {
-            auto* input  = inputBlock .getChannelPointer (ch);
-            auto* output = outputBlock.getChannelPointer (ch);
-            auto& dline = delayLines[ch];
-            auto delayTime = delayTimesSample[ch];
-            auto& filter = filters[ch];
+            auto delayTime = smoothedDelay.getTargetValue();
+            auto wholeSamples = interpolation == DelayInterpolation::none ? (size_t) juce::roundToInt (delayTime)
+                                                                           : (size_t) delayTime;
+            auto fraction = interpolation == DelayInterpolation::none ? Type (0) : delayTime - (Type) wholeSamples;
 
-            for (size_t i = 0; i < numSamples; ++i)
+            if (wholeSamples + 1 >= numSamples && numSamples <= delayedBlocks[ch].size())
             {
-                //auto delayedSample = dline.get (delayTime);
-                auto delayedSample = filter.processSample (dline.get (delayTime));
-                auto inputSample = input[i];
-                auto dlineInputSample = std::tanh (inputSample + feedback * delayedSample);
-                dline.push (dlineInputSample);
-                auto outputSample = inputSample + wetLevel * delayedSample;
-                output[i] = outputSample;
+                processBlock (ch, input, output, numSamples, wholeSamples, fraction);
+                return;
             }
         }
+
+        for (size_t i = 0; i < numSamples; ++i)
+        {
+            //auto delayedSample = dline.get (delayTime);
+            auto delayedSample = filter.processSample (readDelayed (ch, smoothedDelay.getNextValue()));
+            auto inputSample = input[i];
+            auto dlineInputSample = saturator.processSample (inputSample + smoothedFeedback.getNextValue() * delayedSample);
+            dline.push (dlineInputSample);
+            auto outputSample = inputSample + smoothedWetLevel.getNextValue() * delayedSample;
+            output[i] = outputSample;
+        }
     }
 
 private:
     //==============================================================================
-    std::array<DelayLine<Type>, maxNumChannels> delayLines;
-    std::array<size_t, maxNumChannels> delayTimesSample;
-    std::array<Type, maxNumChannels> delayTimes;
+    DelayLineArena<Type> arena;
+    std::array<MaskedDelayLine<Type>, maxNumChannels> delayLines;
+    std::array<std::vector<Type>, maxNumChannels> delayedBlocks, lineInputBlocks;
+    std::array<juce::SmoothedValue<Type>, maxNumChannels> delayTimesSample;
+    std::array<Type, maxNumChannels> delayTimes {};
+    std::array<Type, maxNumChannels> thiranStates {};
+    DelayInterpolation interpolation = DelayInterpolation::linear;
+    double smoothingTime = 0.05;
+    double levelSmoothingTime = 0.01;
     Type feedback { Type (0) };
     Type wetLevel { Type (0) };
+    std::array<juce::SmoothedValue<Type>, maxNumChannels> feedbacks, wetLevels;
 
     std::array<juce::dsp::IIR::Filter<Type>, maxNumChannels> filters;
+    Saturator<Type> saturator;
     typename juce::dsp::IIR::Coefficients<Type>::Ptr filterCoefs;
 
     Type sampleRate   { Type (44.1e3) };
     Type maxDelayTime { Type (2) };
+    Type delayTimeLimit { Type (2) };
 
     //==============================================================================
-    void updateDelayLineSize()
+    void updateDelayLineLength() noexcept
     {
         auto delayLineSizeSamples = (size_t) std::ceil (maxDelayTime * sampleRate);
 
         for (auto& dline : delayLines)
-            dline.resize (delayLineSizeSamples);    // [2]
+            dline.setLength (juce::jmin (delayLineSizeSamples, dline.getCapacity()));    // [2]
     }
 
     //==============================================================================
     void updateDelayTime() noexcept
     {
+        // Lagrange reads one sample either side of the delay, Thiran needs a fraction of at least a half.
+        // Never read further back than the line holds, the max time may be shorter than the delay time.
+        auto minDelay = interpolation == DelayInterpolation::lagrange3 ? Type (1)
+                      : interpolation == DelayInterpolation::thiran    ? Type (0.5)
+                                                                       : Type (0);
+
         for (size_t ch = 0; ch < maxNumChannels; ++ch)
-            delayTimesSample[ch] = (size_t) juce::roundToInt (delayTimes[ch] * sampleRate);
+        {
+            auto maxDelay = juce::jmax (minDelay, (Type) delayLines[ch].size() - Type (3));
+            delayTimesSample[ch].setTargetValue (juce::jlimit (minDelay, maxDelay, delayTimes[ch] * sampleRate));
+        }
+    }
+
+    //==============================================================================
+    Type readDelayed (size_t channel, Type delayTime) noexcept
+    {
+        auto& dline = delayLines[channel];
+
+        switch (interpolation)
+        {
+            case DelayInterpolation::linear:
+            {
+                auto wholeSamples = (size_t) delayTime;
+                auto fraction = delayTime - (Type) wholeSamples;
+                auto a = dline.get (wholeSamples);
+                return a + fraction * (dline.get (wholeSamples + 1) - a);
+            }
+
+            case DelayInterpolation::lagrange3:
+            {
+                auto wholeSamples = (size_t) delayTime;
+                auto d = delayTime - (Type) wholeSamples;
+
+                auto x0 = dline.get (wholeSamples - 1);
+                auto x1 = dline.get (wholeSamples);
+                auto x2 = dline.get (wholeSamples + 1);
+                auto x3 = dline.get (wholeSamples + 2);
+
+                auto dPlus1 = d + Type (1), dMinus1 = d - Type (1), dMinus2 = d - Type (2);
+
+                return - x0 * d * dMinus1 * dMinus2 / Type (6)
+                       + x1 * dPlus1 * dMinus1 * dMinus2 / Type (2)
+                       - x2 * dPlus1 * d * dMinus2 / Type (2)
+                       + x3 * dPlus1 * d * dMinus1 / Type (6);
+            }
+
+            case DelayInterpolation::thiran:
+            {
+                // First order allpass, most accurate with the fraction between 0.5 and 1.5
+                auto wholeSamples = (size_t) (delayTime - Type (0.5));
+                auto d = delayTime - (Type) wholeSamples;
+                auto eta = (Type (1) - d) / (Type (1) + d);
+
+                auto& state = thiranStates[channel];
+                state = eta * (dline.get (wholeSamples) - state) + dline.get (wholeSamples + 1);
+                return state;
+            }
+
+            case DelayInterpolation::none:
+            default:
+                return dline.get ((size_t) juce::roundToInt (delayTime));
+        }
+    }
+
+    //==============================================================================
+    void processBlock (size_t channel, const Type* input, Type* output, size_t numSamples,
+                       size_t wholeSamples, Type fraction) noexcept
+    {
+        auto& dline = delayLines[channel];
+        auto& filter = filters[channel];
+        auto* delayed = delayedBlocks[channel].data();
+        auto* lineInput = lineInputBlocks[channel].data();
+
+        dline.readBlock (wholeSamples, numSamples).copyTo (delayed);
+
+        if (fraction > Type (0))
+        {
+            dline.readBlock (wholeSamples + 1, numSamples).copyTo (lineInput);
+            juce::FloatVectorOperations::multiply (delayed, Type (1) - fraction, (int) numSamples);
+            juce::FloatVectorOperations::addWithMultiply (delayed, lineInput, fraction, (int) numSamples);
+        }
+
+        for (size_t i = 0; i < numSamples; ++i)
+            delayed[i] = filter.processSample (delayed[i]);
+
+        juce::FloatVectorOperations::copy (lineInput, input, (int) numSamples);
+        juce::FloatVectorOperations::addWithMultiply (lineInput, delayed, feedback, (int) numSamples);
+
+        saturator.process (lineInput, numSamples);
+
+        dline.writeBlock (lineInput, numSamples);
+
+        if (output != input)
+            juce::FloatVectorOperations::copy (output, input, (int) numSamples);
+
+        juce::FloatVectorOperations::addWithMultiply (output, delayed, wetLevel, (int) numSamples);
     }
 };
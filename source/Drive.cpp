@@ -0,0 +1,268 @@
+/*
+    Oversampled overdrive with tone shaping before and after the waveshaper.
+*/
+
+#include "Drive.h"
+
+// The automatic mode steps the oversampling down above the first load and up below the second
+static constexpr float maxLoadForOversampling = 0.7f;
+static constexpr float minLoadForMoreOversampling = 0.35f;
+static constexpr double autoSwitchHoldTime = 1.0;
+
+// How long the old and the new oversampler overlap when the factor changes
+static constexpr double oversamplingCrossfadeTime = 0.02;
+
+// Where the asymmetric curve sits on the soft one
+static constexpr float asymmetricBias = 0.3f;
+
+Drive::Drive()
+{
+    saturator.setType (SaturationType::pade);
+    asymmetricOffset = saturator.processSample (asymmetricBias);
+
+    tightCoefficients = new juce::dsp::IIR::Coefficients<float> (juce::dsp::IIR::ArrayCoefficients<float>::makeHighPass (sampleRate, tightFrequency));
+    toneCoefficients = new juce::dsp::IIR::Coefficients<float> (juce::dsp::IIR::ArrayCoefficients<float>::makeLowPass (sampleRate, toneFrequency));
+    dcCoefficients = juce::dsp::IIR::Coefficients<float>::makeFirstOrderHighPass (sampleRate, 10.0f);
+
+    for (size_t ch = 0; ch < maxNumChannels; ++ch)
+    {
+        tightFilters[ch].coefficients = tightCoefficients;
+        toneFilters[ch].coefficients = toneCoefficients;
+        dcFilters[ch].coefficients = dcCoefficients;
+    }
+}
+
+//==============================================================================
+void Drive::prepare (const juce::dsp::ProcessSpec& spec)
+{
+    jassert (spec.numChannels <= maxNumChannels);
+    sampleRate = spec.sampleRate;
+
+    // The polyphase IIR half-band filters have the least latency of the oversampling filters
+    for (size_t i = 0; i < oversamplers.size(); ++i)
+    {
+        oversamplers[i] = std::make_unique<juce::dsp::Oversampling<float>> (spec.numChannels, i + 1,
+                                                                            juce::dsp::Oversampling<float>::filterHalfBandPolyphaseIIR, true);
+        oversamplers[i]->initProcessing (spec.maximumBlockSize);
+    }
+
+    *dcCoefficients = juce::dsp::IIR::ArrayCoefficients<float>::makeFirstOrderHighPass (sampleRate, 10.0f);
+    updateFilters();
+
+    for (size_t ch = 0; ch < maxNumChannels; ++ch)
+    {
+        tightFilters[ch].prepare ({ spec.sampleRate, spec.maximumBlockSize, 1 });
+        toneFilters[ch].prepare ({ spec.sampleRate, spec.maximumBlockSize, 1 });
+        dcFilters[ch].prepare ({ spec.sampleRate, spec.maximumBlockSize, 1 });
+    }
+
+    smoothedDrive.reset (spec.sampleRate, levelSmoothingTime);
+    smoothedDrive.setCurrentAndTargetValue (drive);
+    smoothedLevel.reset (spec.sampleRate, levelSmoothingTime);
+    smoothedLevel.setCurrentAndTargetValue (level);
+
+    fadeBuffer.setSize ((int) maxNumChannels, (int) spec.maximumBlockSize);
+    fadeLength = juce::jmax (1, (int) (sampleRate * oversamplingCrossfadeTime));
+
+    // The automatic mode starts in the middle and finds its way from there
+    currentOrder = targetOrder = requestedOrder > 0 ? requestedOrder : 2;
+    fadeOrder = 0;
+    samplesSinceSwitch = 0;
+}
+
+void Drive::reset() noexcept
+{
+    // Everything starts from silence anyway, so there is nothing to fade
+    currentOrder = targetOrder;
+    fadeOrder = 0;
+
+    for (auto& oversampler : oversamplers)
+        if (oversampler != nullptr)
+            oversampler->reset();
+
+    for (size_t ch = 0; ch < maxNumChannels; ++ch)
+    {
+        tightFilters[ch].reset();
+        toneFilters[ch].reset();
+        dcFilters[ch].reset();
+    }
+}
+
+void Drive::setLevelSmoothingTime (double newValueInSeconds) noexcept
+{
+    jassert (newValueInSeconds >= 0.0);
+    levelSmoothingTime = newValueInSeconds;
+}
+
+//==============================================================================
+void Drive::setDrive (float newValueInDecibels) noexcept
+{
+    drive = juce::Decibels::decibelsToGain (newValueInDecibels);
+    smoothedDrive.setTargetValue (drive);
+}
+
+void Drive::setLevel (float newValueInDecibels) noexcept
+{
+    level = juce::Decibels::decibelsToGain (newValueInDecibels);
+    smoothedLevel.setTargetValue (level);
+}
+
+void Drive::setTightFrequency (float newValueInHz) noexcept
+{
+    if (newValueInHz == tightFrequency)
+        return;
+
+    tightFrequency = newValueInHz;
+    updateFilters();
+}
+
+void Drive::setToneFrequency (float newValueInHz) noexcept
+{
+    if (newValueInHz == toneFrequency)
+        return;
+
+    toneFrequency = newValueInHz;
+    updateFilters();
+}
+
+// The array coefficients are computed on the stack and copied into the existing ones, so this does not allocate
+void Drive::updateFilters() noexcept
+{
+    auto nyquist = (float) sampleRate * 0.49f;
+
+    *tightCoefficients = juce::dsp::IIR::ArrayCoefficients<float>::makeHighPass (sampleRate, juce::jmin (tightFrequency, nyquist));
+    *toneCoefficients = juce::dsp::IIR::ArrayCoefficients<float>::makeLowPass (sampleRate, juce::jmin (toneFrequency, nyquist));
+}
+
+//==============================================================================
+void Drive::setOversamplingOrder (int newOrder) noexcept
+{
+    requestedOrder = juce::jlimit (0, maxOversamplingOrder, newOrder);
+
+    if (requestedOrder > 0)
+        selectOrder (requestedOrder);
+}
+
+void Drive::setProcessingLoad (float load) noexcept
+{
+    if (requestedOrder > 0 || samplesSinceSwitch < (int) (sampleRate * autoSwitchHoldTime))
+        return;
+
+    if (load > maxLoadForOversampling && targetOrder > 1)
+        selectOrder (targetOrder - 1);
+    else if (load < minLoadForMoreOversampling && targetOrder < maxOversamplingOrder)
+        selectOrder (targetOrder + 1);
+}
+
+// process() starts the crossfade, and a change during one waits for it to finish
+void Drive::selectOrder (int newOrder) noexcept
+{
+    if (newOrder == targetOrder)
+        return;
+
+    targetOrder = newOrder;
+    samplesSinceSwitch = 0;
+}
+
+//==============================================================================
+void Drive::shape (float* data, size_t numSamples) const noexcept
+{
+    switch (curve)
+    {
+        case DriveCurve::hard:
+            juce::FloatVectorOperations::clip (data, data, -1.0f, 1.0f, (int) numSamples);
+            break;
+
+        case DriveCurve::asymmetric:
+            juce::FloatVectorOperations::add (data, asymmetricBias, (int) numSamples);
+            saturator.process (data, numSamples);
+            juce::FloatVectorOperations::add (data, -asymmetricOffset, (int) numSamples);
+            break;
+
+        case DriveCurve::soft:
+        default:
+            saturator.process (data, numSamples);
+            break;
+    }
+}
+
+void Drive::processOversampled (juce::dsp::Oversampling<float>& oversampler, juce::dsp::AudioBlock<float>& block) noexcept
+{
+    auto oversampledBlock = oversampler.processSamplesUp (block);
+
+    for (size_t ch = 0; ch < block.getNumChannels(); ++ch)
+        shape (oversampledBlock.getChannelPointer (ch), oversampledBlock.getNumSamples());
+
+    oversampler.processSamplesDown (block);
+}
+
+void Drive::process (const juce::dsp::ProcessContextReplacing<float>& context) noexcept
+{
+    auto& block = context.getOutputBlock();
+    auto numChannels = block.getNumChannels();
+    auto numSamples = block.getNumSamples();
+
+    jassert (oversamplers[(size_t) currentOrder - 1] != nullptr);
+
+    // The oversampler faded in has not run since it was last used, so it starts from silence
+    if (fadeOrder == 0 && targetOrder != currentOrder)
+    {
+        fadeOrder = targetOrder;
+        fadePosition = 0;
+        oversamplers[(size_t) fadeOrder - 1]->reset();
+    }
+
+    for (size_t ch = 0; ch < numChannels; ++ch)
+    {
+        auto channelBlock = block.getSingleChannelBlock (ch);
+        tightFilters[ch].process (juce::dsp::ProcessContextReplacing<float> (channelBlock));
+    }
+
+    // Gain commutes with the upsampling, so the drive ramp can run at the base rate
+    block.multiplyBy (smoothedDrive);
+
+    if (fadeOrder == 0)
+    {
+        processOversampled (*oversamplers[(size_t) currentOrder - 1], block);
+    }
+    else
+    {
+        auto fadeBlock = juce::dsp::AudioBlock<float> (fadeBuffer).getSubsetChannelBlock (0, numChannels).getSubBlock (0, numSamples);
+        fadeBlock.copyFrom (block);
+
+        processOversampled (*oversamplers[(size_t) currentOrder - 1], block);
+        processOversampled (*oversamplers[(size_t) fadeOrder - 1], fadeBlock);
+
+        for (size_t ch = 0; ch < numChannels; ++ch)
+        {
+            auto* data = block.getChannelPointer (ch);
+            auto* faded = fadeBlock.getChannelPointer (ch);
+
+            for (size_t i = 0; i < numSamples; ++i)
+            {
+                auto gain = juce::jmin (1.0f, (float) (fadePosition + (int) i + 1) / (float) fadeLength);
+                data[i] += gain * (faded[i] - data[i]);
+            }
+        }
+
+        fadePosition += (int) numSamples;
+
+        if (fadePosition >= fadeLength)
+        {
+            currentOrder = fadeOrder;
+            fadeOrder = 0;
+        }
+    }
+
+    for (size_t ch = 0; ch < numChannels; ++ch)
+    {
+        auto channelBlock = block.getSingleChannelBlock (ch);
+        juce::dsp::ProcessContextReplacing<float> channelContext (channelBlock);
+        toneFilters[ch].process (channelContext);
+        dcFilters[ch].process (channelContext);
+    }
+
+    block.multiplyBy (smoothedLevel);
+
+    samplesSinceSwitch = juce::jmin (samplesSinceSwitch + (int) block.getNumSamples(), std::numeric_limits<int>::max() / 2);
+}
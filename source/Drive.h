@@ -0,0 +1,87 @@
+/*
+    Oversampled overdrive with tone shaping before and after the waveshaper.
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "Saturator.h"
+
+//==============================================================================
+enum class DriveCurve
+{
+    soft,           // Pade approximant of tanh, a smooth overdrive
+    hard,           // Clips at -1..1, fuzz-like with a high drive
+    asymmetric      // Biased soft curve, even harmonics like a single-ended tube stage
+};
+
+//==============================================================================
+/** Tight (a high-pass) > drive > waveshaper > tone (a low-pass) > level. Only the waveshaper runs
+    oversampled, everything linear runs at the base rate. All three oversamplers are built in
+    prepare(), so switching between 2x, 4x and 8x while running does not allocate. A switch runs
+    both oversamplers for a short crossfade, which hides the new one's filters filling up and the
+    change in latency; the automatic mode also only moves after the load has settled.
+*/
+class Drive
+{
+public:
+    static constexpr size_t maxNumChannels = 2;
+    static constexpr int maxOversamplingOrder = 3;      // 2^3 = 8x
+
+    Drive();
+
+    //==============================================================================
+    void prepare (const juce::dsp::ProcessSpec& spec);
+    void reset() noexcept;
+
+    /** How long drive and level changes take to ramp, applied on the next prepare() */
+    void setLevelSmoothingTime (double newValueInSeconds) noexcept;
+
+    //==============================================================================
+    void setCurve (DriveCurve newValue) noexcept            { curve = newValue; }
+    void setDrive (float newValueInDecibels) noexcept;
+    void setLevel (float newValueInDecibels) noexcept;
+    void setTightFrequency (float newValueInHz) noexcept;
+    void setToneFrequency (float newValueInHz) noexcept;
+
+    /** 1 to 3 for 2x to 8x, 0 picks the factor from the load given to setProcessingLoad() */
+    void setOversamplingOrder (int newOrder) noexcept;
+    int getCurrentOversamplingOrder() const noexcept        { return currentOrder; }
+
+    /** The share of the block's duration the callbacks take, 1 being all of it. In the automatic
+        mode the oversampling goes down a step when there is little headroom left, and back up
+        when there is plenty, at most once a second. Without any load it stays at 4x, which is
+        what an offline render gets, so its output does not depend on how fast it ran.
+    */
+    void setProcessingLoad (float load) noexcept;
+
+    //==============================================================================
+    void process (const juce::dsp::ProcessContextReplacing<float>& context) noexcept;
+
+private:
+    void shape (float* data, size_t numSamples) const noexcept;
+    void processOversampled (juce::dsp::Oversampling<float>& oversampler, juce::dsp::AudioBlock<float>& block) noexcept;
+    void selectOrder (int newOrder) noexcept;
+    void updateFilters() noexcept;
+
+    std::array<std::unique_ptr<juce::dsp::Oversampling<float>>, maxOversamplingOrder> oversamplers;
+    int requestedOrder = 0, currentOrder = 2, targetOrder = 2;
+    int samplesSinceSwitch = 0;
+
+    // While fadeOrder is not 0 its oversampler runs on a copy of the signal and fades in over currentOrder's
+    juce::AudioBuffer<float> fadeBuffer;
+    int fadeOrder = 0, fadePosition = 0, fadeLength = 1;
+
+    std::array<juce::dsp::IIR::Filter<float>, maxNumChannels> tightFilters, toneFilters, dcFilters;
+    juce::dsp::IIR::Coefficients<float>::Ptr tightCoefficients, toneCoefficients, dcCoefficients;
+    float tightFrequency = 100.0f, toneFrequency = 5000.0f;
+
+    Saturator<float> saturator;
+    float asymmetricOffset = 0.0f;
+    DriveCurve curve = DriveCurve::soft;
+
+    double sampleRate = 44100.0;
+    double levelSmoothingTime = 0.01;
+    float drive = 1.0f, level = 1.0f;
+    juce::SmoothedValue<float> smoothedDrive, smoothedLevel;
+};
@@ -0,0 +1,160 @@
+/*
+    Optional, lock-free timing of the processing stages and of the whole audio callback.
+*/
+
+#include "DspProfiler.h"
+
+DspProfiler::DspProfiler()
+    : nanosecondsPerTick (1.0e9 / (double) juce::Time::getHighResolutionTicksPerSecond())
+{
+}
+
+void DspProfiler::setStageName (size_t stage, const char* name) noexcept
+{
+    jassert (stage < maxNumStages);
+
+    if (stage < maxNumStages)
+        stageNames[stage] = name;
+}
+
+void DspProfiler::prepare (double newSampleRate) noexcept
+{
+    sampleRate.store (newSampleRate);
+}
+
+uint64_t DspProfiler::ticksToNanoseconds (int64_t ticks) const noexcept
+{
+    return ticks > 0 ? (uint64_t) ((double) ticks * nanosecondsPerTick) : 0;
+}
+
+void DspProfiler::Histogram::add (uint64_t nanoseconds) noexcept
+{
+    auto clamped = (juce::uint32) juce::jmin (nanoseconds, (uint64_t) 0xffffffff);
+    auto bucket = clamped == 0 ? (size_t) 0 : (size_t) juce::findHighestSetBit (clamped);
+
+    buckets[bucket].fetch_add (1, std::memory_order_relaxed);
+    totalNanoseconds.fetch_add (nanoseconds, std::memory_order_relaxed);
+    count.fetch_add (1, std::memory_order_relaxed);
+}
+
+void DspProfiler::addStageTime (size_t stage, int64_t ticks) noexcept
+{
+    if (stage < maxNumStages)
+        stages[stage].add (ticksToNanoseconds (ticks));
+}
+
+void DspProfiler::addCallback (int64_t ticks, int numSamples) noexcept
+{
+    auto nanoseconds = ticksToNanoseconds (ticks);
+    callbacks.add (nanoseconds);
+
+    // Load is the share of the block's duration that was spent processing it
+    auto deadline = 1.0e9 * numSamples / sampleRate.load (std::memory_order_relaxed);
+    auto load = deadline > 0.0 ? (float) (nanoseconds / deadline) : 0.0f;
+
+    loadSum.fetch_add ((uint64_t) (load * 10000.0f), std::memory_order_relaxed);
+
+    if (load > maxLoad.load (std::memory_order_relaxed))
+        maxLoad.store (load, std::memory_order_relaxed);
+
+    if (load > 1.0f)
+        overruns.fetch_add (1, std::memory_order_relaxed);
+}
+
+juce::String DspProfiler::createReport (int deviceXRuns)
+{
+    auto numCallbacks = callbacks.count.exchange (0);
+    auto averageLoad = numCallbacks > 0 ? (double) loadSum.exchange (0) / (100.0 * numCallbacks) : 0.0;
+    auto peakLoad = maxLoad.exchange (0.0f) * 100.0f;
+    auto newOverruns = overruns.exchange (0);
+    totalOverruns += newOverruns;
+
+    callbacks.totalNanoseconds.exchange (0);
+
+    for (auto& bucket : callbacks.buckets)
+        bucket.exchange (0);
+
+    juce::String report;
+    report << juce::Time::getCurrentTime().toString (true, true) << "  callbacks " << (int) numCallbacks
+           << ", DSP load avg " << juce::String (averageLoad, 1) << "% max " << juce::String (peakLoad, 1) << "%"
+           << ", overruns " << (int) newOverruns << " (" << (juce::int64) totalOverruns << " total)";
+
+    if (deviceXRuns >= 0)
+        report << ", device xruns " << deviceXRuns;
+
+    report << juce::newLine;
+
+    for (size_t stage = 0; stage < maxNumStages; ++stage)
+    {
+        if (stageNames[stage] == nullptr)
+            continue;
+
+        auto& histogram = stages[stage];
+        auto count = histogram.count.exchange (0);
+        auto total = histogram.totalNanoseconds.exchange (0);
+
+        std::array<uint32_t, numBuckets> counts;
+
+        for (size_t i = 0; i < numBuckets; ++i)
+            counts[i] = histogram.buckets[i].exchange (0);
+
+        // Percentiles are reported as the upper edge of the bucket they fall in
+        auto percentile = [&] (double fraction)
+        {
+            uint64_t seen = 0;
+
+            for (size_t i = 0; i < numBuckets; ++i)
+            {
+                seen += counts[i];
+
+                if (seen > 0 && (double) seen >= fraction * count)
+                    return (juce::int64) 1 << (i + 1);
+            }
+
+            return (juce::int64) 0;
+        };
+
+        report << "  " << juce::String (stageNames[stage]).paddedRight (' ', 12)
+               << " calls " << juce::String ((int) count).paddedLeft (' ', 8)
+               << "  mean " << juce::String (count > 0 ? (double) total / count : 0.0, 0).paddedLeft (' ', 8) << " ns"
+               << "  p50 < " << juce::String (percentile (0.5)) << " ns"
+               << "  p99 < " << juce::String (percentile (0.99)) << " ns"
+               << juce::newLine;
+    }
+
+    return report;
+}
+
+//==============================================================================
+DspProfileReporter::DspProfileReporter (DspProfiler& profiler, juce::File outputFile, int intervalMs,
+                                        std::function<int()> getDeviceXRuns)
+    : juce::Thread ("DSP profile reporter"),
+      profilerRef (profiler),
+      file (std::move (outputFile)),
+      interval (intervalMs),
+      deviceXRuns (std::move (getDeviceXRuns))
+{
+    profilerRef.setEnabled (true);
+    startThread (juce::Thread::Priority::low);
+}
+
+DspProfileReporter::~DspProfileReporter()
+{
+    stopThread (interval + 1000);
+    profilerRef.setEnabled (false);
+}
+
+void DspProfileReporter::run()
+{
+    while (! threadShouldExit())
+    {
+        wait (interval);
+
+        auto report = profilerRef.createReport (deviceXRuns != nullptr ? deviceXRuns() : -1);
+
+        if (file == juce::File())
+            std::cout << report << std::flush;
+        else
+            file.appendText (report);
+    }
+}
@@ -0,0 +1,80 @@
+/*
+    Optional, lock-free timing of the processing stages and of the whole audio callback.
+    The audio thread only ever bumps atomics, a low priority thread turns them into reports.
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+class DspProfiler
+{
+public:
+    static constexpr size_t maxNumStages = 16;
+    static constexpr size_t numBuckets = 32;    // Bucket n counts times from 2^n up to 2^(n + 1) nanoseconds
+
+    DspProfiler();
+
+    //==============================================================================
+    void setEnabled (bool shouldBeEnabled) noexcept     { enabled.store (shouldBeEnabled, std::memory_order_relaxed); }
+    bool isEnabled() const noexcept                     { return enabled.load (std::memory_order_relaxed); }
+
+    /** Names must outlive the profiler, string literals are fine */
+    void setStageName (size_t stage, const char* name) noexcept;
+    void prepare (double newSampleRate) noexcept;
+
+    //==============================================================================
+    // Audio thread
+    static int64_t getTicks() noexcept                  { return juce::Time::getHighResolutionTicks(); }
+    void addStageTime (size_t stage, int64_t ticks) noexcept;
+    void addCallback (int64_t ticks, int numSamples) noexcept;
+
+    //==============================================================================
+    /** Summarises everything measured since the previous report and starts counting afresh.
+        Pass the device's xrun count if there is one, or -1.
+    */
+    juce::String createReport (int deviceXRuns = -1);
+
+private:
+    struct Histogram
+    {
+        std::array<std::atomic<uint32_t>, numBuckets> buckets {};
+        std::atomic<uint64_t> totalNanoseconds { 0 };
+        std::atomic<uint32_t> count { 0 };
+
+        void add (uint64_t nanoseconds) noexcept;
+    };
+
+    uint64_t ticksToNanoseconds (int64_t ticks) const noexcept;
+
+    std::atomic<bool> enabled { false };
+    std::array<const char*, maxNumStages> stageNames {};
+    std::array<Histogram, maxNumStages> stages;
+    Histogram callbacks;
+
+    std::atomic<double> sampleRate { 44100.0 };
+    std::atomic<float> maxLoad { 0.0f };
+    std::atomic<uint64_t> loadSum { 0 };        // In hundredths of a percent
+    std::atomic<uint32_t> overruns { 0 };
+    uint64_t totalOverruns = 0;
+
+    const double nanosecondsPerTick;
+};
+
+//==============================================================================
+/** Periodically writes the profiler's reports to stdout, or to a file when one is given */
+class DspProfileReporter : private juce::Thread
+{
+public:
+    DspProfileReporter (DspProfiler& profiler, juce::File outputFile, int intervalMs,
+                        std::function<int()> getDeviceXRuns = {});
+    ~DspProfileReporter() override;
+
+private:
+    void run() override;
+
+    DspProfiler& profilerRef;
+    juce::File file;
+    int interval;
+    std::function<int()> deviceXRuns;
+};
@@ -0,0 +1,576 @@
+/*
+    Runtime configurable routing of the effects, replacing the fixed ProcessorChain.
+*/
+
+#include "EffectGraph.h"
+#include "AudioProcessor.h"
+#include "Convolver.h"
+#include "Drive.h"
+#include "MultiTapDelay.h"
+
+// How long gain and level changes take, long enough to avoid clicks on a preset switch
+static constexpr double levelRampTime = 0.01;
+
+EffectNode::EffectNode (EffectType effectType, const juce::String& nodeName)
+    : type (effectType), name (nodeName)
+{
+}
+
+juce::Result EffectNode::loadImpulseResponse (const juce::File&)
+{
+    return juce::Result::fail (name + " does not take an impulse response");
+}
+
+//==============================================================================
+namespace
+{
+    template <typename ProcessorType>
+    class ProcessorNode : public EffectNode
+    {
+    public:
+        using EffectNode::EffectNode;
+
+        void prepare (const juce::dsp::ProcessSpec& spec, const float*) override
+        {
+            processor.prepare (spec);
+        }
+
+        void reset() noexcept override
+        {
+            processor.reset();
+        }
+
+        void process (const juce::dsp::ProcessContextReplacing<float>& context, RealtimeThreadPool*) noexcept override
+        {
+            processor.process (context);
+        }
+
+    protected:
+        ProcessorType processor;
+    };
+
+    //==============================================================================
+    /** Opens when the analyser's envelope of the input rises above the threshold and closes 6 dB below
+        it after a short hold, so it keys off the input wherever it sits in the graph.
+    */
+    class GateNode : public EffectNode
+    {
+    public:
+        GateNode (EffectType type, const juce::String& name, const SignalAnalyser& inputAnalyser)
+            : EffectNode (type, name), analyser (inputAnalyser)
+        {
+        }
+
+        void prepare (const juce::dsp::ProcessSpec& spec, const float* values) override
+        {
+            sampleRate = spec.sampleRate;
+            attackStep = (float) (1.0 / (attackTime * sampleRate));
+            holdSamples = (int) (holdTime * sampleRate);
+            update (values);
+        }
+
+        void reset() noexcept override
+        {
+            gain = 0.0f;
+            open = false;
+            holdRemaining = 0;
+        }
+
+        void update (const float* values) noexcept override
+        {
+            threshold = juce::Decibels::decibelsToGain (values[Processor::gateThresholdParam]);
+            releaseStep = (float) (1.0 / (values[Processor::gateReleaseParam] * 0.001 * sampleRate));
+        }
+
+        void process (const juce::dsp::ProcessContextReplacing<float>& context, RealtimeThreadPool*) noexcept override
+        {
+            auto& block = context.getOutputBlock();
+            auto numSamples = (int) block.getNumSamples();
+            auto envelope = analyser.getEnvelope();
+
+            if (envelope > threshold)
+            {
+                open = true;
+                holdRemaining = holdSamples;
+            }
+            else if (envelope < threshold * 0.5f)
+            {
+                holdRemaining -= numSamples;
+                open = open && holdRemaining > 0;
+            }
+
+            // Fully open is the common case and costs nothing
+            if (open && gain == 1.0f)
+                return;
+
+            if (! open && gain == 0.0f)
+            {
+                block.clear();
+                return;
+            }
+
+            for (int i = 0; i < numSamples; ++i)
+            {
+                gain = open ? juce::jmin (1.0f, gain + attackStep) : juce::jmax (0.0f, gain - releaseStep);
+
+                for (size_t ch = 0; ch < block.getNumChannels(); ++ch)
+                    block.getChannelPointer (ch)[i] *= gain;
+            }
+        }
+
+    private:
+        static constexpr double attackTime = 0.001;
+        static constexpr double holdTime = 0.05;
+
+        const SignalAnalyser& analyser;
+        double sampleRate = 44100.0;
+        float threshold = 0.0f, attackStep = 1.0f, releaseStep = 1.0f, gain = 0.0f;
+        int holdSamples = 0, holdRemaining = 0;
+        bool open = false;
+    };
+
+    //==============================================================================
+    class CompressorNode : public ProcessorNode<juce::dsp::Compressor<float>>
+    {
+    public:
+        using ProcessorNode::ProcessorNode;
+
+        void update (const float* values) noexcept override
+        {
+            processor.setAttack (values[Processor::compressorAttackParam]);
+            processor.setRelease (values[Processor::compressorReleaseParam]);
+            processor.setRatio (values[Processor::compressorRatioParam]);
+            processor.setThreshold (values[Processor::compressorThresholdParam]);
+        }
+    };
+
+    class GainNode : public ProcessorNode<juce::dsp::Gain<float>>
+    {
+    public:
+        GainNode (EffectType type, const juce::String& name, int gainParameter)
+            : ProcessorNode (type, name), parameterIndex (gainParameter)
+        {
+        }
+
+        // Level changes ramp, so a preset switch fades between the settings
+        void prepare (const juce::dsp::ProcessSpec& spec, const float* values) override
+        {
+            processor.setRampDurationSeconds (levelRampTime);
+            ProcessorNode::prepare (spec, values);
+        }
+
+        void update (const float* values) noexcept override
+        {
+            processor.setGainDecibels (values[parameterIndex]);
+        }
+
+    private:
+        int parameterIndex;
+    };
+
+    class DriveNode : public ProcessorNode<Drive>
+    {
+    public:
+        using ProcessorNode::ProcessorNode;
+
+        void prepare (const juce::dsp::ProcessSpec& spec, const float* values) override
+        {
+            processor.setLevelSmoothingTime (levelRampTime);
+            ProcessorNode::prepare (spec, values);
+        }
+
+        void update (const float* values) noexcept override
+        {
+            processor.setCurve ((DriveCurve) juce::roundToInt (values[Processor::driveCurveParam]));
+            processor.setDrive (values[Processor::driveGainParam]);
+            processor.setTightFrequency (values[Processor::driveTightParam]);
+            processor.setToneFrequency (values[Processor::driveToneParam]);
+            processor.setLevel (values[Processor::driveLevelParam]);
+            processor.setOversamplingOrder (juce::roundToInt (values[Processor::driveOversamplingParam]));
+        }
+
+        void setProcessingLoad (float load) noexcept override
+        {
+            processor.setProcessingLoad (load);
+        }
+    };
+
+    class ChorusNode : public ProcessorNode<juce::dsp::Chorus<float>>
+    {
+    public:
+        using ProcessorNode::ProcessorNode;
+
+        void update (const float* values) noexcept override
+        {
+            processor.setCentreDelay (values[Processor::chorusCentreDelayParam]);
+            processor.setDepth (values[Processor::chorusDepthParam]);
+            processor.setFeedback (values[Processor::chorusFeedbackParam]);
+            processor.setMix (values[Processor::chorusMixParam]);
+            processor.setRate (values[Processor::chorusRateParam]);
+        }
+    };
+
+    class DelayNode : public ProcessorNode<Delay<float>>
+    {
+    public:
+        using ProcessorNode::ProcessorNode;
+
+        // The lines are allocated here for the whole DELAYMAXTIME range, after that the max time is only a window onto them
+        void prepare (const juce::dsp::ProcessSpec& spec, const float* values) override
+        {
+            processor.setMaxDelayTime (values[Processor::delayMaxTimeParam]);
+            processor.setLevelSmoothingTime (levelRampTime);
+            ProcessorNode::prepare (spec, values);
+        }
+
+        void update (const float* values) noexcept override
+        {
+            processor.setMaxDelayTime (values[Processor::delayMaxTimeParam]);
+            processor.setInterpolation ((DelayInterpolation) juce::roundToInt (values[Processor::delayInterpolationParam]));
+            processor.setSaturation ((SaturationType) juce::roundToInt (values[Processor::delaySaturationParam]));
+            processor.setDelayTime (0, values[Processor::delayLeftTimeParam]);
+            processor.setDelayTime (1, values[Processor::delayRightTimeParam]);
+            processor.setWetLevel (values[Processor::delayWetLevelParam]);
+            processor.setFeedback (values[Processor::delayFeedbackParam]);
+        }
+
+        void process (const juce::dsp::ProcessContextReplacing<float>& context, RealtimeThreadPool* pool) noexcept override
+        {
+            if (pool == nullptr)
+                processor.process (context);
+            else
+                pool->run (context.getOutputBlock().getNumChannels(), [&] (size_t channel) { processor.process (context, channel); });
+        }
+    };
+
+    class MultiTapNode : public ProcessorNode<MultiTapDelay<float>>
+    {
+    public:
+        using ProcessorNode::ProcessorNode;
+
+        // The line is as long as the slowest pattern needs, four taps of a quarter at 60 BPM
+        void prepare (const juce::dsp::ProcessSpec& spec, const float* values) override
+        {
+            processor.setMaxDelayTime (4.0f);
+            ProcessorNode::prepare (spec, values);
+        }
+
+        // The taps follow a pattern: evenly spaced at the division of the tempo, each one quieter
+        // and darker than the one before, alternating left and right
+        void update (const float* values) noexcept override
+        {
+            static constexpr float divisionBeats[] = { 1.0f, 0.75f, 0.5f, 1.0f / 3.0f, 0.25f };
+
+            auto division = divisionBeats[juce::jlimit (0, (int) std::size (divisionBeats) - 1, juce::roundToInt (values[Processor::multiTapDivisionParam]))];
+            auto spacing = division * 60.0f / values[Processor::multiTapTempoParam];
+            auto numTaps = (size_t) juce::jlimit (1, 8, juce::roundToInt (values[Processor::multiTapTapsParam]));
+            auto decay = values[Processor::multiTapDecayParam];
+            auto spread = values[Processor::multiTapSpreadParam];
+            auto tone = values[Processor::multiTapToneParam];
+            auto level = 1.0f;
+
+            // Taps past the end of the line are left out
+            numTaps = juce::jmax ((size_t) 1, juce::jmin (numTaps, (size_t) (processor.getMaxDelayTime() / spacing)));
+
+            for (size_t t = 0; t < numTaps; ++t)
+            {
+                processor.setTap (t, spacing * (float) (t + 1), level, t % 2 == 0 ? -spread : spread, tone / (1.0f + 0.3f * (float) t));
+                level *= decay;
+            }
+
+            processor.setNumTaps (numTaps);
+            processor.setFeedback (values[Processor::multiTapFeedbackParam]);
+            processor.setWetLevel (values[Processor::multiTapWetLevelParam]);
+        }
+    };
+
+    class ReverbNode : public ProcessorNode<juce::dsp::Reverb>
+    {
+    public:
+        using ProcessorNode::ProcessorNode;
+
+        void update (const float* values) noexcept override
+        {
+            parameters.roomSize = values[Processor::reverbRoomSizeParam];
+            parameters.damping = values[Processor::reverbDampingParam];
+            parameters.wetLevel = values[Processor::reverbWetLevelParam];
+            parameters.dryLevel = values[Processor::reverbDryLevelParam];
+            parameters.width = values[Processor::reverbWidthParam];
+            parameters.freezeMode = values[Processor::reverbFreezeModeParam];
+            processor.setParameters (parameters);
+        }
+
+    private:
+        juce::dsp::Reverb::Parameters parameters;
+    };
+
+    class ConvolutionNode : public ProcessorNode<Convolver>
+    {
+    public:
+        using ProcessorNode::ProcessorNode;
+
+        void prepare (const juce::dsp::ProcessSpec& spec, const float* values) override
+        {
+            processor.setLevelSmoothingTime (levelRampTime);
+            ProcessorNode::prepare (spec, values);
+        }
+
+        void update (const float* values) noexcept override
+        {
+            processor.setWetLevel (values[Processor::convolutionWetLevelParam]);
+            processor.setDryLevel (values[Processor::convolutionDryLevelParam]);
+        }
+
+        // The tail partitions are the expensive part, with a pool each channel's run on its own core
+        void process (const juce::dsp::ProcessContextReplacing<float>& context, RealtimeThreadPool* pool) noexcept override
+        {
+            if (pool == nullptr)
+                processor.process (context);
+            else
+                pool->run (context.getOutputBlock().getNumChannels(), [&] (size_t channel) { processor.process (context, channel); });
+        }
+
+        juce::Result loadImpulseResponse (const juce::File& file) override
+        {
+            return processor.loadImpulseResponse (file);
+        }
+
+        bool waitForImpulseResponse (int timeoutMs) override
+        {
+            return processor.waitForImpulseResponse (timeoutMs);
+        }
+    };
+}
+
+std::unique_ptr<EffectNode> EffectNode::create (const juce::String& name, const SignalAnalyser& analyser)
+{
+    auto type = name.trimCharactersAtEnd ("0123456789");
+
+    if (type == "gate")         return std::make_unique<GateNode> (gateEffect, name, analyser);
+    if (type == "compressor")   return std::make_unique<CompressorNode> (compressorEffect, name);
+    if (type == "preGain")      return std::make_unique<GainNode> (preGainEffect, name, Processor::preGainParam);
+    if (type == "drive")        return std::make_unique<DriveNode> (driveEffect, name);
+    if (type == "chorus")       return std::make_unique<ChorusNode> (chorusEffect, name);
+    if (type == "delay")        return std::make_unique<DelayNode> (delayEffect, name);
+    if (type == "multiTap")     return std::make_unique<MultiTapNode> (multiTapEffect, name);
+    if (type == "reverb")       return std::make_unique<ReverbNode> (reverbEffect, name);
+    if (type == "convolution")  return std::make_unique<ConvolutionNode> (convolutionEffect, name);
+    if (type == "masterGain")   return std::make_unique<GainNode> (masterGainEffect, name, Processor::masterGainParam);
+
+    return {};
+}
+
+//==============================================================================
+struct EffectGraph::Parser
+{
+    juce::String::CharPointerType text;
+    const std::function<EffectNode* (const juce::String&)>& getNode;
+    std::vector<EffectNode*>& nodes;
+    juce::String error;
+
+    bool accept (juce::juce_wchar character)
+    {
+        text.incrementToEndOfWhitespace();
+
+        if (*text != character)
+            return false;
+
+        ++text;
+        return true;
+    }
+
+    bool fail (const juce::String& message)
+    {
+        if (error.isEmpty())
+            error = message;
+
+        return false;
+    }
+
+    // element ('>' element)*
+    bool parseSeries (Series& series)
+    {
+        do
+        {
+            series.emplace_back();
+
+            if (! parseElement (series.back()))
+                return false;
+        }
+        while (accept ('>'));
+
+        return true;
+    }
+
+    // name ['@' mix] | '[' series ('|' series)* ']' ['@' mix]
+    bool parseElement (Element& element)
+    {
+        if (accept ('['))
+        {
+            do
+            {
+                element.branches.emplace_back();
+
+                if (! parseSeries (element.branches.back()))
+                    return false;
+            }
+            while (accept ('|'));
+
+            if (! accept (']'))
+                return fail ("Missing ]");
+        }
+        else
+        {
+            text.incrementToEndOfWhitespace();
+            juce::String name;
+
+            while (juce::CharacterFunctions::isLetterOrDigit (*text))
+                name += *text++;
+
+            if (name.isEmpty())
+                return fail ("Expected an effect name");
+
+            element.node = getNode (name);
+
+            if (element.node == nullptr)
+                return fail ("Unknown effect " + name);
+
+            if (std::find (nodes.begin(), nodes.end(), element.node) != nodes.end())
+                return fail (name + " is used more than once");
+
+            nodes.push_back (element.node);
+        }
+
+        if (accept ('@'))
+        {
+            text.incrementToEndOfWhitespace();
+            auto mix = juce::CharacterFunctions::readDoubleValue (text);
+
+            if (mix < 0.0 || mix > 1.0)
+                return fail ("The mix has to be between 0 and 1");
+
+            element.mix = (float) mix;
+        }
+
+        return true;
+    }
+};
+
+std::unique_ptr<EffectGraph> EffectGraph::create (const juce::String& description,
+                                                  const std::function<EffectNode* (const juce::String&)>& getNode,
+                                                  juce::String& error)
+{
+    auto graph = std::make_unique<EffectGraph>();
+    graph->description = description.trim();
+
+    Parser parser { graph->description.getCharPointer(), getNode, graph->nodes, {} };
+
+    if (graph->description.isNotEmpty() && parser.parseSeries (graph->root))
+    {
+        parser.text.incrementToEndOfWhitespace();
+
+        if (parser.text.isEmpty())
+            return graph;
+
+        parser.fail ("Unexpected " + juce::String (parser.text));
+    }
+
+    error = parser.error.isNotEmpty() ? parser.error : juce::String ("Empty effect graph");
+    return {};
+}
+
+//==============================================================================
+void EffectGraph::prepare (const juce::dsp::ProcessSpec& spec)
+{
+    prepareSeries (root, spec);
+}
+
+void EffectGraph::prepareSeries (Series& series, const juce::dsp::ProcessSpec& spec)
+{
+    auto numChannels = (int) spec.numChannels;
+    auto numSamples = (int) spec.maximumBlockSize;
+
+    for (auto& element : series)
+    {
+        // A parallel split always needs its input kept, a node only when it is mixed with it
+        if (element.node == nullptr || element.mix < 1.0f)
+            element.dryBuffer.setSize (numChannels, numSamples);
+
+        if (element.node == nullptr)
+        {
+            element.branchBuffers.resize (element.branches.size());
+
+            for (auto& buffer : element.branchBuffers)
+                buffer.setSize (numChannels, numSamples);
+
+            for (auto& branch : element.branches)
+                prepareSeries (branch, spec);
+        }
+    }
+}
+
+juce::dsp::AudioBlock<float> EffectGraph::getBlock (juce::AudioBuffer<float>& buffer, const juce::dsp::AudioBlock<float>& like) noexcept
+{
+    jassert ((int) like.getNumSamples() <= buffer.getNumSamples());
+
+    return juce::dsp::AudioBlock<float> (buffer).getSubsetChannelBlock (0, like.getNumChannels())
+                                                .getSubBlock (0, like.getNumSamples());
+}
+
+void EffectGraph::process (juce::dsp::AudioBlock<float>& block, DspProfiler* profiler, RealtimeThreadPool* pool) noexcept
+{
+    processSeries (root, block, profiler, pool);
+}
+
+void EffectGraph::processSeries (Series& series, juce::dsp::AudioBlock<float>& block, DspProfiler* profiler, RealtimeThreadPool* pool) noexcept
+{
+    for (auto& element : series)
+    {
+        auto hasDry = element.dryBuffer.getNumSamples() > 0;
+
+        if (hasDry)
+            getBlock (element.dryBuffer, block).copyFrom (block);
+
+        if (element.node != nullptr)
+        {
+            juce::dsp::ProcessContextReplacing<float> context (block);
+            auto start = profiler != nullptr ? DspProfiler::getTicks() : 0;
+
+            element.node->process (context, pool);
+
+            if (profiler != nullptr)
+                profiler->addStageTime ((size_t) element.node->getProfilerStage(), DspProfiler::getTicks() - start);
+        }
+        else
+        {
+            auto dry = getBlock (element.dryBuffer, block);
+
+            // The pool runs one job at a time, so the branches themselves run their nodes serially
+            auto processBranch = [&] (size_t i)
+            {
+                auto branchBlock = getBlock (element.branchBuffers[i], block);
+                branchBlock.copyFrom (dry);
+                processSeries (element.branches[i], branchBlock, profiler, nullptr);
+            };
+
+            if (pool != nullptr)
+                pool->run (element.branches.size(), processBranch);
+            else
+                for (size_t i = 0; i < element.branches.size(); ++i)
+                    processBranch (i);
+
+            block.clear();
+
+            for (auto& buffer : element.branchBuffers)
+                block.add (getBlock (buffer, block));
+
+            block.multiplyBy (1.0f / (float) element.branches.size());
+        }
+
+        if (element.mix < 1.0f)
+        {
+            block.multiplyBy (element.mix);
+            block.addProductOf (getBlock (element.dryBuffer, block), 1.0f - element.mix);
+        }
+    }
+}
@@ -0,0 +1,133 @@
+/*
+    Runtime configurable routing of the effects, replacing the fixed ProcessorChain.
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "DspProfiler.h"
+#include "RealtimeThreadPool.h"
+#include "SignalAnalyser.h"
+
+// What an effect is, which also decides which parameters it follows. Several nodes
+// of one type (delay, delay2) share that type's parameters.
+enum EffectType
+{
+    gateEffect,
+    compressorEffect,
+    preGainEffect,
+    driveEffect,
+    chorusEffect,
+    delayEffect,
+    multiTapEffect,
+    reverbEffect,
+    convolutionEffect,
+    masterGainEffect,
+    numEffectTypes
+};
+
+//==============================================================================
+/** One effect in the graph. Nodes outlive the graphs that use them, so reordering the
+    effects keeps their state and the tails ring on.
+*/
+class EffectNode
+{
+public:
+    EffectNode (EffectType type, const juce::String& name);
+    virtual ~EffectNode() = default;
+
+    /** Creates a node from its name, the type being the name without any trailing digits.
+        Returns nullptr for an unknown type. Nodes that follow the input level, like the gate,
+        read it from the analyser, which has to outlive them.
+    */
+    static std::unique_ptr<EffectNode> create (const juce::String& name, const SignalAnalyser& analyser);
+
+    EffectType getType() const noexcept             { return type; }
+    const juce::String& getName() const noexcept    { return name; }
+
+    int getProfilerStage() const noexcept           { return profilerStage; }
+    void setProfilerStage (int newStage) noexcept   { profilerStage = newStage; }
+
+    //==============================================================================
+    /** values are every parameter in its own units, indexed by Processor::ParameterIndex */
+    virtual void prepare (const juce::dsp::ProcessSpec& spec, const float* values) = 0;
+    virtual void reset() noexcept = 0;
+    virtual void update (const float* values) noexcept = 0;
+
+    /** A node may spread its channels over the pool when it is not null */
+    virtual void process (const juce::dsp::ProcessContextReplacing<float>& context, RealtimeThreadPool* pool) noexcept = 0;
+
+    /** Called once per callback with the share of the block's duration the callbacks take, for
+        nodes that trade quality for CPU time
+    */
+    virtual void setProcessingLoad (float) noexcept {}
+
+    /** Only the convolution takes an impulse response, every other node fails */
+    virtual juce::Result loadImpulseResponse (const juce::File& file);
+
+    /** Blocks until a loaded impulse response is in use, see Convolver::waitForImpulseResponse() */
+    virtual bool waitForImpulseResponse (int) { return true; }
+
+private:
+    EffectType type;
+    juce::String name;
+    int profilerStage = 0;
+};
+
+//==============================================================================
+/** An immutable routing of nodes, built and prepared on the control thread and handed
+    to the audio thread in one go. The description reads left to right:
+
+        compressor > preGain > [chorus | delay@0.5] > reverb@0.3 > masterGain
+
+    '>' runs effects in series, '[a | b]' runs branches in parallel on copies of the
+    signal and averages them, '@mix' blends the result with the dry signal. Effects that
+    are not in the description are not processed at all.
+*/
+class EffectGraph
+{
+public:
+    /** Returns nullptr and sets error if the description does not parse. getNode returns
+        the node for a name, or nullptr if it cannot make one.
+    */
+    static std::unique_ptr<EffectGraph> create (const juce::String& description,
+                                                const std::function<EffectNode* (const juce::String&)>& getNode,
+                                                juce::String& error);
+
+    const juce::String& getDescription() const noexcept         { return description; }
+
+    /** Every node in the graph once, in processing order */
+    const std::vector<EffectNode*>& getNodes() const noexcept   { return nodes; }
+
+    /** Allocates the buffers for the parallel branches and dry mixes, the nodes are prepared separately */
+    void prepare (const juce::dsp::ProcessSpec& spec);
+
+    /** Times every node when profiler is not null. With a pool, parallel branches run on separate
+        cores; every branch has its own buffer and they are summed in order afterwards, so the
+        output is bit for bit the same as without one.
+    */
+    void process (juce::dsp::AudioBlock<float>& block, DspProfiler* profiler, RealtimeThreadPool* pool) noexcept;
+
+private:
+    struct Element
+    {
+        EffectNode* node = nullptr;                 // Null for a parallel split
+        std::vector<std::vector<Element>> branches;
+        float mix = 1.0f;
+
+        juce::AudioBuffer<float> dryBuffer;
+        std::vector<juce::AudioBuffer<float>> branchBuffers;
+    };
+
+    using Series = std::vector<Element>;
+
+    struct Parser;
+
+    static void prepareSeries (Series& series, const juce::dsp::ProcessSpec& spec);
+    static void processSeries (Series& series, juce::dsp::AudioBlock<float>& block, DspProfiler* profiler, RealtimeThreadPool* pool) noexcept;
+    static juce::dsp::AudioBlock<float> getBlock (juce::AudioBuffer<float>& buffer, const juce::dsp::AudioBlock<float>& like) noexcept;
+
+    juce::String description;
+    Series root;
+    std::vector<EffectNode*> nodes;
+};
@@ -0,0 +1,70 @@
+/*
+    Measures the round trip latency of the audio interface with a loopback cable.
+*/
+
+#include "LatencyMeasurer.h"
+
+int LatencyMeasurer::measure (juce::AudioDeviceManager& deviceManager, int timeoutMs)
+{
+    LatencyMeasurer measurer;
+    deviceManager.addAudioCallback (&measurer);
+
+    auto deadline = juce::Time::getMillisecondCounter() + (juce::uint32) timeoutMs;
+
+    while (measurer.numMeasured.load() < numMeasurements && juce::Time::getMillisecondCounter() < deadline)
+        juce::Thread::sleep (50);
+
+    deviceManager.removeAudioCallback (&measurer);
+
+    auto count = juce::jmin (measurer.numMeasured.load(), numMeasurements);
+
+    if (count == 0)
+        return -1;
+
+    std::sort (measurer.measurements.begin(), measurer.measurements.begin() + count);
+    return measurer.measurements[(size_t) count / 2];
+}
+
+void LatencyMeasurer::audioDeviceAboutToStart (juce::AudioIODevice* device)
+{
+    // A click every half second, far longer than any round trip worth measuring
+    clickInterval = juce::roundToInt (device->getCurrentSampleRate() * 0.5);
+    samplesSinceClick = 0;
+    waitingForClick = false;
+}
+
+void LatencyMeasurer::audioDeviceIOCallbackWithContext (const float* const* inputChannelData, int numInputChannels,
+                                                       float* const* outputChannelData, int numOutputChannels,
+                                                       int numSamples, const juce::AudioIODeviceCallbackContext&)
+{
+    for (int ch = 0; ch < numOutputChannels; ++ch)
+        if (outputChannelData[ch] != nullptr)
+            juce::FloatVectorOperations::clear (outputChannelData[ch], numSamples);
+
+    auto* input = numInputChannels > 0 ? inputChannelData[0] : nullptr;
+
+    for (int i = 0; i < numSamples; ++i, ++samplesSinceClick)
+    {
+        if (input != nullptr && waitingForClick && std::abs (input[i]) > threshold)
+        {
+            waitingForClick = false;
+            auto index = numMeasured.load (std::memory_order_relaxed);
+
+            if (index < numMeasurements)
+            {
+                measurements[(size_t) index] = samplesSinceClick;
+                numMeasured.store (index + 1, std::memory_order_release);
+            }
+        }
+
+        if (samplesSinceClick >= clickInterval)
+        {
+            samplesSinceClick = 0;
+            waitingForClick = true;
+
+            for (int ch = 0; ch < numOutputChannels; ++ch)
+                if (outputChannelData[ch] != nullptr)
+                    outputChannelData[ch][i] = 0.5f;
+        }
+    }
+}
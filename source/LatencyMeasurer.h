@@ -0,0 +1,36 @@
+/*
+    Measures the round trip latency of the audio interface with a loopback cable.
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+/** Plays short clicks and listens for them coming back on the first input. Needs the
+    output patched into the input (a cable, or the amp's send/return), and nothing else
+    attached to the device while it runs.
+*/
+class LatencyMeasurer : private juce::AudioIODeviceCallback
+{
+public:
+    /** Blocks until enough clicks came back or timeoutMs passed. Returns the median round
+        trip in samples, or -1 if no click came back.
+    */
+    static int measure (juce::AudioDeviceManager& deviceManager, int timeoutMs = 5000);
+
+private:
+    static constexpr int numMeasurements = 9;
+    static constexpr float threshold = 0.1f;
+
+    void audioDeviceAboutToStart (juce::AudioIODevice* device) override;
+    void audioDeviceStopped() override {}
+    void audioDeviceIOCallbackWithContext (const float* const* inputChannelData, int numInputChannels,
+                                          float* const* outputChannelData, int numOutputChannels,
+                                          int numSamples, const juce::AudioIODeviceCallbackContext& context) override;
+
+    int clickInterval = 24000;
+    int samplesSinceClick = 0;
+    bool waitingForClick = false;
+    std::array<int, numMeasurements> measurements {};
+    std::atomic<int> numMeasured { 0 };
+};
@@ -1,26 +1,728 @@
-/*
-    Written by Paul Compter, 10-03-2024
-*/
-
-#include <JuceHeader.h>
-#include "AudioProcessor.h"
-#include "ArduinoSerialReader.h"
-
-int main (void)
-{
-    ScopedJuceInitialiser_GUI initialiser;
-    juce::AudioDeviceManager deviceManager;
-    Processor processor;
-    juce::AudioProcessorPlayer player;
-
-    player.setProcessor(&processor);
-
-    deviceManager.initialiseWithDefaultDevices(1,2);
-
-    deviceManager.addAudioCallback(&player);
-    ArduinoSerialReader reader("/dev/ttyACM0", B9600, processor);
-    for (; ;){};
-
-    deviceManager.removeAudioCallback(&player);
-    return 0;
-}
+/*
+    Written by Paul Compter, 10-03-2024
+*/
+
+#include <JuceHeader.h>
+#include <csignal>
+#include <pthread.h>
+#include "AudioProcessor.h"
+#include "ArduinoSerialReader.h"
+#include "OfflineRenderer.h"
+#include "LatencyMeasurer.h"
+#include "AlsaAudioBackend.h"
+#include "StateStore.h"
+#include "RealtimeChecker.h"
+#include "RigHost.h"
+
+// --profile prints per-stage DSP timings to stdout, --profile=<file> appends them to a file
+static std::unique_ptr<DspProfileReporter> createProfileReporter(const juce::ArgumentList& args, Processor& processor,
+                                                                 std::function<int()> getDeviceXRuns = {})
+{
+    if (! args.containsOption("--profile"))
+        return {};
+
+    auto path = args.getValueForOption("--profile");
+    auto file = path.isEmpty() ? juce::File() : juce::File::getCurrentWorkingDirectory().getChildFile(path);
+    auto intervalMs = args.containsOption("--profile-interval") ? args.getValueForOption("--profile-interval").getIntValue() : 5000;
+
+    return std::make_unique<DspProfileReporter>(processor.getProfiler(), file, juce::jmax(100, intervalMs), std::move(getDeviceXRuns));
+}
+
+// The signals that control a live run: SIGINT and SIGTERM end it, SIGUSR1 saves the state.
+// They are blocked in every thread and only picked up by the main loop.
+static sigset_t getControlSignals()
+{
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGUSR1);
+    return signals;
+}
+
+// --graph="compressor > preGain > delay > reverb > masterGain" sets the order of the effects, see EffectGraph
+static bool applyGraphOption(const juce::ArgumentList& args, Processor& processor)
+{
+    if (! args.containsOption("--graph"))
+        return true;
+
+    auto result = processor.setGraph(args.getValueForOption("--graph"));
+
+    if (result.failed())
+        std::cerr << result.getErrorMessage() << std::endl;
+
+    return result.wasOk();
+}
+
+// --ir=<file> loads an impulse response into the convolution effect, --ir=<effect>:<file>,... into named ones
+// such as convolution2. The response is resampled in the background: a live rig plays through the previous one
+// until it is ready, an offline render waits for it.
+static bool applyImpulseResponseOption(const juce::ArgumentList& args, Processor& processor)
+{
+    if (! args.containsOption("--ir"))
+        return true;
+
+    auto ok = true;
+
+    for (auto& item : juce::StringArray::fromTokens(args.getValueForOption("--ir"), ",", "\"\""))
+    {
+        auto hasName = item.containsChar(':');
+        auto nodeName = hasName ? item.upToFirstOccurrenceOf(":", false, false).trim() : juce::String("convolution");
+        auto path = hasName ? item.fromFirstOccurrenceOf(":", false, false).trim() : item.trim();
+        auto result = processor.loadImpulseResponse(nodeName, juce::File::getCurrentWorkingDirectory().getChildFile(path));
+
+        if (result.failed())
+        {
+            std::cerr << result.getErrorMessage() << std::endl;
+            ok = false;
+        }
+    }
+
+    return ok;
+}
+
+// --threads=<n> adds n real-time worker threads for parallel branches and channels, 0 (the default) keeps
+// all processing on the audio thread. The pool is created before the processor so it outlives it.
+static std::unique_ptr<RealtimeThreadPool> createThreadPool(const juce::ArgumentList& args)
+{
+    auto numWorkers = args.containsOption("--threads") ? args.getValueForOption("--threads").getIntValue() : 0;
+    return numWorkers > 0 ? std::make_unique<RealtimeThreadPool>(numWorkers) : nullptr;
+}
+
+// --sub-block=<samples> processes every block in pieces of at most that many samples, so the parameter
+// ramps move in finer steps without asking the interface for smaller buffers
+static void applySubBlockOption(const juce::ArgumentList& args, Processor& processor)
+{
+    if (args.containsOption("--sub-block"))
+        processor.setSubBlockSize(args.getValueForOption("--sub-block").getIntValue());
+}
+
+// What the driver says the round trip costs: the buffer plus whatever it adds on either side
+static void printDeviceLatency(juce::AudioIODevice& device)
+{
+    auto sampleRate = device.getCurrentSampleRate();
+    auto bufferSize = device.getCurrentBufferSizeSamples();
+    auto reported = device.getInputLatencyInSamples() + device.getOutputLatencyInSamples();
+    auto toMs = [sampleRate](int samples) { return juce::String(1000.0 * samples / sampleRate, 2) + " ms"; };
+
+    std::cout << "Buffer " << bufferSize << " samples (" << toMs(bufferSize) << ") at " << sampleRate << " Hz, "
+              << "reported input + output latency " << reported << " samples (" << toMs(reported) << ")" << std::endl;
+}
+
+// Opens the default device, --buffer-size=<samples> asks the interface for smaller blocks, trading CPU for latency
+static void openAudioDevice(const juce::ArgumentList& args, juce::AudioDeviceManager& deviceManager, int numInputChannels = 1, int numOutputChannels = 2)
+{
+    auto error = deviceManager.initialiseWithDefaultDevices(numInputChannels, numOutputChannels);
+
+    if (error.isNotEmpty())
+        std::cerr << "Error opening audio device: " << error << std::endl;
+
+    if (args.containsOption("--buffer-size"))
+    {
+        auto setup = deviceManager.getAudioDeviceSetup();
+        setup.bufferSize = args.getValueForOption("--buffer-size").getIntValue();
+        error = deviceManager.setAudioDeviceSetup(setup, true);
+
+        if (error.isNotEmpty())
+            std::cerr << "Error setting the buffer size: " << error << std::endl;
+    }
+
+    if (auto* device = deviceManager.getCurrentAudioDevice())
+    {
+        printDeviceLatency(*device);
+
+        // --measure-latency times clicks sent from the output back to the input, which needs a loopback cable
+        if (args.containsOption("--measure-latency"))
+        {
+            auto measured = LatencyMeasurer::measure(deviceManager);
+
+            if (measured < 0)
+                std::cerr << "No click came back, is the output patched into the input?" << std::endl;
+            else
+                std::cout << "Measured round trip latency " << measured << " samples ("
+                          << juce::String(1000.0 * measured / device->getCurrentSampleRate(), 2) << " ms)" << std::endl;
+        }
+    }
+}
+
+// --alsa=<device> runs the processor straight from ALSA instead, with mmap I/O and a SCHED_FIFO thread
+// pinned to --audio-core=<n> (0). --alsa-capture=<device> takes the input from another device, and
+// --period=<frames> (64), --periods=<n> (2) and --sample-rate=<Hz> (48000) set up both.
+static AlsaAudioBackend::Options getAlsaOptions(const juce::ArgumentList& args)
+{
+    AlsaAudioBackend::Options options;
+    options.playbackDevice = args.getValueForOption("--alsa");
+    options.captureDevice = args.containsOption("--alsa-capture") ? args.getValueForOption("--alsa-capture") : options.playbackDevice;
+
+    if (args.containsOption("--period"))
+        options.periodSize = args.getValueForOption("--period").getIntValue();
+
+    if (args.containsOption("--periods"))
+        options.numPeriods = args.getValueForOption("--periods").getIntValue();
+
+    if (args.containsOption("--sample-rate"))
+        options.sampleRate = (unsigned int) args.getValueForOption("--sample-rate").getIntValue();
+
+    if (args.containsOption("--audio-core"))
+        options.core = args.getValueForOption("--audio-core").getIntValue();
+
+    return options;
+}
+
+static juce::Result startAlsaBackend(AlsaAudioBackend& backend, const AlsaAudioBackend::Options& options, juce::AudioProcessor& processor)
+{
+    auto result = backend.open(options);
+    return result.wasOk() ? backend.start(processor) : result;
+}
+
+// The round trip from the driver's counters, so without the converters, and the xruns since the start
+static void printAlsaStatus(const AlsaAudioBackend& backend)
+{
+    auto toMs = [&backend](int samples) { return juce::String(1000.0 * samples / backend.getSampleRate(), 2) + " ms"; };
+
+    std::cout << "ALSA period " << backend.getPeriodSize() << " frames, buffer " << backend.getBufferSize() << " frames at "
+              << backend.getSampleRate() << " Hz, round trip " << backend.getRoundTripLatency() << " samples ("
+              << toMs(backend.getRoundTripLatency()) << "), worst " << backend.getMaxRoundTripLatency() << " samples ("
+              << toMs(backend.getMaxRoundTripLatency()) << "), " << backend.getXRunCount() << " xruns" << std::endl;
+}
+
+// Checks that the audio thread got what it needs to keep time, and prints where the stream settled
+static bool startAlsaLive(AlsaAudioBackend& backend, const AlsaAudioBackend::Options& options, juce::AudioProcessor& processor)
+{
+    auto result = startAlsaBackend(backend, options, processor);
+
+    if (result.failed())
+    {
+        std::cerr << result.getErrorMessage() << std::endl;
+        return false;
+    }
+
+    if (! backend.isMemoryLocked())
+        std::cerr << "Could not lock the memory, it needs CAP_IPC_LOCK or a memlock limit" << std::endl;
+
+    // Give the audio thread time to set itself up and run a few periods
+    juce::Thread::sleep(500);
+
+    if (! backend.hasRealtimePriority())
+        std::cerr << "Could not make the audio thread SCHED_FIFO, it needs CAP_SYS_NICE or an rtprio limit" << std::endl;
+
+    printAlsaStatus(backend);
+    return true;
+}
+
+// Watchdog: a device that stopped after an error (unplugged interface, driver failure) gets reopened.
+// One that stays down is retried after 1, 2, 4 ... up to 60 seconds, and only changes get logged.
+struct DeviceWatchdog
+{
+    bool stopped = false;
+    int numRetries = 0;
+    juce::uint32 nextRetry = 0;         // On the millisecond counter
+    juce::String lastError;
+};
+
+static void restartStoppedDevice(DeviceWatchdog& watchdog, AlsaAudioBackend* alsaBackend, const AlsaAudioBackend::Options& alsaOptions,
+                                 juce::AudioProcessor& processor, juce::AudioDeviceManager& deviceManager)
+{
+    auto* device = deviceManager.getCurrentAudioDevice();
+    auto running = alsaBackend != nullptr ? alsaBackend->isRunning() : device != nullptr && device->isPlaying();
+    auto name = juce::String(alsaBackend != nullptr ? "ALSA stream" : "Audio device");
+    auto now = juce::Time::getMillisecondCounter();
+
+    if (running)
+    {
+        if (watchdog.stopped)
+            std::cout << name << " running again" << std::endl;
+
+        watchdog = {};
+        return;
+    }
+
+    if (! watchdog.stopped)
+    {
+        // The ALSA audio thread keeps the error it gave up on
+        auto cause = alsaBackend != nullptr ? alsaBackend->getLastErrorMessage() : juce::String();
+        std::cerr << name << " stopped" << (cause.isNotEmpty() ? " (" + cause + ")" : juce::String()) << ", restarting it" << std::endl;
+        watchdog.stopped = true;
+        watchdog.lastError = cause.isNotEmpty() ? name + " stopped (" + cause + ")" : juce::String();
+    }
+    else if ((int) (now - watchdog.nextRetry) < 0)
+    {
+        return;
+    }
+
+    juce::String error;
+
+    if (alsaBackend != nullptr)
+    {
+        // A stream that started but stopped again since the last retry says why
+        auto cause = alsaBackend->getLastErrorMessage();
+        auto result = startAlsaBackend(*alsaBackend, alsaOptions, processor);
+        error = result.failed() ? result.getErrorMessage() : cause.isNotEmpty() ? name + " stopped (" + cause + ")" : juce::String();
+    }
+    else
+    {
+        deviceManager.closeAudioDevice();
+        error = deviceManager.restartLastAudioDevice() == nullptr ? "No audio device to restart" : "";
+    }
+
+    if (error.isNotEmpty() && error != watchdog.lastError)
+        std::cerr << error << ", retrying with a growing interval" << std::endl;
+
+    watchdog.lastError = error;
+    watchdog.nextRetry = now + (juce::uint32) juce::jmin(60000, 1000 << juce::jmin(watchdog.numRetries, 6));
+    ++watchdog.numRetries;
+}
+
+// --serial=<device> --baud=<rate>, the rate has to match BAUD_RATE in the Arduino sketch
+static juce::String getSerialPort(const juce::ArgumentList& args)
+{
+    return args.containsOption("--serial") ? args.getValueForOption("--serial") : juce::String("/dev/ttyACM0");
+}
+
+static speed_t getSerialSpeed(const juce::ArgumentList& args)
+{
+    auto baudRate = ArduinoSerialReader::getSpeedForBaudRate(args.containsOption("--baud") ? args.getValueForOption("--baud").getIntValue() : 115200);
+
+    if (baudRate == B0)
+    {
+        std::cerr << "Unsupported baud rate, using 115200" << std::endl;
+        baudRate = B115200;
+    }
+
+    return baudRate;
+}
+
+static void printSerialStatistics(const juce::String& name, const ArduinoSerialReader& reader)
+{
+    auto& serialStatistics = reader.getStatistics();
+    std::cout << name << ": " << serialStatistics.messages.load() << " messages, "
+              << serialStatistics.droppedBytes.load() << " dropped bytes, "
+              << serialStatistics.truncatedMessages.load() << " truncated messages" << std::endl;
+}
+
+// A block with more parameter changes than fit merges those for the same parameter, the rest are lost.
+// Returns false if any were.
+static bool printDroppedParameterEvents(const juce::String& name, const Processor& processor)
+{
+    auto numDropped = processor.getNumDroppedParameterEvents();
+
+    if (numDropped > 0)
+        std::cerr << name << ": " << numDropped << " parameter changes dropped, too many arrived in one block" << std::endl;
+
+    return numDropped == 0;
+}
+
+// Builds with GUITARFX_RT_CHECKS count the allocations, locks and blocking calls made on the audio path,
+// each one is also reported with a stack trace as it happens. Returns false if there were any.
+static bool printRealtimeViolations()
+{
+    if (! RealtimeChecker::isEnabled())
+        return true;
+
+    auto numViolations = RealtimeChecker::getNumViolations();
+    std::cout << "Real-time checks: " << numViolations << " violations on the audio path" << std::endl;
+    return numViolations == 0;
+}
+
+// One line per reading while the TUNER parameter is on, such as "E2 +3 cents (82.5 Hz)"
+static void printTuner(const SignalAnalyser& analyser)
+{
+    auto frequency = analyser.getFrequency();
+
+    if (frequency <= 0.0f)
+    {
+        std::cout << "Tuner: --" << std::endl;
+        return;
+    }
+
+    static const char* const noteNames[] = { "C", "C#", "D", "D#", "E", "F", "F#", "G", "G#", "A", "A#", "B" };
+    auto midiNote = 69.0 + 12.0 * std::log2(frequency / 440.0);
+    auto nearest = juce::roundToInt(midiNote);
+    auto cents = juce::roundToInt(100.0 * (midiNote - nearest));
+
+    std::cout << "Tuner: " << noteNames[(nearest % 12 + 12) % 12] << (nearest / 12 - 1) << " "
+              << (cents >= 0 ? "+" : "") << cents << " cents (" << juce::String(frequency, 1) << " Hz)" << std::endl;
+}
+
+static int runLive(const juce::ArgumentList& args)
+{
+    auto threadPool = createThreadPool(args);
+    juce::AudioDeviceManager deviceManager;
+    Processor processor;
+    juce::AudioProcessorPlayer player;
+
+    player.setProcessor(&processor);
+    processor.setThreadPool(threadPool.get());
+    applyGraphOption(args, processor);
+    applySubBlockOption(args, processor);
+    applyImpulseResponseOption(args, processor);
+
+    // --presets=<directory> of state files, selected by program changes from the footswitch
+    if (args.containsOption("--presets"))
+    {
+        auto result = processor.getPresetBank().loadFromDirectory(juce::File::getCurrentWorkingDirectory().getChildFile(args.getValueForOption("--presets")), processor);
+
+        if (result.failed())
+            std::cerr << result.getErrorMessage() << std::endl;
+
+        // A stored state starts where it was left instead
+        if (! args.containsOption("--state"))
+            processor.setCurrentProgram(0);
+    }
+
+    // Declared after the processor, so it stops calling into it before the processor goes
+    std::unique_ptr<AlsaAudioBackend> alsaBackend;
+    AlsaAudioBackend::Options alsaOptions;
+
+    if (args.containsOption("--alsa"))
+    {
+        alsaOptions = getAlsaOptions(args);
+        alsaBackend = std::make_unique<AlsaAudioBackend>();
+
+        if (! startAlsaLive(*alsaBackend, alsaOptions, processor))
+            return 1;
+    }
+    else
+    {
+        openAudioDevice(args, deviceManager);
+        deviceManager.addAudioCallback(&player);
+    }
+
+    auto profileReporter = createProfileReporter(args, processor, [&deviceManager, &alsaBackend]
+    {
+        if (alsaBackend != nullptr)
+            return alsaBackend->getXRunCount();
+
+        auto* device = deviceManager.getCurrentAudioDevice();
+        return device != nullptr ? device->getXRunCount() : -1;
+    });
+
+    auto serialPort = getSerialPort(args);
+    auto baudRate = getSerialSpeed(args);
+
+    // --midi-map=<file> replaces the default controller mappings, --learn=<PARAMETER ID> maps the
+    // next controller that moves to that parameter and saves the map to the --midi-map file on exit
+    auto& controllerMap = processor.getControllerMap();
+    auto midiMapFile = juce::File::getCurrentWorkingDirectory().getChildFile(args.containsOption("--midi-map") ? args.getValueForOption("--midi-map") : juce::String("midi-map.txt"));
+
+    if (args.containsOption("--midi-map"))
+    {
+        auto result = controllerMap.loadFromFile(midiMapFile);
+
+        if (result.failed())
+        {
+            std::cerr << result.getErrorMessage() << ", using the default mappings" << std::endl;
+            controllerMap.setDefaultMappings();
+        }
+    }
+
+    if (args.containsOption("--learn"))
+    {
+        auto parameterIndex = Processor::findParameterIndex(args.getValueForOption("--learn"));
+
+        if (parameterIndex >= 0)
+            controllerMap.startLearning(parameterIndex);
+        else
+            std::cerr << "Unknown parameter to learn: " << args.getValueForOption("--learn") << std::endl;
+    }
+
+    // --tap-cc=<controller> sets the tap tempo footswitch's controller, -1 turns tapping off
+    if (args.containsOption("--tap-cc"))
+        processor.setTapTempoController(args.getValueForOption("--tap-cc").getIntValue());
+
+    // --state=<file> keeps the state and presets on the SD card, changes are journaled to tmpfs
+    // (--state-journal=<file>) and only written to the card by kill -USR1
+    std::unique_ptr<StateStore> stateStore;
+
+    if (args.containsOption("--state"))
+    {
+        auto cwd = juce::File::getCurrentWorkingDirectory();
+        auto journalPath = args.containsOption("--state-journal") ? args.getValueForOption("--state-journal") : juce::String("/dev/shm/guitarfx-state.journal");
+        stateStore = std::make_unique<StateStore>(cwd.getChildFile(args.getValueForOption("--state")), cwd.getChildFile(journalPath));
+
+        // Presets from --presets take the place of the stored ones, and get stored on the next save
+        auto result = stateStore->load(processor, ! args.containsOption("--presets"));
+
+        if (result.failed())
+            std::cerr << result.getErrorMessage() << ", starting from the defaults" << std::endl;
+    }
+
+    auto reader = std::make_unique<ArduinoSerialReader>(serialPort.toRawUTF8(), baudRate, processor);
+
+    // Sleep until asked to stop, waking once a second to check on the audio device, ten times a second while tuning
+    auto signals = getControlSignals();
+    DeviceWatchdog watchdog;
+
+    for (;;)
+    {
+        auto tuning = processor.isTunerOn();
+        timespec timeout { tuning ? 0 : 1, tuning ? 100000000 : 0 };
+        auto signal = sigtimedwait(&signals, nullptr, &timeout);
+
+        if (signal == SIGINT || signal == SIGTERM)
+            break;
+
+        if (tuning)
+            printTuner(processor.getAnalyser());
+
+        if (stateStore != nullptr)
+        {
+            auto result = signal == SIGUSR1 ? stateStore->commit(processor) : stateStore->journal(processor);
+
+            if (result.failed())
+                std::cerr << result.getErrorMessage() << std::endl;
+            else if (signal == SIGUSR1)
+                std::cout << "State saved" << std::endl;
+        }
+
+        restartStoppedDevice(watchdog, alsaBackend.get(), alsaOptions, processor, deviceManager);
+    }
+
+    printSerialStatistics("Serial input", *reader);
+    printDroppedParameterEvents("Processor", processor);
+
+    // Tear down from the inputs inwards, so nothing is left calling into the processor
+    reader.reset();
+
+    if (stateStore != nullptr)
+        stateStore->journal(processor);
+
+    if (args.containsOption("--learn") && ! controllerMap.isLearning())
+    {
+        auto result = controllerMap.saveToFile(midiMapFile);
+        std::cout << (result.wasOk() ? "Saved MIDI map to " + midiMapFile.getFullPathName() : result.getErrorMessage()) << std::endl;
+    }
+
+    profileReporter.reset();
+
+    if (alsaBackend != nullptr)
+    {
+        printAlsaStatus(*alsaBackend);
+        alsaBackend->close();
+    }
+
+    deviceManager.removeAudioCallback(&player);
+    deviceManager.closeAudioDevice();
+    player.setProcessor(nullptr);
+    printRealtimeViolations();
+    return 0;
+}
+
+// --rigs=<n> runs n players' rigs from one interface, see RigHost. Rig n plays out on outputs 2n and 2n + 1
+// and takes input n, or the channel given for it in --rig-inputs=<channel>,... --rig-serial=<device>,... gives
+// the rigs Arduinos of their own, which they listen to on every MIDI channel. Rigs without one share the --serial
+// port and rig n listens on channel n + 1. --rig-channels=<channel>,... overrides either, 0 being every channel.
+static std::vector<RigHost::RigOptions> getRigOptions(const juce::ArgumentList& args)
+{
+    auto numRigs = juce::jlimit(1, 16, args.getValueForOption("--rigs").getIntValue());
+    auto inputs = juce::StringArray::fromTokens(args.getValueForOption("--rig-inputs"), ",", "");
+    auto serialPorts = juce::StringArray::fromTokens(args.getValueForOption("--rig-serial"), ",", "");
+    auto midiChannels = juce::StringArray::fromTokens(args.getValueForOption("--rig-channels"), ",", "");
+    std::vector<RigHost::RigOptions> rigOptions((size_t) numRigs);
+
+    for (int i = 0; i < numRigs; ++i)
+    {
+        auto& options = rigOptions[(size_t) i];
+        auto ownPort = i < serialPorts.size() && serialPorts[i].trim().isNotEmpty();
+        options.inputChannel = i < inputs.size() ? juce::jmax(0, inputs[i].getIntValue()) : i;
+        options.serialPort = ownPort ? serialPorts[i].trim() : getSerialPort(args);
+        options.midiChannel = i < midiChannels.size() ? juce::jlimit(0, 16, midiChannels[i].getIntValue()) : (ownPort ? 0 : i + 1);
+    }
+
+    return rigOptions;
+}
+
+// Every rig starts from the same --graph, --ir, --sub-block, --presets, --midi-map and --tap-cc, and goes
+// its own way from its controls. --threads=<n> spreads the rigs over n more cores.
+static int runRigHost(const juce::ArgumentList& args)
+{
+    auto threadPool = createThreadPool(args);
+    juce::AudioDeviceManager deviceManager;
+    RigHost host(getRigOptions(args));
+    juce::AudioProcessorPlayer player;
+
+    player.setProcessor(&host);
+    host.setThreadPool(threadPool.get());
+
+    for (int i = 0; i < host.getNumRigs(); ++i)
+    {
+        auto& rig = host.getRig(i);
+        applyGraphOption(args, rig);
+        applySubBlockOption(args, rig);
+        applyImpulseResponseOption(args, rig);
+
+        if (args.containsOption("--presets"))
+        {
+            auto result = rig.getPresetBank().loadFromDirectory(juce::File::getCurrentWorkingDirectory().getChildFile(args.getValueForOption("--presets")), rig);
+
+            if (result.failed())
+                std::cerr << result.getErrorMessage() << std::endl;
+
+            rig.setCurrentProgram(0);
+        }
+
+        if (args.containsOption("--midi-map"))
+        {
+            auto result = rig.getControllerMap().loadFromFile(juce::File::getCurrentWorkingDirectory().getChildFile(args.getValueForOption("--midi-map")));
+
+            if (result.failed())
+            {
+                std::cerr << result.getErrorMessage() << ", using the default mappings" << std::endl;
+                rig.getControllerMap().setDefaultMappings();
+            }
+        }
+
+        if (args.containsOption("--tap-cc"))
+            rig.setTapTempoController(args.getValueForOption("--tap-cc").getIntValue());
+
+        auto& options = host.getRigOptions(i);
+        std::cout << "Rig " << i << ": input " << options.inputChannel << ", outputs " << 2 * i << " and " << 2 * i + 1
+                  << ", " << (options.midiChannel > 0 ? "MIDI channel " + juce::String(options.midiChannel) : juce::String("every MIDI channel"))
+                  << " of " << options.serialPort << std::endl;
+    }
+
+    // Declared after the host, so it stops calling into it before the host goes
+    std::unique_ptr<AlsaAudioBackend> alsaBackend;
+    AlsaAudioBackend::Options alsaOptions;
+
+    if (args.containsOption("--alsa"))
+    {
+        alsaOptions = getAlsaOptions(args);
+        alsaOptions.numInputChannels = host.getTotalNumInputChannels();
+        alsaOptions.numOutputChannels = host.getTotalNumOutputChannels();
+        alsaBackend = std::make_unique<AlsaAudioBackend>();
+
+        if (! startAlsaLive(*alsaBackend, alsaOptions, host))
+            return 1;
+    }
+    else
+    {
+        openAudioDevice(args, deviceManager, host.getTotalNumInputChannels(), host.getTotalNumOutputChannels());
+        deviceManager.addAudioCallback(&player);
+    }
+
+    // One reader per port, passing each message on to the rigs on that port
+    auto baudRate = getSerialSpeed(args);
+    std::vector<std::unique_ptr<ArduinoSerialReader>> readers;
+    auto serialPorts = host.getSerialPorts();
+
+    for (auto& port : serialPorts)
+        readers.push_back(std::make_unique<ArduinoSerialReader>(port.toRawUTF8(), baudRate, [&host, port] (const juce::MidiMessage& message)
+        {
+            host.handleMidiMessage(port, message);
+        }));
+
+    // Sleep until asked to stop, waking once a second to check on the audio device
+    auto signals = getControlSignals();
+    DeviceWatchdog watchdog;
+
+    for (;;)
+    {
+        timespec timeout { 1, 0 };
+        auto signal = sigtimedwait(&signals, nullptr, &timeout);
+
+        if (signal == SIGINT || signal == SIGTERM)
+            break;
+
+        restartStoppedDevice(watchdog, alsaBackend.get(), alsaOptions, host, deviceManager);
+    }
+
+    for (size_t i = 0; i < readers.size(); ++i)
+        printSerialStatistics("Serial input from " + serialPorts[(int) i], *readers[i]);
+
+    for (int i = 0; i < host.getNumRigs(); ++i)
+        printDroppedParameterEvents("Rig " + juce::String(i), host.getRig(i));
+
+    readers.clear();
+
+    if (alsaBackend != nullptr)
+    {
+        printAlsaStatus(*alsaBackend);
+        alsaBackend->close();
+    }
+
+    deviceManager.removeAudioCallback(&player);
+    deviceManager.closeAudioDevice();
+    player.setProcessor(nullptr);
+    printRealtimeViolations();
+    return 0;
+}
+
+// GuitarFX --render=in.wav --output=out.wav [--block-size=64] [--automation=automation.txt] [--tail=2] [--graph=...] [--threads=n] [--sub-block=n] [--ir=cab.wav]
+static int runOfflineRender(const juce::ArgumentList& args)
+{
+    auto cwd = juce::File::getCurrentWorkingDirectory();
+    auto inputFile = cwd.getChildFile(args.getValueForOption("--render"));
+    auto outputFile = cwd.getChildFile(args.getValueForOption("--output"));
+    auto blockSize = args.containsOption("--block-size") ? args.getValueForOption("--block-size").getIntValue() : 64;
+    auto tailSeconds = args.containsOption("--tail") ? args.getValueForOption("--tail").getDoubleValue() : 2.0;
+
+    if (! args.containsOption("--output"))
+    {
+        std::cerr << "Missing --output=<file>" << std::endl;
+        return 1;
+    }
+
+    auto threadPool = createThreadPool(args);
+    Processor processor;
+    OfflineRenderer renderer(processor);
+    processor.getProfiler().setEnabled(args.containsOption("--profile"));
+    processor.setThreadPool(threadPool.get());
+
+    if (! applyGraphOption(args, processor))
+        return 1;
+
+    applySubBlockOption(args, processor);
+
+    if (! applyImpulseResponseOption(args, processor))
+        return 1;
+
+    if (args.containsOption("--automation"))
+    {
+        auto result = renderer.loadAutomation(cwd.getChildFile(args.getValueForOption("--automation")));
+
+        if (result.failed())
+        {
+            std::cerr << result.getErrorMessage() << std::endl;
+            return 1;
+        }
+    }
+
+    auto result = renderer.render(inputFile, outputFile, blockSize, tailSeconds);
+
+    if (result.failed())
+    {
+        std::cerr << result.getErrorMessage() << std::endl;
+        return 1;
+    }
+
+    std::cout << "Rendered " << renderer.getRenderedSeconds() << " s in " << renderer.getProcessingSeconds()
+              << " s of processing at " << blockSize << " samples per block: "
+              << renderer.getRealtimeFactor() << "x real time" << std::endl;
+
+    if (processor.getProfiler().isEnabled())
+        std::cout << processor.getProfiler().createReport();
+
+    // A render in CI fails on any violation, so they are caught before they reach a gig. A dropped
+    // parameter change means the output no longer follows the automation.
+    auto droppedNone = printDroppedParameterEvents("Render", processor);
+    return printRealtimeViolations() && droppedNone ? 0 : 1;
+}
+
+int main (int argc, char* argv[])
+{
+    juce::ArgumentList args(argc, argv);
+
+    if (args.containsOption("--render"))
+    {
+        ScopedJuceInitialiser_GUI initialiser;
+        return runOfflineRender(args);
+    }
+
+    // Must happen before any thread is started, so every thread inherits the mask
+    auto signals = getControlSignals();
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    ScopedJuceInitialiser_GUI initialiser;
+    return args.containsOption("--rigs") ? runRigHost(args) : runLive(args);
+}
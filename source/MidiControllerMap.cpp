@@ -0,0 +1,239 @@
+/*
+    Table driven mapping of MIDI controllers onto processor parameters.
+*/
+
+#include "MidiControllerMap.h"
+#include "AudioProcessor.h"
+
+MidiControllerMap::MidiControllerMap()
+{
+    setDefaultMappings();
+}
+
+//==============================================================================
+// Layout: parameter index + 1 in bits 0-7 (0 = unmapped), minimum and maximum as 16 bit
+// fractions in bits 8-23 and 24-39, taper in bits 40-41 and the 14-bit flag in bit 42
+uint64_t MidiControllerMap::pack (const ControllerMapping& mapping) noexcept
+{
+    if (mapping.parameterIndex < 0)
+        return 0;
+
+    auto toFraction = [] (float value) { return (uint64_t) juce::roundToInt (juce::jlimit (0.0f, 1.0f, value) * 65535.0f); };
+
+    return (uint64_t) (mapping.parameterIndex + 1)
+         | (toFraction (mapping.minimum) << 8)
+         | (toFraction (mapping.maximum) << 24)
+         | ((uint64_t) mapping.taper << 40)
+         | ((uint64_t) (mapping.highResolution ? 1 : 0) << 42);
+}
+
+ControllerMapping MidiControllerMap::unpack (uint64_t packed) noexcept
+{
+    ControllerMapping mapping;
+    mapping.parameterIndex = (int) (packed & 0xff) - 1;
+    mapping.minimum = (float) ((packed >> 8) & 0xffff) / 65535.0f;
+    mapping.maximum = (float) ((packed >> 24) & 0xffff) / 65535.0f;
+    mapping.taper = (ControllerTaper) ((packed >> 40) & 0x3);
+    mapping.highResolution = ((packed >> 42) & 1) != 0;
+    return mapping;
+}
+
+float MidiControllerMap::applyTaper (ControllerTaper taper, float value) noexcept
+{
+    switch (taper)
+    {
+        case ControllerTaper::logarithmic:  return std::log10 (1.0f + 9.0f * value);
+        case ControllerTaper::exponential:  return (std::pow (10.0f, value) - 1.0f) / 9.0f;
+        case ControllerTaper::linear:
+        default:                            return value;
+    }
+}
+
+//==============================================================================
+void MidiControllerMap::setMapping (int channel, int controller, const ControllerMapping& mapping) noexcept
+{
+    if (! juce::isPositiveAndBelow (controller, 128) || ! juce::isPositiveAndNotGreaterThan (channel, 16))
+    {
+        jassertfalse;
+        return;
+    }
+
+    // Only controllers 0-31 have an LSB partner
+    auto entry = mapping;
+    entry.highResolution = entry.highResolution && controller < 32;
+
+    for (int ch = 1; ch <= 16; ++ch)
+        if (channel == 0 || channel == ch)
+            table[(size_t) ((ch - 1) * 128 + controller)].store (pack (entry), std::memory_order_relaxed);
+}
+
+ControllerMapping MidiControllerMap::getMapping (int channel, int controller) const noexcept
+{
+    if (! juce::isPositiveAndBelow (controller, 128) || ! juce::isPositiveAndBelow (channel - 1, 16))
+        return {};
+
+    return unpack (table[(size_t) ((channel - 1) * 128 + controller)].load (std::memory_order_relaxed));
+}
+
+void MidiControllerMap::clear() noexcept
+{
+    for (auto& entry : table)
+        entry.store (0, std::memory_order_relaxed);
+}
+
+// The pots of the Arduino sketch, on every channel
+void MidiControllerMap::setDefaultMappings() noexcept
+{
+    clear();
+
+    ControllerMapping mapping;
+    mapping.parameterIndex = Processor::compressorAttackParam;
+    setMapping (0, 1, mapping);
+    mapping.parameterIndex = Processor::delayFeedbackParam;
+    setMapping (0, 2, mapping);
+    mapping.parameterIndex = Processor::reverbWetLevelParam;
+    setMapping (0, 3, mapping);
+}
+
+//==============================================================================
+bool MidiControllerMap::map (const juce::MidiMessage& message, State& state, int& parameterIndex, float& normalisedValue) const noexcept
+{
+    if (! message.isController())
+        return false;
+
+    auto channel = message.getChannel() - 1;
+    auto controller = message.getControllerNumber();
+    auto value = message.getControllerValue();
+    auto& msb = state.msbValues[(size_t) (channel * 32 + (controller & 31))];
+
+    auto mapping = unpack (table[(size_t) (channel * 128 + controller)].load (std::memory_order_relaxed));
+    auto position = 0.0f;
+
+    if (mapping.parameterIndex >= 0)
+    {
+        position = (float) value / 127.0f;
+
+        // A 14-bit MSB move, the LSB that may follow refines it
+        if (mapping.highResolution)
+        {
+            msb = (uint8_t) value;
+            position = (float) (value << 7) / 16383.0f;
+        }
+    }
+    else if (controller >= 32 && controller < 64)
+    {
+        mapping = unpack (table[(size_t) (channel * 128 + controller - 32)].load (std::memory_order_relaxed));
+
+        if (mapping.parameterIndex < 0 || ! mapping.highResolution)
+            return false;
+
+        position = (float) ((msb << 7) | value) / 16383.0f;
+    }
+    else
+    {
+        return false;
+    }
+
+    parameterIndex = mapping.parameterIndex;
+    normalisedValue = mapping.minimum + (mapping.maximum - mapping.minimum) * applyTaper (mapping.taper, position);
+    return true;
+}
+
+bool MidiControllerMap::learn (const juce::MidiMessage& message) noexcept
+{
+    if (! message.isController())
+        return false;
+
+    auto parameterIndex = learnParameter.exchange (-1);
+
+    if (parameterIndex < 0)
+        return false;
+
+    ControllerMapping mapping;
+    mapping.parameterIndex = parameterIndex;
+    setMapping (message.getChannel(), message.getControllerNumber(), mapping);
+    return true;
+}
+
+//==============================================================================
+juce::Result MidiControllerMap::loadFromFile (const juce::File& file)
+{
+    if (! file.existsAsFile())
+        return juce::Result::fail("MIDI map not found: " + file.getFullPathName());
+
+    juce::StringArray lines;
+    file.readLines(lines);
+    clear();
+
+    for (int i = 0; i < lines.size(); ++i)
+    {
+        auto line = lines[i].trim();
+
+        if (line.isEmpty() || line.startsWithChar('#'))
+            continue;
+
+        auto tokens = juce::StringArray::fromTokens(line, false);
+        tokens.removeEmptyStrings();
+
+        auto fail = [&] { return juce::Result::fail("Invalid MIDI mapping on line " + juce::String(i + 1) + ": " + line); };
+
+        if (tokens.size() < 3)
+            return fail();
+
+        auto channel = tokens[0] == "*" ? 0 : tokens[0].getIntValue();
+        auto controller = tokens[1].getIntValue();
+
+        ControllerMapping mapping;
+        mapping.parameterIndex = Processor::findParameterIndex(tokens[2]);
+
+        if (mapping.parameterIndex < 0 || ! juce::isPositiveAndBelow(controller, 128) || ! juce::isPositiveAndNotGreaterThan(channel, 16))
+            return fail();
+
+        auto next = 3;
+
+        if (tokens.size() >= 5 && tokens[3].containsOnly("0123456789.") && tokens[4].containsOnly("0123456789."))
+        {
+            mapping.minimum = tokens[3].getFloatValue();
+            mapping.maximum = tokens[4].getFloatValue();
+            next = 5;
+        }
+
+        for (; next < tokens.size(); ++next)
+        {
+            if (tokens[next] == "linear")       mapping.taper = ControllerTaper::linear;
+            else if (tokens[next] == "log")     mapping.taper = ControllerTaper::logarithmic;
+            else if (tokens[next] == "exp")     mapping.taper = ControllerTaper::exponential;
+            else if (tokens[next] == "14bit")   mapping.highResolution = true;
+            else                                return fail();
+        }
+
+        setMapping(channel, controller, mapping);
+    }
+
+    return juce::Result::ok();
+}
+
+juce::Result MidiControllerMap::saveToFile (const juce::File& file) const
+{
+    static const char* taperNames[] = { "linear", "log", "exp" };
+
+    juce::String text ("# <channel> <controller> <PARAMETER ID> <min> <max> <taper> [14bit]\n");
+
+    for (int channel = 1; channel <= 16; ++channel)
+    {
+        for (int controller = 0; controller < 128; ++controller)
+        {
+            auto mapping = getMapping(channel, controller);
+
+            if (mapping.parameterIndex < 0)
+                continue;
+
+            text << channel << " " << controller << " " << Processor::getParameterID(mapping.parameterIndex) << " "
+                 << juce::String(mapping.minimum, 3) << " " << juce::String(mapping.maximum, 3) << " "
+                 << taperNames[(int) mapping.taper] << (mapping.highResolution ? " 14bit" : "") << "\n";
+        }
+    }
+
+    return file.replaceWithText(text) ? juce::Result::ok()
+                                      : juce::Result::fail("Could not write " + file.getFullPathName());
+}
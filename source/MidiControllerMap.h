@@ -0,0 +1,72 @@
+/*
+    Table driven mapping of MIDI controllers onto processor parameters.
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+enum class ControllerTaper
+{
+    linear,
+    logarithmic,    // Moves quickly at the start of the pot's travel
+    exponential     // Moves slowly at the start of the pot's travel
+};
+
+struct ControllerMapping
+{
+    int parameterIndex = -1;                // Processor::ParameterIndex, -1 when unmapped
+    float minimum = 0.0f;                   // The part of the parameter's normalised range the controller sweeps
+    float maximum = 1.0f;
+    ControllerTaper taper = ControllerTaper::linear;
+    bool highResolution = false;            // Pairs controller 0-31 with controller + 32 as its LSB, for 14 bits
+};
+
+/** A flat table with one entry per channel and controller number, so a message is
+    dispatched by indexing rather than searching. Entries are packed into atomics,
+    so the table can be changed from the control thread while the audio thread reads it.
+*/
+class MidiControllerMap
+{
+public:
+    /** The previous MSB of every 14-bit controller pair. Each thread that maps messages keeps its own. */
+    struct State
+    {
+        std::array<uint8_t, 16 * 32> msbValues {};
+    };
+
+    MidiControllerMap();
+
+    //==============================================================================
+    /** channel is 1-16, or 0 for all channels */
+    void setMapping (int channel, int controller, const ControllerMapping& mapping) noexcept;
+    ControllerMapping getMapping (int channel, int controller) const noexcept;
+    void clear() noexcept;
+    void setDefaultMappings() noexcept;
+
+    /** Looks up a controller message, returns false if it is not mapped */
+    bool map (const juce::MidiMessage& message, State& state, int& parameterIndex, float& normalisedValue) const noexcept;
+
+    //==============================================================================
+    /** The next controller that moves gets mapped to the parameter */
+    void startLearning (int parameterIndex) noexcept    { learnParameter.store (parameterIndex); }
+    bool isLearning() const noexcept                    { return learnParameter.load() >= 0; }
+
+    /** Maps the controller if learning, and returns true if it did */
+    bool learn (const juce::MidiMessage& message) noexcept;
+
+    //==============================================================================
+    /** One mapping per line: <channel 1-16 or *> <controller> <PARAMETER ID> [min max] [linear|log|exp] [14bit]
+        with min and max as fractions of the parameter's range. Lines starting with # are ignored.
+    */
+    juce::Result loadFromFile (const juce::File& file);
+    juce::Result saveToFile (const juce::File& file) const;
+
+private:
+    static uint64_t pack (const ControllerMapping& mapping) noexcept;
+    static ControllerMapping unpack (uint64_t packed) noexcept;
+    static float applyTaper (ControllerTaper taper, float value) noexcept;
+
+    std::array<std::atomic<uint64_t>, 16 * 128> table;
+    std::atomic<int> learnParameter { -1 };
+};
@@ -0,0 +1,248 @@
+/*
+    Incremental MIDI 1.0 byte stream parser for the serial input.
+*/
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/** Turns a raw MIDI byte stream into complete messages, one byte at a time, so it
+    does not care how the stream was split up into reads.
+
+    Handles every channel voice message, running status, system common messages,
+    realtime bytes interleaved anywhere (even inside other messages) and SysEx.
+    Data bytes without a status in front of them are dropped until the next status
+    byte, which is how it regains sync after garbage.
+
+    The Arduino sketch ends every message with 0xFF, which is simply a realtime
+    System Reset to this parser.
+*/
+class MidiStreamParser
+{
+public:
+    static constexpr size_t maxSysExSize = 256;
+
+    /** Counters for the control thread, they can be read from any thread */
+    struct Statistics
+    {
+        std::atomic<uint32_t> messages { 0 };           // Complete messages, realtime included
+        std::atomic<uint32_t> realtimeMessages { 0 };
+        std::atomic<uint32_t> sysExMessages { 0 };
+        std::atomic<uint32_t> droppedBytes { 0 };       // Data bytes that did not belong to any message
+        std::atomic<uint32_t> truncatedMessages { 0 };  // Messages cut short by a new status byte
+        std::atomic<uint32_t> oversizedSysEx { 0 };     // SysEx longer than maxSysExSize, dropped
+    };
+
+    /** Parses the bytes, calling onMessage (const uint8_t* bytes, size_t size) for every complete message */
+    template <typename Callback>
+    void feed (const uint8_t* data, size_t numBytes, Callback&& onMessage)
+    {
+        for (size_t i = 0; i < numBytes; ++i)
+        {
+            auto byte = data[i];
+
+            if (byte >= 0xf8)
+            {
+                count (statistics.realtimeMessages);
+                count (statistics.messages);
+                onMessage (&byte, (size_t) 1);
+            }
+            else if (byte >= 0x80)
+            {
+                handleStatus (byte, onMessage);
+            }
+            else
+            {
+                handleData (byte, onMessage);
+            }
+        }
+    }
+
+    void reset() noexcept
+    {
+        runningStatus = 0;
+        numDataBytes = 0;
+        expectedDataBytes = 0;
+        sysExSize = 0;
+        inSysEx = false;
+        sysExOverflowed = false;
+    }
+
+    const Statistics& getStatistics() const noexcept    { return statistics; }
+
+private:
+    //==============================================================================
+    static void count (std::atomic<uint32_t>& counter) noexcept
+    {
+        counter.fetch_add (1, std::memory_order_relaxed);
+    }
+
+    static int getNumDataBytes (uint8_t status) noexcept
+    {
+        switch (status & 0xf0)
+        {
+            case 0xc0:  // Program change
+            case 0xd0:  // Channel pressure
+                return 1;
+
+            case 0xf0:
+                switch (status)
+                {
+                    case 0xf1:  // MTC quarter frame
+                    case 0xf3:  // Song select
+                        return 1;
+                    case 0xf2:  // Song position
+                        return 2;
+                    case 0xf6:  // Tune request
+                        return 0;
+                    default:    // 0xf4 and 0xf5 are undefined
+                        return -1;
+                }
+
+            default:
+                return 2;
+        }
+    }
+
+    template <typename Callback>
+    void handleStatus (uint8_t status, Callback& onMessage)
+    {
+        if (inSysEx)
+        {
+            inSysEx = false;
+
+            if (status == 0xf7)
+            {
+                if (sysExOverflowed)
+                    return;
+
+                sysEx[sysExSize++] = status;
+                count (statistics.sysExMessages);
+                count (statistics.messages);
+                onMessage (sysEx.data(), sysExSize);
+                return;
+            }
+
+            // Any other status ends a SysEx that never got its terminator
+            count (statistics.truncatedMessages);
+        }
+        else if (expectedDataBytes > 0)
+        {
+            count (statistics.truncatedMessages);
+        }
+
+        numDataBytes = 0;
+
+        if (status == 0xf0)
+        {
+            runningStatus = 0;
+            expectedDataBytes = 0;
+            inSysEx = true;
+            sysExOverflowed = false;
+            sysEx[0] = status;
+            sysExSize = 1;
+            return;
+        }
+
+        if (status == 0xf7)
+        {
+            // A terminator without a SysEx
+            count (statistics.droppedBytes);
+            return;
+        }
+
+        auto numBytes = getNumDataBytes (status);
+
+        if (status >= 0xf0)
+        {
+            // System common messages cancel running status
+            runningStatus = 0;
+
+            if (numBytes < 0)
+            {
+                count (statistics.droppedBytes);
+                expectedDataBytes = 0;
+                return;
+            }
+
+            if (numBytes == 0)
+            {
+                expectedDataBytes = 0;
+                count (statistics.messages);
+                onMessage (&status, (size_t) 1);
+                return;
+            }
+
+            pendingStatus = status;
+            expectedDataBytes = numBytes;
+            return;
+        }
+
+        runningStatus = status;
+        pendingStatus = status;
+        expectedDataBytes = numBytes;
+    }
+
+    template <typename Callback>
+    void handleData (uint8_t byte, Callback& onMessage)
+    {
+        if (inSysEx)
+        {
+            if (sysExSize < maxSysExSize - 1)
+            {
+                sysEx[sysExSize++] = byte;
+            }
+            else if (! sysExOverflowed)
+            {
+                sysExOverflowed = true;
+                count (statistics.oversizedSysEx);
+            }
+
+            return;
+        }
+
+        if (expectedDataBytes == 0)
+        {
+            // Running status lets the data bytes of the next channel message start straight away
+            if (runningStatus == 0)
+            {
+                count (statistics.droppedBytes);
+                return;
+            }
+
+            pendingStatus = runningStatus;
+            expectedDataBytes = getNumDataBytes (runningStatus);
+        }
+
+        dataBytes[numDataBytes++] = byte;
+
+        if (numDataBytes < expectedDataBytes)
+            return;
+
+        std::array<uint8_t, 3> message { pendingStatus, dataBytes[0], dataBytes[1] };
+        auto size = (size_t) (1 + expectedDataBytes);
+
+        numDataBytes = 0;
+        expectedDataBytes = 0;
+
+        count (statistics.messages);
+        onMessage (message.data(), size);
+    }
+
+    //==============================================================================
+    uint8_t runningStatus = 0;
+    uint8_t pendingStatus = 0;
+    int expectedDataBytes = 0;
+    int numDataBytes = 0;
+    std::array<uint8_t, 2> dataBytes {};
+
+    std::array<uint8_t, maxSysExSize> sysEx {};
+    size_t sysExSize = 0;
+    bool inSysEx = false;
+    bool sysExOverflowed = false;
+
+    Statistics statistics;
+};
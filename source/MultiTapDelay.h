@@ -0,0 +1,280 @@
+/*
+    Up to eight taps reading from one delay line, each with its own level, pan and tone.
+*/
+
+#pragma once
+#include <JuceHeader.h>
+#include "CustomDelay.h"
+
+//==============================================================================
+/** A mono delay line fed from the input's channels, read by several taps that are filtered and
+    panned onto the output. The last active tap feeds back into the line.
+
+    The taps are read a block at a time: every tap's span of the line is gathered into one
+    buffer, interleaved by sample, so filtering and mixing all the taps is a single pass over
+    contiguous memory instead of one modulo walk per tap. A tap shorter than the block falls
+    back to reading sample by sample.
+
+    A tap that changes its time crossfades from the old time to the new one over one block.
+*/
+template <typename Type, size_t maxNumTaps = 8>
+class MultiTapDelay
+{
+public:
+    MultiTapDelay()
+    {
+        for (size_t i = 0; i < maxNumTaps; ++i)
+            setTap (i, Type (0.25) * Type (i + 1), Type (1), Type (0), Type (8000));
+    }
+
+    //==============================================================================
+    void prepare (const juce::dsp::ProcessSpec& spec)
+    {
+        jassert (spec.numChannels <= 2);
+        sampleRate = (Type) spec.sampleRate;
+        maxBlockSize = spec.maximumBlockSize;
+
+        line.resize ((size_t) std::ceil (maxDelayTime * sampleRate));
+        gathered.assign (maxBlockSize * maxNumTaps, Type (0));
+        fadeBlock.assign (maxBlockSize, Type (0));
+        lineInput.assign (maxBlockSize, Type (0));
+
+        for (size_t i = 0; i < maxNumTaps; ++i)
+            updateTap (i);
+
+        previousDelays = delays;
+    }
+
+    void reset() noexcept
+    {
+        line.clear();
+        states.fill (Type (0));
+    }
+
+    //==============================================================================
+    /** Allocates, so only call it before prepare() */
+    void setMaxDelayTime (Type newValue)
+    {
+        jassert (newValue > Type (0));
+        maxDelayTime = newValue;
+    }
+
+    Type getMaxDelayTime() const noexcept       { return maxDelayTime; }
+
+    void setNumTaps (size_t newValue) noexcept
+    {
+        auto newNumTaps = juce::jlimit ((size_t) 1, maxNumTaps, newValue);
+
+        // Taps that drop out are silenced, so one that comes back starts from nothing rather than
+        // from whatever its filter held. Their samples are no longer gathered, so those are cleared too.
+        for (auto t = newNumTaps; t < numTaps; ++t)
+        {
+            states[t] = Type (0);
+
+            for (auto i = t; i < gathered.size(); i += maxNumTaps)
+                gathered[i] = Type (0);
+        }
+
+        numTaps = newNumTaps;
+    }
+
+    /** Pan runs from -1 (left) to 1 (right), the cutoff is a one pole low-pass */
+    void setTap (size_t index, Type timeInSeconds, Type level, Type pan, Type cutoffInHz) noexcept
+    {
+        jassert (index < maxNumTaps);
+        taps[index] = { timeInSeconds, level, juce::jlimit (Type (-1), Type (1), pan), cutoffInHz };
+        updateTap (index);
+    }
+
+    void setFeedback (Type newValue) noexcept
+    {
+        jassert (newValue >= Type (0) && newValue < Type (1));
+        feedback = newValue;
+    }
+
+    void setWetLevel (Type newValue) noexcept
+    {
+        jassert (newValue >= Type (0) && newValue <= Type (1));
+        wetLevel = newValue;
+    }
+
+    //==============================================================================
+    template <typename ProcessContext>
+    void process (const ProcessContext& context) noexcept
+    {
+        auto& inputBlock  = context.getInputBlock();
+        auto& outputBlock = context.getOutputBlock();
+        auto numSamples = outputBlock.getNumSamples();
+        auto numChannels = outputBlock.getNumChannels();
+
+        jassert (numSamples <= maxBlockSize && numChannels > 0);
+
+        // The line takes the channels' average
+        auto* mono = lineInput.data();
+        juce::FloatVectorOperations::copy (mono, inputBlock.getChannelPointer (0), (int) numSamples);
+
+        for (size_t ch = 1; ch < numChannels; ++ch)
+            juce::FloatVectorOperations::add (mono, inputBlock.getChannelPointer (ch), (int) numSamples);
+
+        if (numChannels > 1)
+            juce::FloatVectorOperations::multiply (mono, Type (1) / (Type) numChannels, (int) numSamples);
+
+        auto* left = outputBlock.getChannelPointer (0);
+        auto* right = numChannels > 1 ? outputBlock.getChannelPointer (1) : nullptr;
+
+        if (inputBlock.getChannelPointer (0) != left)
+            for (size_t ch = 0; ch < numChannels; ++ch)
+                juce::FloatVectorOperations::copy (outputBlock.getChannelPointer (ch), inputBlock.getChannelPointer (ch), (int) numSamples);
+
+        auto shortest = std::numeric_limits<size_t>::max();
+
+        for (size_t t = 0; t < numTaps; ++t)
+            shortest = juce::jmin (shortest, delays[t], previousDelays[t]);
+
+        if (shortest + 1 >= numSamples)
+            processBlock (mono, left, right, numSamples);
+        else
+            processSamples (mono, left, right, numSamples);
+
+        previousDelays = delays;
+    }
+
+private:
+    //==============================================================================
+    struct Tap
+    {
+        Type time, level, pan, cutoff;
+    };
+
+    void updateTap (size_t index) noexcept
+    {
+        auto& tap = taps[index];
+        auto maxDelay = line.size() > 1 ? line.size() - 1 : (size_t) 0;
+
+        delays[index] = (size_t) juce::jlimit ((Type) 0, (Type) maxDelay, tap.time * sampleRate - Type (1));
+        coefficients[index] = Type (1) - std::exp (-juce::MathConstants<Type>::twoPi * juce::jmin (tap.cutoff, sampleRate * Type (0.45)) / sampleRate);
+
+        // Constant power panning
+        auto angle = (tap.pan + Type (1)) * juce::MathConstants<Type>::pi / Type (4);
+        leftGains[index] = tap.level * std::cos (angle);
+        rightGains[index] = tap.level * std::sin (angle);
+    }
+
+    // Every tap's samples for the block, interleaved so gathered[i * maxNumTaps + t] is tap t at sample i
+    void gatherTaps (size_t numSamples) noexcept
+    {
+        for (size_t t = 0; t < numTaps; ++t)
+        {
+            auto* destination = gathered.data() + t;
+            auto spans = line.readBlock (delays[t], numSamples);
+            size_t i = 0;
+
+            for (size_t s = 0; s < 2; ++s)
+                for (size_t j = 0; j < spans.size[s]; ++j, ++i)
+                    destination[i * maxNumTaps] = spans.data[s][j];
+
+            if (previousDelays[t] == delays[t])
+                continue;
+
+            line.readBlock (previousDelays[t], numSamples).copyTo (fadeBlock.data());
+            auto step = Type (1) / (Type) numSamples;
+
+            for (i = 0; i < numSamples; ++i)
+            {
+                auto& sample = destination[i * maxNumTaps];
+                sample = fadeBlock[i] + (sample - fadeBlock[i]) * (Type) i * step;
+            }
+        }
+    }
+
+    // Filters the taps of one sample, mixes them onto the outputs and returns the feedback tap
+    Type mixTaps (const Type* tapSamples, Type* left, Type* right, size_t i) noexcept
+    {
+        Type sumLeft (0), sumRight (0);
+
+        for (size_t t = 0; t < maxNumTaps; ++t)
+        {
+            states[t] += coefficients[t] * (tapSamples[t] - states[t]);
+            sumLeft += states[t] * activeLeftGains[t];
+            sumRight += states[t] * activeRightGains[t];
+        }
+
+        if (right != nullptr)
+        {
+            left[i] += wetLevel * sumLeft;
+            right[i] += wetLevel * sumRight;
+        }
+        else
+        {
+            left[i] += wetLevel * (sumLeft + sumRight) * juce::MathConstants<Type>::sqrt2 * Type (0.5);
+        }
+
+        return states[numTaps - 1];
+    }
+
+    void updateActiveGains() noexcept
+    {
+        for (size_t t = 0; t < maxNumTaps; ++t)
+        {
+            activeLeftGains[t] = t < numTaps ? leftGains[t] : Type (0);
+            activeRightGains[t] = t < numTaps ? rightGains[t] : Type (0);
+        }
+    }
+
+    void processBlock (Type* mono, Type* left, Type* right, size_t numSamples) noexcept
+    {
+        gatherTaps (numSamples);
+        updateActiveGains();
+
+        // mono becomes the line's input in place, every tap was read before it is written
+        for (size_t i = 0; i < numSamples; ++i)
+        {
+            auto feedbackSample = mixTaps (gathered.data() + i * maxNumTaps, left, right, i);
+            mono[i] += feedback * feedbackSample;
+        }
+
+        saturator.process (mono, numSamples);
+        line.writeBlock (mono, numSamples);
+    }
+
+    void processSamples (Type* mono, Type* left, Type* right, size_t numSamples) noexcept
+    {
+        updateActiveGains();
+        std::array<Type, maxNumTaps> tapSamples {};
+        auto step = Type (1) / (Type) numSamples;
+
+        for (size_t i = 0; i < numSamples; ++i)
+        {
+            for (size_t t = 0; t < numTaps; ++t)
+            {
+                tapSamples[t] = line.get (delays[t]);
+
+                if (previousDelays[t] != delays[t])
+                {
+                    auto old = line.get (previousDelays[t]);
+                    tapSamples[t] = old + (tapSamples[t] - old) * (Type) i * step;
+                }
+            }
+
+            auto feedbackSample = mixTaps (tapSamples.data(), left, right, i);
+            line.push (saturator.processSample (mono[i] + feedback * feedbackSample));
+        }
+    }
+
+    //==============================================================================
+    MaskedDelayLine<Type> line;
+    std::vector<Type> gathered, fadeBlock, lineInput;
+    Saturator<Type> saturator;
+
+    std::array<Tap, maxNumTaps> taps;
+    std::array<size_t, maxNumTaps> delays {}, previousDelays {};
+    std::array<Type, maxNumTaps> coefficients {}, leftGains {}, rightGains {}, states {};
+    std::array<Type, maxNumTaps> activeLeftGains {}, activeRightGains {};
+    size_t numTaps = 4;
+
+    Type feedback { Type (0.3) };
+    Type wetLevel { Type (0.5) };
+    Type sampleRate { Type (44.1e3) };
+    Type maxDelayTime { Type (4) };
+    size_t maxBlockSize = 0;
+};
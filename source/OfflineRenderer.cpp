@@ -0,0 +1,158 @@
+/*
+    Streams a WAV file through the Processor chain without any audio hardware.
+*/
+
+#include "OfflineRenderer.h"
+#include <cstdlib>
+
+OfflineRenderer::OfflineRenderer(Processor& processor) : processorRef(processor)
+{
+}
+
+// The whole token has to be a number, getDoubleValue() would read a typo as 0
+static bool parseNumber(const juce::String& token, double& value)
+{
+    auto* text = token.toRawUTF8();
+    char* end = nullptr;
+    value = std::strtod(text, &end);
+    return end != text && *end == 0 && std::isfinite(value);
+}
+
+juce::Result OfflineRenderer::loadAutomation(const juce::File& file)
+{
+    if (! file.existsAsFile())
+        return juce::Result::fail("Automation file not found: " + file.getFullPathName());
+
+    juce::StringArray lines;
+    file.readLines(lines);
+
+    automation.clear();
+
+    for (int i = 0; i < lines.size(); ++i)
+    {
+        auto line = lines[i].trim();
+
+        if (line.isEmpty() || line.startsWithChar('#'))
+            continue;
+
+        auto tokens = juce::StringArray::fromTokens(line, false);
+        tokens.removeEmptyStrings();
+        auto parameterIndex = tokens.size() == 3 ? Processor::findParameterIndex(tokens[1]) : -1;
+        auto error = "Invalid automation on line " + juce::String(i + 1) + ": " + line;
+        double time, value;
+
+        if (parameterIndex < 0)
+            return juce::Result::fail(error);
+
+        if (! parseNumber(tokens[0], time) || time < 0.0)
+            return juce::Result::fail(error + " (the time is not a number of seconds)");
+
+        auto* parameter = processorRef.getParameterByIndex(parameterIndex);
+        auto range = parameter->getNormalisableRange();
+
+        if (! parseNumber(tokens[2], value) || value < range.start || value > range.end)
+            return juce::Result::fail(error + " (the value is not a number from " + juce::String(range.start) + " to " + juce::String(range.end) + ")");
+
+        automation.push_back({ time, parameterIndex, parameter->convertTo0to1((float) value) });
+    }
+
+    std::stable_sort(automation.begin(), automation.end(),
+                     [] (const AutomationEvent& a, const AutomationEvent& b) { return a.time < b.time; });
+
+    return juce::Result::ok();
+}
+
+juce::Result OfflineRenderer::render(const juce::File& inputFile, const juce::File& outputFile, int blockSize, double tailSeconds)
+{
+    if (blockSize <= 0)
+        return juce::Result::fail("Invalid block size");
+
+    juce::AudioFormatManager formatManager;
+    formatManager.registerBasicFormats();
+
+    std::unique_ptr<juce::AudioFormatReader> reader(formatManager.createReaderFor(inputFile));
+
+    if (reader == nullptr)
+        return juce::Result::fail("Could not read " + inputFile.getFullPathName());
+
+    auto sampleRate = reader->sampleRate;
+    auto numChannels = processorRef.getTotalNumOutputChannels();
+
+    outputFile.deleteFile();
+    std::unique_ptr<juce::OutputStream> stream(outputFile.createOutputStream());
+    juce::WavAudioFormat wavFormat;
+    std::unique_ptr<juce::AudioFormatWriter> writer;
+
+    if (stream != nullptr)
+        writer.reset(wavFormat.createWriterFor(stream.get(), sampleRate, (unsigned int) numChannels, 24, {}, 0));
+
+    if (writer == nullptr)
+        return juce::Result::fail("Could not write " + outputFile.getFullPathName());
+
+    stream.release(); // Now owned by the writer
+
+    processorRef.setNonRealtime(true);
+    processorRef.setRateAndBufferSizeDetails(sampleRate, blockSize);
+    processorRef.prepareToPlay(sampleRate, blockSize);
+
+    // Impulse responses are resampled in the background, without waiting the first blocks would
+    // go through whatever the convolution had before, depending on how the threads were scheduled
+    auto loaded = processorRef.waitForImpulseResponses(impulseResponseTimeoutMs);
+
+    if (loaded.failed())
+    {
+        processorRef.releaseResources();
+        return loaded;
+    }
+
+    juce::AudioBuffer<float> buffer(numChannels, blockSize);
+    juce::MidiBuffer midiMessages;
+
+    auto totalSamples = reader->lengthInSamples + (juce::int64) (tailSeconds * sampleRate);
+    juce::int64 position = 0;
+    size_t nextEvent = 0;
+    processingSeconds = 0.0;
+
+    while (position < totalSamples)
+    {
+        // Queue every change that is due, and cut the block short at the next one so it lands on its sample
+        while (nextEvent < automation.size() && (juce::int64) (automation[nextEvent].time * sampleRate) <= position)
+        {
+            // With the queue full, an empty block hands what is queued to the processor, and the
+            // rest follows on the same sample
+            if (! processorRef.pushParameterChange(automation[nextEvent].parameterIndex, automation[nextEvent].normalisedValue))
+            {
+                buffer.setSize(numChannels, 0, false, false, true);
+                processorRef.processBlock(buffer, midiMessages);
+                continue;
+            }
+
+            ++nextEvent;
+        }
+
+        auto numSamples = (int) juce::jmin((juce::int64) blockSize, totalSamples - position);
+
+        if (nextEvent < automation.size())
+            numSamples = (int) juce::jmin((juce::int64) numSamples, (juce::int64) (automation[nextEvent].time * sampleRate) - position);
+
+        buffer.setSize(numChannels, numSamples, false, false, true);
+        buffer.clear();
+        reader->read(&buffer, 0, numSamples, position, true, true);
+
+        if (reader->numChannels == 1)
+            for (int ch = 1; ch < numChannels; ++ch)
+                buffer.copyFrom(ch, 0, buffer, 0, 0, numSamples);
+
+        auto start = juce::Time::getHighResolutionTicks();
+        processorRef.processBlock(buffer, midiMessages);
+        processingSeconds += juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - start);
+
+        writer->writeFromAudioSampleBuffer(buffer, 0, numSamples);
+        position += numSamples;
+    }
+
+    processorRef.releaseResources();
+    renderedSeconds = (double) totalSamples / sampleRate;
+
+    return juce::Result::ok();
+}
@@ -0,0 +1,45 @@
+/*
+    Streams a WAV file through the Processor chain without any audio hardware,
+    for regression testing and profiling on build machines.
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "AudioProcessor.h"
+
+class OfflineRenderer
+{
+public:
+    explicit OfflineRenderer(Processor& processor);
+
+    /** Reads parameter automation, one change per line: <seconds> <PARAMETER ID> <value>
+        with the value in the parameter's own units. Lines starting with # are ignored.
+    */
+    juce::Result loadAutomation(const juce::File& file);
+
+    /** Renders the input file plus tailSeconds of silence, so delay and reverb tails end up in the output */
+    juce::Result render(const juce::File& inputFile, const juce::File& outputFile, int blockSize, double tailSeconds = 2.0);
+
+    double getRenderedSeconds() const noexcept { return renderedSeconds; }
+    double getProcessingSeconds() const noexcept { return processingSeconds; }
+
+    /** How many times faster than real time processBlock ran, file I/O excluded */
+    double getRealtimeFactor() const noexcept { return processingSeconds > 0.0 ? renderedSeconds / processingSeconds : 0.0; }
+
+private:
+    struct AutomationEvent
+    {
+        double time;
+        int parameterIndex;
+        float normalisedValue;
+    };
+
+    // Resampling a long impulse response on a Pi takes a few seconds
+    static constexpr int impulseResponseTimeoutMs = 30000;
+
+    Processor& processorRef;
+    std::vector<AutomationEvent> automation;
+    double renderedSeconds = 0.0;
+    double processingSeconds = 0.0;
+};
@@ -0,0 +1,73 @@
+/*
+    Single-producer/single-consumer queue used to hand parameter changes from the
+    control threads (serial reader, MIDI) to the audio thread without locking.
+*/
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+//==============================================================================
+/** A parameter change that has already been resolved to an index, so the audio
+    thread never has to look anything up by name.
+*/
+struct ParameterEvent
+{
+    uint16_t parameterIndex = 0;
+    uint32_t sampleOffset = 0;   // Position inside the next block, 0 = block start
+    float normalisedValue = 0.0f;
+};
+
+//==============================================================================
+/** Fixed capacity lock-free ring. push() may only be called from one thread and
+    pop() from one other thread. Nothing in here allocates or blocks.
+*/
+template <typename Type, size_t capacity>
+class SpscQueue
+{
+public:
+    static_assert (capacity >= 2 && (capacity & (capacity - 1)) == 0,
+                   "SpscQueue capacity must be a power of two");
+
+    /** Returns false if the queue is full, in which case the item is dropped. */
+    bool push (const Type& item) noexcept
+    {
+        auto write = writeIndex.load (std::memory_order_relaxed);
+
+        if (write - readIndex.load (std::memory_order_acquire) == capacity)
+            return false;
+
+        items[write & mask] = item;
+        writeIndex.store (write + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop (Type& item) noexcept
+    {
+        auto read = readIndex.load (std::memory_order_relaxed);
+
+        if (read == writeIndex.load (std::memory_order_acquire))
+            return false;
+
+        item = items[read & mask];
+        readIndex.store (read + 1, std::memory_order_release);
+        return true;
+    }
+
+    size_t getNumReady() const noexcept
+    {
+        return writeIndex.load (std::memory_order_acquire) - readIndex.load (std::memory_order_acquire);
+    }
+
+private:
+    static constexpr size_t mask = capacity - 1;
+
+    std::array<Type, capacity> items {};
+    alignas (64) std::atomic<size_t> writeIndex { 0 };
+    alignas (64) std::atomic<size_t> readIndex { 0 };
+};
+
+using ParameterQueue = SpscQueue<ParameterEvent, 256>;
@@ -0,0 +1,68 @@
+/*
+    Preset storage for program changes from the footswitch.
+*/
+
+#include "PresetBank.h"
+#include "AudioProcessor.h"
+
+int PresetBank::addPreset (std::unique_ptr<Preset> preset)
+{
+    jassert (preset != nullptr && preset->values.size() == Processor::numParameters);
+    presets.add (preset.release());
+    return presets.size() - 1;
+}
+
+juce::Result PresetBank::loadFromDirectory (const juce::File& directory, const Processor& processor)
+{
+    if (! directory.isDirectory())
+        return juce::Result::fail("Preset directory not found: " + directory.getFullPathName());
+
+    auto files = directory.findChildFiles(juce::File::findFiles, false, "*.xml");
+    files.sort();
+
+    for (auto& file : files)
+    {
+        auto xml = juce::XmlDocument::parse(file);
+
+        if (xml == nullptr)
+            return juce::Result::fail("Could not parse preset " + file.getFullPathName());
+
+        auto preset = createPreset(*xml, processor);
+
+        if (preset->name.isEmpty())
+            preset->name = file.getFileNameWithoutExtension();
+
+        addPreset(std::move(preset));
+    }
+
+    return juce::Result::ok();
+}
+
+std::unique_ptr<Preset> PresetBank::createPreset (const juce::XmlElement& state, const Processor& processor)
+{
+    auto preset = std::make_unique<Preset>();
+    preset->name = state.getStringAttribute("name");
+    preset->graph = state.getStringAttribute("graph");
+    preset->values.resize(Processor::numParameters);
+
+    for (int i = 0; i < Processor::numParameters; ++i)
+    {
+        auto* parameter = processor.getParameterByIndex(i);
+        preset->values[(size_t) i] = parameter->convertFrom0to1(parameter->getDefaultValue());
+    }
+
+    // The same PARAM children AudioProcessorValueTreeState writes
+    for (auto* child : state.getChildWithTagNameIterator("PARAM"))
+    {
+        auto index = Processor::findParameterIndex(child->getStringAttribute("id"));
+
+        if (index < 0)
+            continue;
+
+        auto* parameter = processor.getParameterByIndex(index);
+        auto value = (float) child->getDoubleAttribute("value");
+        preset->values[(size_t) index] = parameter->convertFrom0to1(parameter->convertTo0to1(value));
+    }
+
+    return preset;
+}
@@ -0,0 +1,44 @@
+/*
+    Preset storage for program changes from the footswitch.
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+class Processor;
+
+/** Every parameter value of a preset, already resolved, clamped and snapped to the
+    parameter ranges, indexed by Processor::ParameterIndex and in the parameters' own units.
+    Switching to it on the audio thread is a plain copy.
+*/
+struct Preset
+{
+    juce::String name;
+    std::vector<float> values;
+    juce::String graph;     // The effect order, empty to keep the current one
+};
+
+/** Presets are built on the control thread and never removed or changed afterwards,
+    so the audio thread can keep a pointer to one without locking.
+*/
+class PresetBank
+{
+public:
+    int size() const noexcept { return presets.size(); }
+    const Preset* getPreset (int index) const noexcept { return presets[index]; }
+
+    /** Appends a preset, returns its program number */
+    int addPreset (std::unique_ptr<Preset> preset);
+
+    /** Loads every .xml file in the directory, sorted by file name. The files hold the same
+        XML as Processor::getStateInformation(), with optional name and graph attributes.
+    */
+    juce::Result loadFromDirectory (const juce::File& directory, const Processor& processor);
+
+    /** Resolves a state XML into a preset, parameters it does not mention keep their defaults */
+    static std::unique_ptr<Preset> createPreset (const juce::XmlElement& state, const Processor& processor);
+
+private:
+    juce::OwnedArray<Preset> presets;
+};
@@ -0,0 +1,251 @@
+/*
+    Catches allocations, locks and blocking calls on the audio path, in builds with GUITARFX_RT_CHECKS.
+
+    The functions below are defined in the executable, so the dynamic linker binds every call to
+    them (from our code, libstdc++, JUCE and the rest) here instead of in libc. Each one checks
+    whether its thread is inside a section and then calls the real one. The allocator is reached
+    through glibc's __libc_ entry points, as looking it up with dlsym would allocate.
+
+    Nothing in here may include JuceHeader.h: it declares these functions with its own
+    exception specifications, and it would pull allocating code into the checks themselves.
+*/
+
+#include "RealtimeChecker.h"
+
+#if GUITARFX_RT_CHECKS
+
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <poll.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <time.h>
+#include <unistd.h>
+
+extern "C"
+{
+    void* __libc_malloc(size_t);
+    void* __libc_calloc(size_t, size_t);
+    void* __libc_realloc(void*, size_t);
+    void* __libc_memalign(size_t, size_t);
+    void __libc_free(void*);
+}
+
+// Initial-exec thread locals are plain offsets from the thread pointer, reading them never allocates
+#define GUITARFX_THREAD_LOCAL static thread_local __attribute__((tls_model("initial-exec")))
+
+GUITARFX_THREAD_LOCAL int sectionDepth = 0;
+GUITARFX_THREAD_LOCAL bool reporting = false;
+
+static std::atomic<int> numViolations { 0 };
+
+// Only the first of these get a stack trace, after that they are just counted
+static constexpr int maxReportedViolations = 32;
+static constexpr int maxStackDepth = 32;
+
+static void report(const char* function, size_t size = 0)
+{
+    reporting = true;
+    auto count = numViolations.fetch_add(1, std::memory_order_relaxed) + 1;
+
+    if (count <= maxReportedViolations)
+    {
+        char message[160];
+        auto length = size > 0 ? std::snprintf(message, sizeof(message), "Real-time violation %d: %s(%zu) on the audio path\n", count, function, size)
+                               : std::snprintf(message, sizeof(message), "Real-time violation %d: %s() on the audio path\n", count, function);
+
+        if (length > 0)
+            (void) ::write(STDERR_FILENO, message, (size_t) (length < (int) sizeof(message) ? length : (int) sizeof(message) - 1));
+
+        // Skips this function, the trace starts at the interposed call
+        void* stack[maxStackDepth];
+        auto depth = backtrace(stack, maxStackDepth);
+        backtrace_symbols_fd(stack + 1, depth - 1, STDERR_FILENO);
+
+        if (count == maxReportedViolations)
+        {
+            static const char last[] = "Further real-time violations are only counted\n";
+            (void) ::write(STDERR_FILENO, last, sizeof(last) - 1);
+        }
+    }
+
+    reporting = false;
+}
+
+static inline void check(const char* function, size_t size = 0)
+{
+    if (sectionDepth > 0 && ! reporting)
+        report(function, size);
+}
+
+// The real function behind an interposed one, looked up once. A plain atomic rather than a
+// function-local static object, whose initialisation guard could end up back in pthread_mutex_lock.
+static void* getReal(std::atomic<void*>& cached, const char* name) noexcept
+{
+    auto* function = cached.load(std::memory_order_acquire);
+
+    if (function == nullptr)
+    {
+        function = dlsym(RTLD_NEXT, name);
+        cached.store(function, std::memory_order_release);
+    }
+
+    return function;
+}
+
+//==============================================================================
+RealtimeChecker::ScopedSection::ScopedSection() noexcept    { ++sectionDepth; }
+RealtimeChecker::ScopedSection::~ScopedSection()            { --sectionDepth; }
+
+int RealtimeChecker::getNumViolations() noexcept
+{
+    return numViolations.load(std::memory_order_relaxed);
+}
+
+//==============================================================================
+extern "C"
+{
+    void* malloc(size_t size) noexcept
+    {
+        check("malloc", size);
+        return __libc_malloc(size);
+    }
+
+    void* calloc(size_t count, size_t size) noexcept
+    {
+        check("calloc", count * size);
+        return __libc_calloc(count, size);
+    }
+
+    void* realloc(void* pointer, size_t size) noexcept
+    {
+        check("realloc", size);
+        return __libc_realloc(pointer, size);
+    }
+
+    void free(void* pointer) noexcept
+    {
+        if (pointer != nullptr)
+            check("free");
+
+        __libc_free(pointer);
+    }
+
+    void* memalign(size_t alignment, size_t size) noexcept
+    {
+        check("memalign", size);
+        return __libc_memalign(alignment, size);
+    }
+
+    void* aligned_alloc(size_t alignment, size_t size) noexcept
+    {
+        check("aligned_alloc", size);
+        return __libc_memalign(alignment, size);
+    }
+
+    int posix_memalign(void** result, size_t alignment, size_t size) noexcept
+    {
+        check("posix_memalign", size);
+
+        if (alignment % sizeof(void*) != 0 || (alignment & (alignment - 1)) != 0)
+            return EINVAL;
+
+        auto* pointer = __libc_memalign(alignment, size);
+
+        if (pointer == nullptr)
+            return ENOMEM;
+
+        *result = pointer;
+        return 0;
+    }
+
+    int pthread_mutex_lock(pthread_mutex_t* mutex) noexcept
+    {
+        check("pthread_mutex_lock");
+        static std::atomic<void*> real { nullptr };
+        return reinterpret_cast<int (*)(pthread_mutex_t*)>(getReal(real, "pthread_mutex_lock"))(mutex);
+    }
+
+    int pthread_rwlock_rdlock(pthread_rwlock_t* lock) noexcept
+    {
+        check("pthread_rwlock_rdlock");
+        static std::atomic<void*> real { nullptr };
+        return reinterpret_cast<int (*)(pthread_rwlock_t*)>(getReal(real, "pthread_rwlock_rdlock"))(lock);
+    }
+
+    int pthread_rwlock_wrlock(pthread_rwlock_t* lock) noexcept
+    {
+        check("pthread_rwlock_wrlock");
+        static std::atomic<void*> real { nullptr };
+        return reinterpret_cast<int (*)(pthread_rwlock_t*)>(getReal(real, "pthread_rwlock_wrlock"))(lock);
+    }
+
+    int pthread_cond_wait(pthread_cond_t* condition, pthread_mutex_t* mutex)
+    {
+        check("pthread_cond_wait");
+        static std::atomic<void*> real { nullptr };
+        return reinterpret_cast<int (*)(pthread_cond_t*, pthread_mutex_t*)>(getReal(real, "pthread_cond_wait"))(condition, mutex);
+    }
+
+    int pthread_cond_timedwait(pthread_cond_t* condition, pthread_mutex_t* mutex, const struct timespec* time)
+    {
+        check("pthread_cond_timedwait");
+        static std::atomic<void*> real { nullptr };
+        return reinterpret_cast<int (*)(pthread_cond_t*, pthread_mutex_t*, const struct timespec*)>(getReal(real, "pthread_cond_timedwait"))(condition, mutex, time);
+    }
+
+    int sem_wait(sem_t* semaphore)
+    {
+        check("sem_wait");
+        static std::atomic<void*> real { nullptr };
+        return reinterpret_cast<int (*)(sem_t*)>(getReal(real, "sem_wait"))(semaphore);
+    }
+
+    int nanosleep(const struct timespec* duration, struct timespec* remaining)
+    {
+        check("nanosleep");
+        static std::atomic<void*> real { nullptr };
+        return reinterpret_cast<int (*)(const struct timespec*, struct timespec*)>(getReal(real, "nanosleep"))(duration, remaining);
+    }
+
+    int usleep(useconds_t microseconds)
+    {
+        check("usleep");
+        static std::atomic<void*> real { nullptr };
+        return reinterpret_cast<int (*)(useconds_t)>(getReal(real, "usleep"))(microseconds);
+    }
+
+    ssize_t read(int file, void* buffer, size_t size)
+    {
+        check("read", size);
+        static std::atomic<void*> real { nullptr };
+        return reinterpret_cast<ssize_t (*)(int, void*, size_t)>(getReal(real, "read"))(file, buffer, size);
+    }
+
+    ssize_t write(int file, const void* buffer, size_t size)
+    {
+        check("write", size);
+        static std::atomic<void*> real { nullptr };
+        return reinterpret_cast<ssize_t (*)(int, const void*, size_t)>(getReal(real, "write"))(file, buffer, size);
+    }
+
+    int poll(struct pollfd* files, nfds_t numFiles, int timeout)
+    {
+        check("poll");
+        static std::atomic<void*> real { nullptr };
+        return reinterpret_cast<int (*)(struct pollfd*, nfds_t, int)>(getReal(real, "poll"))(files, numFiles, timeout);
+    }
+
+    int fsync(int file)
+    {
+        check("fsync");
+        static std::atomic<void*> real { nullptr };
+        return reinterpret_cast<int (*)(int)>(getReal(real, "fsync"))(file);
+    }
+}
+
+#endif
@@ -0,0 +1,46 @@
+/*
+    Catches allocations, locks and blocking calls on the audio path, in builds with GUITARFX_RT_CHECKS.
+*/
+
+#pragma once
+
+#ifndef GUITARFX_RT_CHECKS
+ #define GUITARFX_RT_CHECKS 0
+#endif
+
+/** With GUITARFX_RT_CHECKS on, the executable interposes malloc and the rest of the allocator,
+    mutex, condition variable and semaphore waits, sleeps and blocking I/O. A call to any of them
+    from a thread inside a ScopedSection is counted and reported on stderr with a stack trace,
+    and the call then goes ahead as normal.
+
+    Without GUITARFX_RT_CHECKS a section is empty and compiles away, and there are never any
+    violations. The checks need glibc, and link the executable with -rdynamic so the stack traces
+    have names in them.
+*/
+class RealtimeChecker
+{
+public:
+    /** Marks the calling thread as being on the audio path for as long as it exists. Sections nest. */
+    class ScopedSection
+    {
+    public:
+       #if GUITARFX_RT_CHECKS
+        ScopedSection() noexcept;
+        ~ScopedSection();
+       #else
+        ScopedSection() noexcept {}
+       #endif
+
+        ScopedSection(const ScopedSection&) = delete;
+        ScopedSection& operator=(const ScopedSection&) = delete;
+    };
+
+    static constexpr bool isEnabled() noexcept { return GUITARFX_RT_CHECKS != 0; }
+
+    /** Every violation in any thread since the start */
+   #if GUITARFX_RT_CHECKS
+    static int getNumViolations() noexcept;
+   #else
+    static int getNumViolations() noexcept { return 0; }
+   #endif
+};
@@ -0,0 +1,165 @@
+/*
+    Fork-join worker pool for running independent parts of the audio callback on the other cores.
+*/
+
+#include "RealtimeThreadPool.h"
+#include "RealtimeChecker.h"
+#include <climits>
+#include <linux/futex.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Roughly 10-50 us depending on the core, which covers the gap between the parts of one callback
+static constexpr int spinIterations = 4000;
+
+static void cpuRelax() noexcept
+{
+   #if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+   #elif defined(__aarch64__) || defined(__arm__)
+    asm volatile("yield");
+   #endif
+}
+
+static uint32_t* getFutexWord(std::atomic<uint32_t>& word) noexcept
+{
+    static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "The futex needs a plain 32 bit word");
+    return reinterpret_cast<uint32_t*>(&word);
+}
+
+RealtimeThreadPool::RealtimeThreadPool(int numWorkers, int priority, int firstCore)
+{
+    auto numCores = (int) std::thread::hardware_concurrency();
+
+    for (int i = 0; i < numWorkers; ++i)
+        workers.emplace_back(&RealtimeThreadPool::workerThread, this, numCores > 0 ? (firstCore + i) % numCores : -1, priority);
+}
+
+RealtimeThreadPool::~RealtimeThreadPool()
+{
+    stop = true;
+    wakeGeneration.fetch_add(1);
+    syscall(SYS_futex, getFutexWord(wakeGeneration), FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+
+    for (auto& worker : workers)
+        worker.join();
+}
+
+//==============================================================================
+void RealtimeThreadPool::runTasks(size_t numTasks, const void* context, TaskFunction function) noexcept
+{
+    jassert(numTasks <= taskMask);
+
+    // Published by the release store of the claim word, the workers only read them after a successful claim
+    taskContext = context;
+    taskFunction = function;
+    remainingTasks.store(numTasks, std::memory_order_relaxed);
+
+    ++generation;
+    claim.store(((uint64_t) generation << 32) | ((uint64_t) numTasks << 16), std::memory_order_release);
+
+    // A worker about to sleep either sees the new generation or gets woken
+    wakeGeneration.store(generation);
+
+    if (numSleeping.load() > 0)
+        syscall(SYS_futex, getFutexWord(wakeGeneration), FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+
+    // The calling thread works too, then waits for the tasks still running elsewhere without ever sleeping
+    while (claimAndRunTask(generation))
+    {
+    }
+
+    while (remainingTasks.load(std::memory_order_acquire) > 0)
+        cpuRelax();
+}
+
+bool RealtimeThreadPool::claimAndRunTask(uint32_t expectedGeneration) noexcept
+{
+    auto current = claim.load(std::memory_order_acquire);
+
+    for (;;)
+    {
+        auto numTasks = (current >> 16) & taskMask;
+        auto next = current & taskMask;
+
+        if ((uint32_t) (current >> 32) != expectedGeneration || next >= numTasks)
+            return false;
+
+        if (claim.compare_exchange_weak(current, current + 1, std::memory_order_acq_rel, std::memory_order_acquire))
+        {
+            // The job stays put until this task is counted off. Tasks are part of the callback, so they get checked.
+            RealtimeChecker::ScopedSection realtimeSection;
+            taskFunction(taskContext, (size_t) next);
+            remainingTasks.fetch_sub(1, std::memory_order_acq_rel);
+            return true;
+        }
+    }
+}
+
+//==============================================================================
+bool RealtimeThreadPool::setCurrentThreadRealtime(int core, int priority) noexcept
+{
+    if (core >= 0)
+    {
+        cpu_set_t cores;
+        CPU_ZERO(&cores);
+        CPU_SET(core, &cores);
+
+        if (pthread_setaffinity_np(pthread_self(), sizeof(cores), &cores) != 0)
+            DBG("Could not pin audio thread to core " << core);
+    }
+
+    sched_param parameters {};
+    parameters.sched_priority = priority;
+
+    return pthread_setschedparam(pthread_self(), SCHED_FIFO, &parameters) == 0;
+}
+
+void RealtimeThreadPool::workerThread(int core, int priority)
+{
+    if (! setCurrentThreadRealtime(core, priority))
+        DBG("Could not make audio worker SCHED_FIFO, it needs CAP_SYS_NICE or an rtprio limit");
+
+    // Same floating point behaviour as the audio thread, or the results would not match the serial path
+    juce::FloatVectorOperations::disableDenormalisedNumberSupport();
+
+    uint32_t seenGeneration = 0;
+
+    while (! stop.load(std::memory_order_relaxed))
+    {
+        auto current = (uint32_t) (claim.load(std::memory_order_acquire) >> 32);
+
+        if (current != seenGeneration)
+        {
+            seenGeneration = current;
+
+            while (claimAndRunTask(current))
+            {
+            }
+
+            continue;
+        }
+
+        // Nothing new: spin for a while, as the next job usually follows within the same callback
+        auto spins = 0;
+
+        while (spins < spinIterations && (uint32_t) (claim.load(std::memory_order_relaxed) >> 32) == seenGeneration
+               && ! stop.load(std::memory_order_relaxed))
+        {
+            cpuRelax();
+            ++spins;
+        }
+
+        if (spins < spinIterations)
+            continue;
+
+        // Then park until the next job, the futex returns straight away if one came in meanwhile
+        numSleeping.fetch_add(1);
+
+        if ((uint32_t) (claim.load() >> 32) == seenGeneration && ! stop.load())
+            syscall(SYS_futex, getFutexWord(wakeGeneration), FUTEX_WAIT_PRIVATE, seenGeneration, nullptr, nullptr, 0);
+
+        numSleeping.fetch_sub(1);
+    }
+}
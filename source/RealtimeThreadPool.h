@@ -0,0 +1,72 @@
+/*
+    Fork-join worker pool for running independent parts of the audio callback on the other cores.
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+/** Workers are pinned to their own cores and run SCHED_FIFO when the system allows it.
+    Between callbacks they spin for a short while and then sleep on a futex, so a pool
+    that is not used costs nothing.
+
+    run() splits a job into numbered tasks which the workers and the calling thread claim
+    one at a time, and returns once they are all done. The tasks have to write to separate
+    data, then the result does not depend on which thread ran what. Nothing in run()
+    allocates or locks, waking a sleeping worker is one futex syscall.
+*/
+class RealtimeThreadPool
+{
+public:
+    /** priority is the SCHED_FIFO priority, worker n goes on core firstCore + n */
+    explicit RealtimeThreadPool(int numWorkers, int priority = 70, int firstCore = 1);
+    ~RealtimeThreadPool();
+
+    int getNumWorkers() const noexcept { return (int) workers.size(); }
+
+    /** Pins the calling thread to core (-1 leaves it free) and makes it SCHED_FIFO at priority.
+        Returns false if the scheduler refused, which needs CAP_SYS_NICE or an rtprio limit.
+    */
+    static bool setCurrentThreadRealtime(int core, int priority) noexcept;
+
+    /** Calls task (size_t index) for every index below numTasks. Only one thread may call this at a time. */
+    template <typename Task>
+    void run(size_t numTasks, const Task& task) noexcept
+    {
+        if (numTasks <= 1 || workers.empty())
+        {
+            for (size_t i = 0; i < numTasks; ++i)
+                task(i);
+
+            return;
+        }
+
+        runTasks(numTasks, &task, [](const void* context, size_t index) { (*static_cast<const Task*>(context))(index); });
+    }
+
+private:
+    using TaskFunction = void (*)(const void*, size_t);
+
+    // The claim word holds the job's generation in the top 32 bits, its number of tasks in the
+    // next 16 and the next unclaimed task in the bottom 16, so a claim can never mix up two jobs
+    static constexpr uint64_t taskMask = 0xffff;
+
+    void runTasks(size_t numTasks, const void* context, TaskFunction function) noexcept;
+    bool claimAndRunTask(uint32_t generation) noexcept;
+    void workerThread(int core, int priority);
+
+    std::vector<std::thread> workers;
+
+    alignas(64) std::atomic<uint64_t> claim { 0 };
+    alignas(64) std::atomic<uint32_t> wakeGeneration { 0 };     // The futex word
+    std::atomic<uint32_t> numSleeping { 0 };
+    alignas(64) std::atomic<size_t> remainingTasks { 0 };
+    std::atomic<bool> stop { false };
+
+    const void* taskContext = nullptr;
+    TaskFunction taskFunction = nullptr;
+    uint32_t generation = 0;
+};
@@ -0,0 +1,179 @@
+/*
+    Runs several players' rigs, each a Processor of its own, from one multichannel interface.
+*/
+
+#include "RigHost.h"
+#include "RealtimeChecker.h"
+
+RigHost::BusesProperties RigHost::getBuses(const std::vector<RigOptions>& rigOptions)
+{
+    auto numInputs = 1;
+
+    for (auto& options : rigOptions)
+        numInputs = juce::jmax(numInputs, options.inputChannel + 1);
+
+    return BusesProperties()
+        .withInput("Input", juce::AudioChannelSet::discreteChannels(numInputs), true)
+        .withOutput("Output", juce::AudioChannelSet::discreteChannels(2 * juce::jmax(1, (int) rigOptions.size())), true);
+}
+
+RigHost::RigHost(const std::vector<RigOptions>& rigOptions)
+    : juce::AudioProcessor(getBuses(rigOptions))
+{
+    for (auto& options : rigOptions)
+    {
+        auto rig = std::make_unique<Rig>();
+        rig->options = options;
+        rig->processor = std::make_unique<Processor>();
+        rigs.push_back(std::move(rig));
+    }
+}
+
+RigHost::~RigHost() = default;
+
+juce::StringArray RigHost::getSerialPorts() const
+{
+    juce::StringArray ports;
+
+    for (auto& rig : rigs)
+        if (rig->options.serialPort.isNotEmpty())
+            ports.addIfNotAlreadyThere(rig->options.serialPort);
+
+    return ports;
+}
+
+bool RigHost::listensTo(int midiChannel, const juce::uint8* message) noexcept
+{
+    // System messages such as the clock have no channel and reach every rig
+    return midiChannel == 0 || message[0] >= 0xf0 || (message[0] & 0x0f) + 1 == midiChannel;
+}
+
+void RigHost::handleMidiMessage(const juce::String& serialPort, const juce::MidiMessage& message)
+{
+    for (auto& rig : rigs)
+        if (rig->options.serialPort == serialPort && listensTo(rig->options.midiChannel, message.getRawData()))
+            rig->processor->handleMidiMessage(message);
+}
+
+//==============================================================================
+void RigHost::prepareToPlay(double sampleRate, int samplesPerBlock)
+{
+    maxBlockSize = juce::jmax(1, samplesPerBlock);
+
+    for (auto& rig : rigs)
+    {
+        rig->buffer.setSize(2, maxBlockSize);
+        rig->midiMessages.ensureSize(midiBufferSize);
+        rig->processor->setRateAndBufferSizeDetails(sampleRate, maxBlockSize);
+        rig->processor->prepareToPlay(sampleRate, maxBlockSize);
+    }
+}
+
+void RigHost::releaseResources()
+{
+    for (auto& rig : rigs)
+        rig->processor->releaseResources();
+}
+
+// Whatever the device offers, the rigs whose channels it does not have stay silent
+bool RigHost::isBusesLayoutSupported(const BusesLayout&) const
+{
+    return true;
+}
+
+double RigHost::getTailLengthSeconds() const
+{
+    auto tail = 0.0;
+
+    for (auto& rig : rigs)
+        tail = juce::jmax(tail, rig->processor->getTailLengthSeconds());
+
+    return tail;
+}
+
+void RigHost::processBlock(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
+{
+    juce::ScopedNoDenormals noDenormals;
+    RealtimeChecker::ScopedSection realtimeSection;
+    auto* pool = threadPool.load(std::memory_order_relaxed);
+    auto numChannels = buffer.getNumChannels();
+
+    // A block longer than the rigs were prepared for goes through in pieces
+    for (int startSample = 0; startSample < buffer.getNumSamples(); startSample += maxBlockSize)
+    {
+        auto numSamples = juce::jmin(maxBlockSize, buffer.getNumSamples() - startSample);
+        auto task = [this, &buffer, &midiMessages, startSample, numSamples](size_t index)
+        {
+            processRig(*rigs[index], buffer, midiMessages, startSample, numSamples);
+        };
+
+        if (pool != nullptr)
+            pool->run(rigs.size(), task);
+        else
+            for (size_t i = 0; i < rigs.size(); ++i)
+                task(i);
+
+        // Every rig has read its input, so the outputs can go over the input channels now
+        for (size_t i = 0; i < rigs.size(); ++i)
+            for (int ch = 0; ch < 2 && (int) i * 2 + ch < numChannels; ++ch)
+                buffer.copyFrom((int) i * 2 + ch, startSample, rigs[i]->buffer, ch, 0, numSamples);
+    }
+
+    // Channels past the rigs' outputs only held inputs
+    for (auto ch = 2 * (int) rigs.size(); ch < numChannels; ++ch)
+        buffer.clear(ch, 0, buffer.getNumSamples());
+}
+
+void RigHost::processRig(Rig& rig, const juce::AudioBuffer<float>& buffer, const juce::MidiBuffer& midiMessages,
+                         int startSample, int numSamples) noexcept
+{
+    if (rig.options.inputChannel < buffer.getNumChannels())
+        rig.buffer.copyFrom(0, 0, buffer, rig.options.inputChannel, startSample, numSamples);
+    else
+        rig.buffer.clear(0, 0, numSamples);
+
+    rig.buffer.copyFrom(1, 0, rig.buffer, 0, 0, numSamples);
+
+    // The buffer was made room for in prepareToPlay(), so this does not allocate unless a block is crowded
+    rig.midiMessages.clear();
+
+    for (const auto metadata : midiMessages)
+        if (metadata.samplePosition >= startSample && metadata.samplePosition < startSample + numSamples
+             && listensTo(rig.options.midiChannel, metadata.data))
+            rig.midiMessages.addEvent(metadata.data, metadata.numBytes, metadata.samplePosition - startSample);
+
+    // Refers to the rig's buffer without copying, a block's worth of it
+    juce::AudioBuffer<float> block(rig.buffer.getArrayOfWritePointers(), 2, numSamples);
+    rig.processor->processBlock(block, rig.midiMessages);
+}
+
+//==============================================================================
+void RigHost::getStateInformation(juce::MemoryBlock& destData)
+{
+    juce::MemoryOutputStream stream(destData, false);
+
+    for (auto& rig : rigs)
+    {
+        juce::MemoryBlock state;
+        rig->processor->getStateInformation(state);
+        stream.writeInt((int) state.getSize());
+        stream.write(state.getData(), state.getSize());
+    }
+}
+
+void RigHost::setStateInformation(const void* data, int sizeInBytes)
+{
+    juce::MemoryInputStream stream(data, (size_t) sizeInBytes, false);
+
+    for (auto& rig : rigs)
+    {
+        auto size = stream.readInt();
+
+        if (size <= 0 || size > stream.getNumBytesRemaining())
+            return;
+
+        juce::MemoryBlock state;
+        stream.readIntoMemoryBlock(state, size);
+        rig->processor->setStateInformation(state.getData(), (int) state.getSize());
+    }
+}
@@ -0,0 +1,102 @@
+/*
+    Runs several players' rigs, each a Processor of its own, from one multichannel interface.
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "AudioProcessor.h"
+
+/** Every rig takes one input channel of the device, which goes to both of its channels like the
+    single rig's mono input does, and plays out on its own pair of outputs: rig n on 2n and 2n + 1.
+    The host's layout is as many inputs as the highest input channel in use and two outputs per rig,
+    so it plugs into the AudioProcessorPlayer or the AlsaAudioBackend like a single Processor.
+
+    The rigs are the unit of parallelism. With a thread pool every callback hands the rigs out
+    to the audio thread and the workers, so adding a rig adds a core's worth of headroom instead
+    of queueing behind the others on one thread. Each rig works in a buffer of its own and the
+    outputs are only written once every rig has read its input, so a rig can read any input channel.
+    The rigs' processors get no pool of their own, as only one thread may run the pool at a time.
+
+    Each rig also has its own controls: MIDI in the block and messages from the serial port it is on
+    reach it if they are on its MIDI channel, or 0 for all channels. Clock and other system messages
+    reach every rig.
+*/
+class RigHost : public juce::AudioProcessor
+{
+public:
+    struct RigOptions
+    {
+        int inputChannel = 0;
+        int midiChannel = 0;            // 1-16, 0 for all channels
+        juce::String serialPort;        // Empty when the rig has no controller of its own
+    };
+
+    explicit RigHost(const std::vector<RigOptions>& rigOptions);
+    ~RigHost() override;
+
+    int getNumRigs() const noexcept { return (int) rigs.size(); }
+    Processor& getRig(int index) noexcept { return *rigs[(size_t) index]->processor; }
+    const RigOptions& getRigOptions(int index) const noexcept { return rigs[(size_t) index]->options; }
+
+    /** The serial ports the rigs are on, each once */
+    juce::StringArray getSerialPorts() const;
+
+    /** Hands a message from the reader of serialPort to the rigs on that port that listen on its channel.
+        Each port has one reader thread, so each rig's processor still has a single control thread.
+    */
+    void handleMidiMessage(const juce::String& serialPort, const juce::MidiMessage& message);
+
+    /** Spreads the rigs over other cores, null runs them one after the other on the audio thread.
+        The pool has to outlive the host's use of it.
+    */
+    void setThreadPool(RealtimeThreadPool* newPool) noexcept { threadPool.store(newPool); }
+
+    //==============================================================================
+    void prepareToPlay(double sampleRate, int samplesPerBlock) override;
+    void releaseResources() override;
+    bool isBusesLayoutSupported(const BusesLayout& layouts) const override;
+    void processBlock(juce::AudioBuffer<float>&, juce::MidiBuffer&) override;
+
+    juce::AudioProcessorEditor* createEditor() override { return nullptr; }
+    bool hasEditor() const override { return false; }
+
+    const juce::String getName() const override { return "GuitarFX rigs"; }
+    bool acceptsMidi() const override { return true; }
+    bool producesMidi() const override { return false; }
+    double getTailLengthSeconds() const override;
+
+    // Programs belong to the rigs, each switches its own from its controller
+    int getNumPrograms() override { return 1; }
+    int getCurrentProgram() override { return 0; }
+    void setCurrentProgram(int) override {}
+    const juce::String getProgramName(int) override { return {}; }
+    void changeProgramName(int, const juce::String&) override {}
+
+    // Every rig's state one after the other, each preceded by its size
+    void getStateInformation(juce::MemoryBlock& destData) override;
+    void setStateInformation(const void* data, int sizeInBytes) override;
+
+private:
+    struct Rig
+    {
+        RigOptions options;
+        std::unique_ptr<Processor> processor;
+        juce::AudioBuffer<float> buffer;
+        juce::MidiBuffer midiMessages;
+    };
+
+    static bool listensTo(int midiChannel, const juce::uint8* message) noexcept;
+    static BusesProperties getBuses(const std::vector<RigOptions>& rigOptions);
+
+    // Reads the rig's input and runs its processor, the output stays in the rig's buffer
+    void processRig(Rig& rig, const juce::AudioBuffer<float>& buffer, const juce::MidiBuffer& midiMessages,
+                    int startSample, int numSamples) noexcept;
+
+    std::vector<std::unique_ptr<Rig>> rigs;
+    std::atomic<RealtimeThreadPool*> threadPool { nullptr };
+    int maxBlockSize = 0;
+
+    // Room for this many bytes of MIDI per rig and block before the rig's buffer has to grow
+    static constexpr int midiBufferSize = 2048;
+};
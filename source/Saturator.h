@@ -0,0 +1,109 @@
+/*
+    Cheaper stand-ins for std::tanh, used to saturate the Delay feedback path.
+*/
+
+#pragma once
+#include <JuceHeader.h>
+
+//==============================================================================
+enum class SaturationType
+{
+    tanh,           // std::tanh, the reference
+    pade,           // [7/6] Pade approximant of tanh, within 1e-4 of it
+    lookupTable,    // Linearly interpolated table of tanh
+    hardClip        // Clips to -1..1
+};
+
+//==============================================================================
+template <typename Type>
+class Saturator
+{
+public:
+    Saturator()
+    {
+        for (size_t i = 0; i < table.size(); ++i)
+            table[i] = std::tanh ((Type) i / tableScale - tableRange);
+    }
+
+    //==============================================================================
+    void setType (SaturationType newValue) noexcept
+    {
+        type = newValue;
+    }
+
+    SaturationType getType() const noexcept
+    {
+        return type;
+    }
+
+    //==============================================================================
+    Type processSample (Type x) const noexcept
+    {
+        switch (type)
+        {
+            case SaturationType::pade:          return pade (x);
+            case SaturationType::lookupTable:   return lookup (x);
+            case SaturationType::hardClip:      return juce::jlimit (Type (-1), Type (1), x);
+            case SaturationType::tanh:
+            default:                            return std::tanh (x);
+        }
+    }
+
+    /** Saturates a block in place. The loops are kept branch free so the compiler can
+        vectorise them, hard clipping goes through FloatVectorOperations.
+    */
+    void process (Type* data, size_t numSamples) const noexcept
+    {
+        switch (type)
+        {
+            case SaturationType::pade:
+                for (size_t i = 0; i < numSamples; ++i)
+                    data[i] = pade (data[i]);
+                break;
+
+            case SaturationType::lookupTable:
+                for (size_t i = 0; i < numSamples; ++i)
+                    data[i] = lookup (data[i]);
+                break;
+
+            case SaturationType::hardClip:
+                juce::FloatVectorOperations::clip (data, data, Type (-1), Type (1), (int) numSamples);
+                break;
+
+            case SaturationType::tanh:
+            default:
+                for (size_t i = 0; i < numSamples; ++i)
+                    data[i] = std::tanh (data[i]);
+                break;
+        }
+    }
+
+private:
+    //==============================================================================
+    // The approximant reaches 1 just below 5, clamping the input there keeps it monotonic
+    static Type pade (Type x) noexcept
+    {
+        x = juce::jlimit (Type (-4.97), Type (4.97), x);
+        auto x2 = x * x;
+        auto numerator = x * (Type (135135) + x2 * (Type (17325) + x2 * (Type (378) + x2)));
+        auto denominator = Type (135135) + x2 * (Type (62370) + x2 * (Type (3150) + x2 * Type (28)));
+        return juce::jlimit (Type (-1), Type (1), numerator / denominator);
+    }
+
+    Type lookup (Type x) const noexcept
+    {
+        auto position = (juce::jlimit (-tableRange, tableRange, x) + tableRange) * tableScale;
+        auto index = (size_t) position;
+        auto fraction = position - (Type) index;
+        index = juce::jmin (index, tableSize - 1);
+        return table[index] + fraction * (table[index + 1] - table[index]);
+    }
+
+    //==============================================================================
+    static constexpr size_t tableSize = 2048;
+    static constexpr Type tableRange = Type (5);
+    static constexpr Type tableScale = Type (tableSize) / (Type (2) * tableRange);
+
+    std::array<Type, tableSize + 1> table;
+    SaturationType type = SaturationType::pade;
+};
@@ -0,0 +1,259 @@
+/*
+    Level and pitch analysis of the input, shared by the noise gate and the tuner.
+*/
+
+#include "SignalAnalyser.h"
+
+// Zero padded so the correlation of windowSize against historySize does not wrap around
+static constexpr int fftOrder = 12;
+static constexpr int fftSize = 1 << fftOrder;
+static_assert (fftSize >= SignalAnalyser::historySize + SignalAnalyser::windowSize, "The FFT is too short for a linear correlation");
+
+// The YIN threshold on the normalised difference, lower only takes cleaner notes
+static constexpr float yinThreshold = 0.15f;
+
+SignalAnalyser::SignalAnalyser()
+    : fft (fftOrder)
+{
+}
+
+//==============================================================================
+void SignalAnalyser::prepare (double newSampleRate)
+{
+    sampleRate = newSampleRate;
+    envelopeRelease = (float) std::exp (-1.0 / (0.05 * sampleRate));
+    rmsTimeConstant = (float) (0.3 * sampleRate);
+
+    // Two biquads keep the harmonics above the decimated Nyquist frequency from folding down onto the fundamental
+    auto decimatedRate = sampleRate / decimationFactor;
+    auto coefficients = juce::dsp::IIR::Coefficients<float>::makeLowPass (sampleRate, (float) (decimatedRate * 0.2));
+
+    for (auto& filter : antiAliasingFilters)
+    {
+        filter.coefficients = coefficients;
+        filter.prepare ({ sampleRate, 1, 1 });
+    }
+
+    history.assign (historySize, 0.0f);
+    frame.assign (historySize, 0.0f);
+    windowSpectrum.assign (fftSize * 2, 0.0f);
+    historySpectrum.assign (fftSize * 2, 0.0f);
+    reset();
+}
+
+void SignalAnalyser::reset() noexcept
+{
+    envelope = meanSquare = 0.0f;
+    peakLevel.store (0.0f);
+    rmsLevel.store (0.0f);
+    frequency.store (0.0f);
+
+    for (auto& filter : antiAliasingFilters)
+        filter.reset();
+
+    std::fill (history.begin(), history.end(), 0.0f);
+    writeIndex = decimationPhase = samplesSinceEstimate = 0;
+    stage = PitchStage::waiting;
+}
+
+void SignalAnalyser::setPitchDetectionEnabled (bool shouldBeEnabled) noexcept
+{
+    if (shouldBeEnabled == pitchDetectionEnabled)
+        return;
+
+    pitchDetectionEnabled = shouldBeEnabled;
+    stage = PitchStage::waiting;
+    frequency.store (0.0f, std::memory_order_relaxed);
+}
+
+//==============================================================================
+void SignalAnalyser::process (const juce::dsp::AudioBlock<const float>& block) noexcept
+{
+    auto numSamples = (int) block.getNumSamples();
+    auto numChannels = block.getNumChannels();
+
+    if (numSamples == 0 || numChannels == 0)
+        return;
+
+    auto blockPeak = 0.0f;
+    auto blockSquares = 0.0f;
+
+    for (size_t ch = 0; ch < numChannels; ++ch)
+    {
+        auto* data = block.getChannelPointer (ch);
+        auto range = juce::FloatVectorOperations::findMinAndMax (data, numSamples);
+        blockPeak = juce::jmax (blockPeak, -range.getStart(), range.getEnd());
+
+        for (int i = 0; i < numSamples; ++i)
+            blockSquares += data[i] * data[i];
+    }
+
+    // The envelope jumps up to a peak and decays from it as if it had been sample by sample
+    envelope = juce::jmax (blockPeak, envelope * std::pow (envelopeRelease, (float) numSamples));
+
+    auto blockMeanSquare = blockSquares / (float) (numSamples * (int) numChannels);
+    meanSquare += (blockMeanSquare - meanSquare) * (1.0f - std::exp (-(float) numSamples / rmsTimeConstant));
+
+    peakLevel.store (envelope, std::memory_order_relaxed);
+    rmsLevel.store (std::sqrt (meanSquare), std::memory_order_relaxed);
+
+    if (! pitchDetectionEnabled)
+        return;
+
+    pushDecimated (block);
+    runPitchStage();
+}
+
+void SignalAnalyser::pushDecimated (const juce::dsp::AudioBlock<const float>& block) noexcept
+{
+    auto numChannels = block.getNumChannels();
+    auto gain = 1.0f / (float) numChannels;
+
+    for (size_t i = 0; i < block.getNumSamples(); ++i)
+    {
+        auto sample = 0.0f;
+
+        for (size_t ch = 0; ch < numChannels; ++ch)
+            sample += block.getSample ((int) ch, (int) i);
+
+        for (auto& filter : antiAliasingFilters)
+            sample = filter.processSample (sample);
+
+        if (++decimationPhase < decimationFactor)
+            continue;
+
+        decimationPhase = 0;
+        history[(size_t) writeIndex] = sample * gain;
+        writeIndex = (writeIndex + 1) % historySize;
+        ++samplesSinceEstimate;
+    }
+}
+
+//==============================================================================
+// One FFT at most per call: the window and the history are transformed separately, then
+// multiplied and transformed back, and the pitch is picked from the result on the next call.
+void SignalAnalyser::runPitchStage() noexcept
+{
+    switch (stage)
+    {
+        case PitchStage::waiting:
+            if (samplesSinceEstimate < hopSize)
+                break;
+
+            samplesSinceEstimate = 0;
+
+            // Oldest first, the window being the start of the history
+            for (int i = 0; i < historySize; ++i)
+                frame[(size_t) i] = history[(size_t) ((writeIndex + i) % historySize)];
+
+            stage = PitchStage::transformWindow;
+            break;
+
+        case PitchStage::transformWindow:
+            std::fill (windowSpectrum.begin(), windowSpectrum.end(), 0.0f);
+            std::copy (frame.begin(), frame.begin() + windowSize, windowSpectrum.begin());
+            fft.performRealOnlyForwardTransform (windowSpectrum.data());
+            stage = PitchStage::transformHistory;
+            break;
+
+        case PitchStage::transformHistory:
+            std::fill (historySpectrum.begin(), historySpectrum.end(), 0.0f);
+            std::copy (frame.begin(), frame.end(), historySpectrum.begin());
+            fft.performRealOnlyForwardTransform (historySpectrum.data());
+            stage = PitchStage::correlate;
+            break;
+
+        case PitchStage::correlate:
+        {
+            // conj (window) * history gives the cross-correlation sum of x[j] * x[j + lag] over the window
+            auto* window = reinterpret_cast<std::complex<float>*> (windowSpectrum.data());
+            auto* full = reinterpret_cast<std::complex<float>*> (historySpectrum.data());
+
+            for (int bin = 0; bin < fftSize; ++bin)
+                full[bin] *= std::conj (window[bin]);
+
+            fft.performRealOnlyInverseTransform (historySpectrum.data());
+            stage = PitchStage::pickPitch;
+            break;
+        }
+
+        case PitchStage::pickPitch:
+            frequency.store (pickPitch(), std::memory_order_relaxed);
+            stage = PitchStage::waiting;
+            break;
+    }
+}
+
+// YIN's cumulative mean normalised difference, with the difference built from the correlation:
+// d (lag) = energy of the window + energy of the window moved by lag - 2 * correlation (lag)
+float SignalAnalyser::pickPitch() const noexcept
+{
+    auto decimatedRate = (float) sampleRate / decimationFactor;
+    auto minLag = juce::jmax (2, (int) (decimatedRate / maxFrequency));
+    auto maxLag = juce::jmin (windowSize - 1, (int) (decimatedRate / minFrequency) + 1);
+    auto& correlation = historySpectrum;
+
+    auto windowEnergy = 0.0f;
+
+    for (int i = 0; i < windowSize; ++i)
+        windowEnergy += frame[(size_t) i] * frame[(size_t) i];
+
+    // Too quiet to be a note
+    if (windowEnergy < 1.0e-6f * (float) windowSize || correlation[0] <= 0.0f)
+        return 0.0f;
+
+    // The correlation at lag 0 is the window's energy, which takes care of however the FFT scales
+    auto correlationScale = windowEnergy / correlation[0];
+    auto movedEnergy = windowEnergy;
+    auto differenceSum = 0.0f;
+    auto previous = 1.0f;
+    auto bestLag = -1;
+    std::array<float, 3> neighbours { 1.0f, 1.0f, 1.0f };
+
+    for (int lag = 1; lag <= maxLag; ++lag)
+    {
+        movedEnergy += frame[(size_t) (lag + windowSize - 1)] * frame[(size_t) (lag + windowSize - 1)]
+                     - frame[(size_t) (lag - 1)] * frame[(size_t) (lag - 1)];
+
+        auto difference = juce::jmax (0.0f, windowEnergy + movedEnergy - 2.0f * correlationScale * correlation[(size_t) lag]);
+        differenceSum += difference;
+        auto normalised = differenceSum > 0.0f ? difference * (float) lag / differenceSum : 1.0f;
+
+        if (lag < minLag)
+        {
+            previous = normalised;
+            continue;
+        }
+
+        // The first dip under the threshold, followed down to its minimum
+        if (bestLag < 0 && normalised < yinThreshold)
+        {
+            bestLag = lag;
+            neighbours = { previous, normalised, 1.0f };
+        }
+        else if (bestLag >= 0)
+        {
+            if (normalised < neighbours[1])
+            {
+                bestLag = lag;
+                neighbours = { previous, normalised, 1.0f };
+            }
+            else
+            {
+                neighbours[2] = normalised;
+                break;
+            }
+        }
+
+        previous = normalised;
+    }
+
+    if (bestLag < 0)
+        return 0.0f;
+
+    // Parabolic interpolation between the neighbouring lags
+    auto denominator = neighbours[0] - 2.0f * neighbours[1] + neighbours[2];
+    auto offset = std::abs (denominator) > 1.0e-9f ? 0.5f * (neighbours[0] - neighbours[2]) / denominator : 0.0f;
+
+    return decimatedRate / ((float) bestLag + juce::jlimit (-0.5f, 0.5f, offset));
+}
@@ -0,0 +1,80 @@
+/*
+    Level and pitch analysis of the input, shared by the noise gate and the tuner.
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+/** Follows the input's peak and RMS level every block, and when pitch detection is on estimates
+    the pitch with YIN on a decimated copy of the input.
+
+    The YIN difference function comes from an FFT autocorrelation, split into stages of at most
+    one FFT each. A stage runs per call to process(), so an estimate takes a few blocks and no
+    block pays for more than one FFT. Nothing allocates after prepare().
+
+    The results are published through atomics and can be read from any thread.
+*/
+class SignalAnalyser
+{
+public:
+    static constexpr int decimationFactor = 4;
+    static constexpr int windowSize = 1024;             // Decimated samples compared per lag
+    static constexpr int historySize = windowSize * 2;  // Decimated samples the lags reach into
+    static constexpr int hopSize = 256;                 // Decimated samples between estimates
+    static constexpr float minFrequency = 60.0f;        // Below a drop C on a seven string
+    static constexpr float maxFrequency = 1500.0f;      // Above the 24th fret of the high E
+
+    SignalAnalyser();
+
+    //==============================================================================
+    void prepare (double sampleRate);
+    void reset() noexcept;
+
+    /** Pitch detection only runs while something needs it, the levels are always followed */
+    void setPitchDetectionEnabled (bool shouldBeEnabled) noexcept;
+
+    /** Audio thread, analyses the channels summed to mono */
+    void process (const juce::dsp::AudioBlock<const float>& block) noexcept;
+
+    //==============================================================================
+    /** Audio thread: the peak envelope as of the last block, instant attack and a 50 ms release */
+    float getEnvelope() const noexcept                  { return envelope; }
+
+    /** Any thread, linear levels */
+    float getPeakLevel() const noexcept                 { return peakLevel.load (std::memory_order_relaxed); }
+    float getRmsLevel() const noexcept                  { return rmsLevel.load (std::memory_order_relaxed); }
+
+    /** Any thread: the last pitch in Hz, or 0 when there was no clear one */
+    float getFrequency() const noexcept                 { return frequency.load (std::memory_order_relaxed); }
+
+private:
+    enum class PitchStage
+    {
+        waiting,
+        transformWindow,
+        transformHistory,
+        correlate,
+        pickPitch
+    };
+
+    void pushDecimated (const juce::dsp::AudioBlock<const float>& block) noexcept;
+    void runPitchStage() noexcept;
+    float pickPitch() const noexcept;
+
+    double sampleRate = 44100.0;
+    float envelope = 0.0f, meanSquare = 0.0f;
+    float envelopeRelease = 0.0f;       // Per sample
+    float rmsTimeConstant = 0.0f;       // In samples
+
+    std::atomic<float> peakLevel { 0.0f }, rmsLevel { 0.0f }, frequency { 0.0f };
+
+    bool pitchDetectionEnabled = false;
+    std::array<juce::dsp::IIR::Filter<float>, 2> antiAliasingFilters;
+    std::vector<float> history, frame;
+    int writeIndex = 0, decimationPhase = 0, samplesSinceEstimate = 0;
+
+    PitchStage stage = PitchStage::waiting;
+    juce::dsp::FFT fft;
+    std::vector<float> windowSpectrum, historySpectrum;
+};
@@ -0,0 +1,254 @@
+/*
+    Binary persistence of the processor state and preset bank, safe on a read-only SD card.
+*/
+
+#include "StateStore.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Layout after the header, all little endian:
+//   uint32_t parameterIdHashes[numParameters]
+//   float    values[numParameters]
+//   numPresets times { char name[maxNameLength]; float values[numParameters]; }
+
+StateStore::StateStore(const juce::File& store, const juce::File& journal)
+    :   storeFile(store),
+        journalFile(journal)
+{
+}
+
+uint32_t StateStore::getChecksum(const uint8_t* data, size_t size) noexcept
+{
+    uint32_t hash = 2166136261u;
+
+    for (size_t i = 0; i < size; ++i)
+        hash = (hash ^ data[i]) * 16777619u;
+
+    return hash;
+}
+
+std::vector<uint8_t> StateStore::serialise(Processor& processor)
+{
+    auto& presets = processor.getPresetBank();
+    auto numPresets = (size_t) presets.size();
+    auto numParameters = (size_t) Processor::numParameters;
+
+    std::vector<uint8_t> data(sizeof(Header) + numParameters * 8 + numPresets * (maxNameLength + numParameters * 4));
+    auto* write = data.data() + sizeof(Header);
+
+    auto append = [&write](const void* source, size_t size)
+    {
+        std::memcpy(write, source, size);
+        write += size;
+    };
+
+    for (size_t i = 0; i < numParameters; ++i)
+    {
+        auto hash = (uint32_t) Processor::getParameterID((int) i).hashCode();
+        append(&hash, sizeof(hash));
+    }
+
+    auto values = processor.getParameterValues();
+    append(values.data(), numParameters * sizeof(float));
+
+    for (int i = 0; i < (int) numPresets; ++i)
+    {
+        auto* preset = presets.getPreset(i);
+        char name[maxNameLength] {};
+        preset->name.copyToUTF8(name, maxNameLength);
+        append(name, maxNameLength);
+        append(preset->values.data(), numParameters * sizeof(float));
+    }
+
+    Header header { magic, version, (uint32_t) numParameters, (uint32_t) numPresets,
+                    getChecksum(data.data() + sizeof(Header), data.size() - sizeof(Header)) };
+    std::memcpy(data.data(), &header, sizeof(header));
+    return data;
+}
+
+//==============================================================================
+juce::Result StateStore::load(Processor& processor, bool loadPresets)
+{
+    if (journalFile.existsAsFile())
+    {
+        auto result = loadFile(journalFile, processor, loadPresets);
+
+        if (result.wasOk())
+            return result;
+
+        std::cerr << result.getErrorMessage() << ", falling back to the committed state" << std::endl;
+    }
+
+    return loadFile(storeFile, processor, loadPresets);
+}
+
+juce::Result StateStore::loadFile(const juce::File& file, Processor& processor, bool loadPresets)
+{
+    auto fd = open(file.getFullPathName().toRawUTF8(), O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0)
+        return juce::Result::fail("Could not open " + file.getFullPathName());
+
+    struct stat info;
+    auto size = fstat(fd, &info) == 0 ? (size_t) info.st_size : 0;
+    auto* mapped = size >= sizeof(Header) ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+
+    if (mapped == MAP_FAILED)
+        return juce::Result::fail("Could not map " + file.getFullPathName());
+
+    auto* data = static_cast<const uint8_t*>(mapped);
+    Header header;
+    std::memcpy(&header, data, sizeof(header));
+
+    auto numParameters = (size_t) header.numParameters;
+    auto expectedSize = sizeof(Header) + numParameters * 8 + (size_t) header.numPresets * (maxNameLength + numParameters * 4);
+
+    if (header.magic != magic || header.version != version || size != expectedSize
+        || header.checksum != getChecksum(data + sizeof(Header), size - sizeof(Header)))
+    {
+        munmap(mapped, size);
+        return juce::Result::fail("Corrupt or incompatible state file " + file.getFullPathName());
+    }
+
+    // Where each stored value goes, -1 for parameters this build no longer has
+    std::vector<int> indices(numParameters, -1);
+    auto* hashes = data + sizeof(Header);
+
+    for (size_t i = 0; i < numParameters; ++i)
+    {
+        uint32_t hash;
+        std::memcpy(&hash, hashes + i * 4, sizeof(hash));
+
+        for (int p = 0; p < Processor::numParameters; ++p)
+            if ((uint32_t) Processor::getParameterID(p).hashCode() == hash)
+                indices[i] = p;
+    }
+
+    auto readValues = [&](const uint8_t* source, std::vector<float>& values)
+    {
+        for (size_t i = 0; i < numParameters; ++i)
+        {
+            if (indices[i] < 0)
+                continue;
+
+            float value;
+            std::memcpy(&value, source + i * 4, sizeof(value));
+            auto* parameter = processor.getParameterByIndex(indices[i]);
+            values[(size_t) indices[i]] = parameter->convertFrom0to1(parameter->convertTo0to1(value));
+        }
+    };
+
+    auto values = processor.getParameterValues();
+    readValues(hashes + numParameters * 4, values);
+
+    if (loadPresets)
+    {
+        auto* presetData = hashes + numParameters * 8;
+        auto presetSize = maxNameLength + numParameters * 4;
+
+        for (size_t i = 0; i < header.numPresets; ++i, presetData += presetSize)
+        {
+            auto preset = PresetBank::createPreset(juce::XmlElement("Parameters"), processor);
+            preset->name = juce::String::fromUTF8(reinterpret_cast<const char*>(presetData),
+                                                  (int) strnlen(reinterpret_cast<const char*>(presetData), maxNameLength));
+            readValues(presetData + maxNameLength, preset->values);
+            processor.getPresetBank().addPreset(std::move(preset));
+        }
+    }
+
+    munmap(mapped, size);
+
+    processor.setParameterValues(values);
+
+    // Nothing has changed since what was just loaded
+    lastJournaled = serialise(processor);
+    return juce::Result::ok();
+}
+
+//==============================================================================
+juce::Result StateStore::journal(Processor& processor)
+{
+    auto data = serialise(processor);
+
+    if (data == lastJournaled)
+        return juce::Result::ok();
+
+    auto result = writeFile(journalFile, data, false);
+
+    if (result.wasOk())
+        lastJournaled = std::move(data);
+
+    return result;
+}
+
+juce::Result StateStore::commit(Processor& processor)
+{
+    auto data = serialise(processor);
+    auto result = writeFile(storeFile, data, true);
+
+    if (result.failed())
+        return result;
+
+    // The store is now current, the journal only gets written again once something changes
+    journalFile.deleteFile();
+    lastJournaled = std::move(data);
+    return juce::Result::ok();
+}
+
+// Writes next to the target and renames over it, so readers only ever see a complete file.
+// A durable write also syncs the file and its directory, so the rename survives a power cut.
+juce::Result StateStore::writeFile(const juce::File& file, const std::vector<uint8_t>& data, bool durable)
+{
+    auto path = file.getFullPathName();
+    auto temporaryPath = path + ".tmp";
+    auto fd = open(temporaryPath.toRawUTF8(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+    if (fd < 0)
+    {
+        perror("Error creating state file");
+        return juce::Result::fail("Could not write " + temporaryPath);
+    }
+
+    size_t written = 0;
+
+    while (written < data.size())
+    {
+        auto result = write(fd, data.data() + written, data.size() - written);
+
+        if (result < 0 && errno == EINTR)
+            continue;
+
+        if (result <= 0)
+            break;
+
+        written += (size_t) result;
+    }
+
+    auto ok = written == data.size() && (! durable || fsync(fd) == 0);
+    close(fd);
+
+    if (! ok || rename(temporaryPath.toRawUTF8(), path.toRawUTF8()) != 0)
+    {
+        perror("Error writing state file");
+        unlink(temporaryPath.toRawUTF8());
+        return juce::Result::fail("Could not write " + path);
+    }
+
+    if (durable)
+    {
+        auto directoryFd = open(file.getParentDirectory().getFullPathName().toRawUTF8(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+        if (directoryFd >= 0)
+        {
+            fsync(directoryFd);
+            close(directoryFd);
+        }
+    }
+
+    return juce::Result::ok();
+}
@@ -0,0 +1,57 @@
+/*
+    Binary persistence of the processor state and preset bank, safe on a read-only SD card.
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <vector>
+#include "AudioProcessor.h"
+
+/** Keeps the committed state in one small binary file that is read through mmap at
+    startup. Changes only go to a journal on tmpfs, so nothing touches the SD card until
+    commit(), which replaces the store with rename() and fsync() so a power cut leaves
+    either the old or the new file, never half of one.
+
+    Values are stored against a hash of their parameter ID, so a store written by an older
+    build still loads after parameters are added or reordered.
+*/
+class StateStore
+{
+public:
+    StateStore(const juce::File& storeFile, const juce::File& journalFile);
+
+    /** Loads the journal if there is one, which holds changes made since the last commit,
+        and the committed store otherwise. When loadPresets is set the stored presets are appended
+        to the bank, which never removes any, so load into a bank that is still empty.
+    */
+    juce::Result load(Processor& processor, bool loadPresets);
+
+    /** Writes the current state and presets to the journal if they changed since the last call */
+    juce::Result journal(Processor& processor);
+
+    /** Atomically replaces the committed store with the current state */
+    juce::Result commit(Processor& processor);
+
+private:
+    static constexpr uint32_t magic = 0x53584647;  // "GFXS"
+    static constexpr uint32_t version = 1;
+    static constexpr size_t maxNameLength = 32;
+
+    struct Header
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t numParameters;
+        uint32_t numPresets;
+        uint32_t checksum;      // FNV-1a over everything after the header
+    };
+
+    static std::vector<uint8_t> serialise(Processor& processor);
+    static uint32_t getChecksum(const uint8_t* data, size_t size) noexcept;
+    static juce::Result writeFile(const juce::File& file, const std::vector<uint8_t>& data, bool durable);
+    juce::Result loadFile(const juce::File& file, Processor& processor, bool loadPresets);
+
+    juce::File storeFile, journalFile;
+    std::vector<uint8_t> lastJournaled;
+};
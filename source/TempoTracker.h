@@ -0,0 +1,85 @@
+/*
+    Tempo from a tap tempo footswitch or from MIDI clock.
+*/
+
+#pragma once
+
+#include <array>
+#include <cmath>
+
+/** Turns taps or MIDI clock ticks into beats per minute. Times are in seconds on any clock
+    that only goes forwards, so the audio thread can use its sample position.
+*/
+class TempoTracker
+{
+public:
+    static constexpr double minBpm = 40.0;
+    static constexpr double maxBpm = 300.0;
+
+    /** A footswitch press. Returns the tempo from the last few taps, or 0 for the first tap
+        after a pause, which starts counting afresh.
+    */
+    double tap (double timeInSeconds) noexcept
+    {
+        auto interval = timeInSeconds - lastTapTime;
+        lastTapTime = timeInSeconds;
+
+        if (interval <= 60.0 / maxBpm || interval >= 60.0 / minBpm)
+        {
+            numIntervals = nextInterval = 0;
+            return 0.0;
+        }
+
+        intervals[nextInterval] = interval;
+        nextInterval = (nextInterval + 1) % intervals.size();
+        numIntervals = numIntervals < intervals.size() ? numIntervals + 1 : numIntervals;
+
+        auto sum = 0.0;
+
+        for (size_t i = 0; i < numIntervals; ++i)
+            sum += intervals[i];
+
+        return 60.0 * (double) numIntervals / sum;
+    }
+
+    /** A MIDI clock tick, 24 to the beat. Returns the tempo once per beat, 0 in between. */
+    double clock (double timeInSeconds) noexcept
+    {
+        // A pause in the clock restarts the count, the same as a start message
+        if (ticks > 0 && timeInSeconds - lastTickTime > 60.0 / minBpm / ticksPerBeat * 4.0)
+            ticks = 0;
+
+        lastTickTime = timeInSeconds;
+
+        if (ticks++ == 0)
+        {
+            beatStartTime = timeInSeconds;
+            return 0.0;
+        }
+
+        if (ticks <= ticksPerBeat)
+            return 0.0;
+
+        auto bpm = 60.0 / (timeInSeconds - beatStartTime);
+        beatStartTime = timeInSeconds;
+        ticks = 1;
+
+        return bpm >= minBpm && bpm <= maxBpm ? bpm : 0.0;
+    }
+
+    /** MIDI start and continue, the next tick starts a beat */
+    void restartClock() noexcept
+    {
+        ticks = 0;
+    }
+
+private:
+    static constexpr int ticksPerBeat = 24;
+
+    std::array<double, 4> intervals {};
+    size_t numIntervals = 0, nextInterval = 0;
+    double lastTapTime = -1.0e9;
+
+    int ticks = 0;
+    double lastTickTime = 0.0, beatStartTime = 0.0;
+};